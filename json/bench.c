@@ -0,0 +1,1070 @@
+/* JSON Library benchmarks */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "json.h"
+
+#define BENCH_DOC_SIZE ((size_t)50 << 20)
+#define BENCH_ROUNDS 5
+
+
+/* Allocation counting */
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static size_t bench_alloc_count = 0;
+
+void *malloc(size_t size);
+void *calloc(size_t nmemb, size_t size);
+void *realloc(void *ptr, size_t size);
+void free(void *ptr);
+
+void *malloc(size_t size)
+{
+    __atomic_fetch_add(&bench_alloc_count, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    __atomic_fetch_add(&bench_alloc_count, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    __atomic_fetch_add(&bench_alloc_count, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+static size_t bench_allocs(void)
+{
+    return __atomic_load_n(&bench_alloc_count, __ATOMIC_RELAXED);
+}
+#else
+static size_t bench_allocs(void)
+{
+    return 0;
+}
+#endif
+
+
+/* Helpers */
+
+static double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static double bench_mbps(size_t bytes, double seconds)
+{
+    return ((double)bytes / (1024.0 * 1024.0)) / seconds;
+}
+
+/* [{"id":0,"name":"record0",...},...] of roughly size bytes */
+static char *bench_make_records(size_t size, size_t *len_out)
+{
+    size_t cap = size + 256;
+    char *str = (char *)malloc(cap);
+    size_t len = 0;
+    int idx = 0;
+
+    if (str == NULL) return NULL;
+    str[len++] = '[';
+    while (len < size)
+    {
+        if (idx != 0) str[len++] = ',';
+        len += (size_t)sprintf(str + len, \
+                "{\"id\":%d,\"name\":\"record%d\",\"tags\":[\"alpha\",\"beta\"]," \
+                "\"active\":true,\"parent\":null}", idx, idx);
+        idx++;
+    }
+    str[len++] = ']';
+    str[len] = '\0';
+
+    *len_out = len;
+    return str;
+}
+
+/* {"id":0,"name":"record0",...} per line, roughly size bytes */
+static char *bench_make_ndjson(size_t size, size_t *len_out)
+{
+    size_t cap = size + 256;
+    char *str = (char *)malloc(cap);
+    size_t len = 0;
+    int idx = 0;
+
+    if (str == NULL) return NULL;
+    while (len < size)
+    {
+        len += (size_t)sprintf(str + len, \
+                "{\"id\":%d,\"name\":\"record%d\",\"tags\":[\"alpha\",\"beta\"]," \
+                "\"active\":true,\"parent\":null}\n", idx, idx);
+        idx++;
+    }
+    str[len] = '\0';
+
+    *len_out = len;
+    return str;
+}
+
+/* [{"msg":"<log line>","blob":"<base64>"},...] of roughly size bytes */
+static char *bench_make_strings(size_t size, size_t *len_out)
+{
+    static const char b64[] = \
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t cap = size + 2048;
+    char *str = (char *)malloc(cap);
+    size_t len = 0;
+    size_t idx;
+    unsigned int seed = 1;
+
+    if (str == NULL) return NULL;
+    str[len++] = '[';
+    while (len < size)
+    {
+        if (len != 1) str[len++] = ',';
+        len += (size_t)sprintf(str + len, \
+                "{\"msg\":\"2016-05-04 12:00:%02u INFO worker-%u handled " \
+                "request \\/api\\/v1\\/items\\/%u in %u ms, cache miss,\\tupstream " \
+                "shard-%u replied 200 OK after retry\",\"blob\":\"", \
+                seed % 60, seed % 16, seed, seed % 1000, seed % 7);
+        for (idx = 0; idx != 1024; idx++)
+        {
+            seed = seed * 1103515245u + 12345u;
+            str[len++] = b64[(seed >> 16) & 63];
+        }
+        str[len++] = '\"';
+        str[len++] = '}';
+    }
+    str[len++] = ']';
+    str[len] = '\0';
+
+    *len_out = len;
+    return str;
+}
+
+/* The records document as a pretty-printer with a two space indent
+ * would write it */
+static char *bench_make_pretty(size_t size, size_t *len_out)
+{
+    size_t cap = size + 512;
+    char *str = (char *)malloc(cap);
+    size_t len = 0;
+    int idx = 0;
+
+    if (str == NULL) return NULL;
+    len += (size_t)sprintf(str + len, "[\n");
+    while (len < size)
+    {
+        if (idx != 0) len += (size_t)sprintf(str + len, ",\n");
+        len += (size_t)sprintf(str + len, \
+                "  {\n" \
+                "    \"id\": %d,\n" \
+                "    \"name\": \"record%d\",\n" \
+                "    \"tags\": [\n" \
+                "      \"alpha\",\n" \
+                "      \"beta\"\n" \
+                "    ],\n" \
+                "    \"active\": true,\n" \
+                "    \"parent\": null\n" \
+                "  }", idx, idx);
+        idx++;
+    }
+    len += (size_t)sprintf(str + len, "\n]\n");
+
+    *len_out = len;
+    return str;
+}
+
+/* [0,1,2,...] with count elements */
+static char *bench_make_integers(size_t count, size_t *len_out)
+{
+    size_t cap = count * 12 + 2;
+    char *str = (char *)malloc(cap);
+    size_t len = 0;
+    size_t idx;
+
+    if (str == NULL) return NULL;
+    str[len++] = '[';
+    for (idx = 0; idx != count; idx++)
+    {
+        if (idx != 0) str[len++] = ',';
+        len += (size_t)sprintf(str + len, "%lu", (unsigned long)(idx % 1000000));
+    }
+    str[len++] = ']';
+    str[len] = '\0';
+
+    *len_out = len;
+    return str;
+}
+
+/* A telemetry-like array of doubles up to size bytes: short fixed
+ * readings, full-precision values and small exponents */
+static char *bench_make_floats(size_t size, size_t *len_out)
+{
+    char *str = (char *)malloc(size + 64);
+    size_t len = 0;
+    size_t idx;
+    unsigned long seed = 12345;
+    double value;
+
+    if (str == NULL) return NULL;
+    str[len++] = '[';
+    for (idx = 0; len < size; idx++)
+    {
+        if (idx != 0) str[len++] = ',';
+        seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+        value = (double)(seed >> 11) / 9007199254740992.0;
+        switch (idx % 4)
+        {
+            case 0:
+            case 1:
+                len += (size_t)sprintf(str + len, "%.3f", value * 1000.0 - 500.0);
+                break;
+            case 2:
+                len += (size_t)sprintf(str + len, "%.17g", value * 100.0);
+                break;
+            default:
+                len += (size_t)sprintf(str + len, "%.6e", value * 1e-7);
+                break;
+        }
+    }
+    str[len++] = ']';
+    str[len] = '\0';
+
+    *len_out = len;
+    return str;
+}
+
+/* The same numbers through strtod, as the reference */
+static void bench_strtod(char *str, size_t len)
+{
+    int round;
+    double t0, sum = 0.0;
+    char *str_p;
+
+    t0 = bench_now();
+    for (round = 0; round != BENCH_ROUNDS; round++)
+    {
+        for (str_p = str + 1; *str_p != '\0'; str_p++)
+        { sum += strtod(str_p, &str_p); }
+    }
+    printf("%-24s strtod %8.1f MB/s  (sum %g)\n", "scan strtod", \
+            bench_mbps(len * BENCH_ROUNDS, bench_now() - t0), sum);
+}
+
+/* Every double of an array through snprintf("%.17g"), the usual way
+ * to print one that reads back the same */
+static void bench_snprintf(json_t *json, size_t len)
+{
+    int round;
+    double t0;
+    size_t idx, count = json_node_array_size(json->root);
+    char buf[32];
+    size_t out = 0;
+
+    t0 = bench_now();
+    for (round = 0; round != BENCH_ROUNDS; round++)
+    {
+        for (idx = 0; idx != count; idx++)
+        {
+            out += (size_t)snprintf(buf, sizeof(buf), "%.17g", \
+                    json_node_array_get(json->root, idx)->u.number_part.double_part);
+        }
+    }
+    printf("%-24s snprintf %6.1f MB/s  (%lu bytes)\n", "print snprintf", \
+            bench_mbps(len * BENCH_ROUNDS, bench_now() - t0), (unsigned long)out);
+}
+
+/* {"key0":0,"key1":1,...} with count members */
+static char *bench_make_keys(size_t count, size_t *len_out)
+{
+    size_t cap = count * 24 + 2;
+    char *str = (char *)malloc(cap);
+    size_t len = 0;
+    size_t idx;
+
+    if (str == NULL) return NULL;
+    str[len++] = '{';
+    for (idx = 0; idx != count; idx++)
+    {
+        if (idx != 0) str[len++] = ',';
+        len += (size_t)sprintf(str + len, "\"key%lu\":%lu", \
+                (unsigned long)idx, (unsigned long)idx);
+    }
+    str[len++] = '}';
+    str[len] = '\0';
+
+    *len_out = len;
+    return str;
+}
+
+
+/* Benchmarks */
+
+static void bench_load(const char *name, char *str, size_t len, \
+        unsigned int flags)
+{
+    int round;
+    double load_time = 0.0, destroy_time = 0.0, t0, t1, t2;
+    size_t allocs = 0, allocs0;
+    json_t *json = NULL;
+
+    for (round = 0; round != BENCH_ROUNDS; round++)
+    {
+        allocs0 = bench_allocs();
+        t0 = bench_now();
+        if (json_load_ex(&json, str, len, flags) != 0)
+        { printf("%-24s load failed\n", name); return; }
+        t1 = bench_now();
+        allocs += bench_allocs() - allocs0;
+        json_destroy(json);
+        t2 = bench_now();
+        load_time += t1 - t0;
+        destroy_time += t2 - t1;
+    }
+
+    printf("%-24s load %8.1f MB/s  destroy %8.1f MB/s  allocs/doc %10lu\n", \
+            name, \
+            bench_mbps(len * BENCH_ROUNDS, load_time), \
+            bench_mbps(len * BENCH_ROUNDS, destroy_time), \
+            (unsigned long)(allocs / BENCH_ROUNDS));
+}
+
+/* A cursor over a root array of records: stepping over the whole
+ * root, over every record, and reading one field of each */
+static void bench_cursor(const char *name, char *str, size_t len, \
+        const char *key)
+{
+    static const char *labels[3] = { "skip root", "skip items", "pluck" };
+    int round, mode, ret;
+    double times[3] = { 0.0, 0.0, 0.0 }, t0;
+    size_t count = 0;
+    const char *value;
+    size_t value_len;
+    char label[48];
+    json_cursor_t *cursor;
+
+    for (round = 0; round != BENCH_ROUNDS; round++)
+    {
+        for (mode = 0; mode != 3; mode++)
+        {
+            t0 = bench_now();
+            if ((cursor = json_cursor_new(str, len, JSON_LOAD_DEFAULT)) == NULL)
+            { return; }
+            if (mode == 0) ret = json_cursor_next(cursor) - 1;
+            else ret = json_cursor_enter(cursor);
+            while (ret == 0)
+            {
+                if (mode == 2)
+                {
+                    if ((json_cursor_enter(cursor) != 0) || \
+                            (json_cursor_find(cursor, key, strlen(key)) != 0) || \
+                            (json_cursor_get_string(cursor, &value, \
+                                                    &value_len) != 0))
+                    { ret = -1; break; }
+                    count += value_len;
+                    if ((ret = json_cursor_leave(cursor)) != 0) break;
+                }
+                ret = json_cursor_next(cursor);
+            }
+            json_cursor_destroy(cursor);
+            if (ret == -1)
+            { printf("%-24s cursor failed\n", name); return; }
+            times[mode] += bench_now() - t0;
+        }
+    }
+
+    for (mode = 0; mode != 3; mode++)
+    {
+        sprintf(label, "%s %s", name, labels[mode]);
+        printf("%-24s cursor %8.1f MB/s\n", label, \
+                bench_mbps(len * BENCH_ROUNDS, times[mode]));
+    }
+    (void)count;
+}
+
+/* Recursive descent against the two-stage indexed engine, in GB/s */
+static void bench_engines(const char *name, char *str, size_t len)
+{
+    static const unsigned int engines[2] = { JSON_LOAD_DEFAULT, JSON_LOAD_INDEXED };
+    double load_time[2] = { 0.0, 0.0 }, t0;
+    int round, engine;
+    json_t *json = NULL;
+
+    for (round = 0; round != BENCH_ROUNDS; round++)
+    {
+        for (engine = 0; engine != 2; engine++)
+        {
+            t0 = bench_now();
+            if (json_load_ex(&json, str, len, engines[engine]) != 0)
+            { printf("%-24s load failed\n", name); return; }
+            load_time[engine] += bench_now() - t0;
+            json_destroy(json);
+        }
+    }
+
+    printf("%-24s recursive %6.2f GB/s  indexed %6.2f GB/s\n", name, \
+            bench_mbps(len * BENCH_ROUNDS, load_time[0]) / 1024.0, \
+            bench_mbps(len * BENCH_ROUNDS, load_time[1]) / 1024.0);
+}
+
+static void bench_array_index(size_t count)
+{
+    size_t len, idx, pos = 0;
+    size_t probes = (size_t)10000000;
+    long sum = 0;
+    double t0, t1;
+    char *str = bench_make_integers(count, &len);
+    json_t *json = NULL;
+
+    if (str == NULL) return;
+    if (json_load(&json, str, len) != 0)
+    { printf("array index load failed\n"); free(str); return; }
+
+    t0 = bench_now();
+    for (idx = 0; idx != probes; idx++)
+    {
+        /* Stride through the array so every probe is a random access */
+        pos = (pos + 7919) % count;
+        sum += json_node_array_get(json->root, pos)->u.number_part.int_part;
+    }
+    t1 = bench_now();
+
+    printf("%-24s %lu elements  %6.2f ns/get  (sum %ld)\n", "array index", \
+            (unsigned long)count, (t1 - t0) * 1e9 / (double)probes, sum);
+    json_destroy(json);
+    free(str);
+}
+
+static void bench_dump(const char *name, json_t *json, unsigned int flags)
+{
+    int round;
+    double dump_time = 0.0, t0;
+    size_t len = 0;
+    char *str = NULL;
+
+    for (round = 0; round != BENCH_ROUNDS; round++)
+    {
+        t0 = bench_now();
+        if (json_dump_ex(json, &str, &len, flags, 0) != 0)
+        { printf("%-24s dump failed\n", name); return; }
+        dump_time += bench_now() - t0;
+        free(str);
+    }
+
+    printf("%-24s dump %8.1f MB/s\n", name, \
+            bench_mbps(len * BENCH_ROUNDS, dump_time));
+}
+
+static int bench_null_write(void *ctx, const char *data, size_t len)
+{
+    (void)data;
+    *(size_t *)ctx += len;
+    return 0;
+}
+
+static void bench_dump_stream(const char *name, json_t *json)
+{
+    int round;
+    double dump_time = 0.0, t0;
+    size_t allocs0, allocs = 0, len = 0;
+
+    for (round = 0; round != BENCH_ROUNDS; round++)
+    {
+        allocs0 = bench_allocs();
+        t0 = bench_now();
+        if (json_dump_cb(json, bench_null_write, &len) != 0)
+        { printf("%-24s dump failed\n", name); return; }
+        dump_time += bench_now() - t0;
+        allocs += bench_allocs() - allocs0;
+    }
+
+    printf("%-24s dump %8.1f MB/s  allocs/dump %lu\n", name, \
+            bench_mbps(len, dump_time), \
+            (unsigned long)(allocs / BENCH_ROUNDS));
+}
+
+static int bench_count_start_object(void *ctx)
+{
+    (*(size_t *)ctx)++;
+    return 0;
+}
+
+static void bench_sax_count(char *str, size_t len)
+{
+    int round;
+    double sax_time = 0.0, t0;
+    size_t allocs0, allocs = 0, records = 0;
+    json_sax_t sax;
+
+    memset(&sax, 0, sizeof(sax));
+    sax.on_start_object = bench_count_start_object;
+    for (round = 0; round != BENCH_ROUNDS; round++)
+    {
+        allocs0 = bench_allocs();
+        t0 = bench_now();
+        if (json_sax_parse(str, len, &sax, &records) != 0)
+        { printf("sax count failed\n"); return; }
+        sax_time += bench_now() - t0;
+        allocs += bench_allocs() - allocs0;
+    }
+
+    printf("%-24s load %8.1f MB/s  allocs/doc %10lu  (%lu records)\n", \
+            "sax count records", bench_mbps(len * BENCH_ROUNDS, sax_time), \
+            (unsigned long)(allocs / BENCH_ROUNDS), \
+            (unsigned long)(records / BENCH_ROUNDS));
+}
+
+static void bench_parser(char *str, size_t len, size_t chunk)
+{
+    int round;
+    double parse_time = 0.0, t0;
+    size_t pos, step;
+    char name[48];
+    json_t *json = NULL;
+    json_parser_t *parser = json_parser_new(JSON_LOAD_DEFAULT);
+
+    if (parser == NULL) return;
+    sprintf(name, "push parser %luK chunks", (unsigned long)(chunk >> 10));
+    for (round = 0; round != BENCH_ROUNDS; round++)
+    {
+        t0 = bench_now();
+        for (pos = 0; pos < len; pos += step)
+        {
+            step = (len - pos < chunk) ? len - pos : chunk;
+            if (json_parser_feed(parser, str + pos, step) != 0) break;
+        }
+        if (json_parser_finish(parser, &json) != 0)
+        { printf("%-24s failed\n", name); break; }
+        parse_time += bench_now() - t0;
+        json_destroy(json);
+    }
+
+    printf("%-24s load %8.1f MB/s\n", name, \
+            bench_mbps(len * BENCH_ROUNDS, parse_time));
+    json_parser_destroy(parser);
+}
+
+static void bench_load_parallel(const char *label, char *str, size_t len)
+{
+    static const size_t nthreads[5] = { 1, 2, 4, 8, 16 };
+    int round, idx;
+    double load_time, t0;
+    char name[48];
+    json_t *json = NULL;
+
+    for (idx = 0; idx != 5; idx++)
+    {
+        load_time = 0.0;
+        for (round = 0; round != BENCH_ROUNDS; round++)
+        {
+            t0 = bench_now();
+            if (json_load_parallel(&json, str, len, JSON_LOAD_DEFAULT, \
+                        nthreads[idx]) != 0)
+            { printf("%-24s load failed\n", label); return; }
+            load_time += bench_now() - t0;
+            json_destroy(json);
+        }
+        sprintf(name, "%s %lu threads", label, (unsigned long)nthreads[idx]);
+        printf("%-24s load %8.1f MB/s\n", name, \
+                bench_mbps(len * BENCH_ROUNDS, load_time));
+    }
+}
+
+static void bench_dump_parallel(const char *label, json_t *json)
+{
+    static const size_t nthreads[5] = { 1, 2, 4, 8, 16 };
+    int round, idx;
+    double dump_time, t0;
+    size_t len = 0;
+    char name[48];
+    char *str = NULL;
+
+    for (idx = 0; idx != 5; idx++)
+    {
+        dump_time = 0.0;
+        for (round = 0; round != BENCH_ROUNDS; round++)
+        {
+            t0 = bench_now();
+            if (json_dump_parallel(json, &str, &len, nthreads[idx]) != 0)
+            { printf("%-24s dump failed\n", label); return; }
+            dump_time += bench_now() - t0;
+            free(str);
+        }
+        sprintf(name, "%s %lu threads", label, (unsigned long)nthreads[idx]);
+        printf("%-24s dump %8.1f MB/s\n", name, \
+                bench_mbps(len * BENCH_ROUNDS, dump_time));
+    }
+}
+
+/* A document loaded from a file: read into a malloc'd buffer and
+ * loaded from there, against json_load_file's mapping, warm cache */
+static void bench_load_file(char *str, size_t len, unsigned int flags)
+{
+    static const char path[] = "bench_load_file.json";
+    int round;
+    double read_time = 0.0, map_time = 0.0, t0;
+    char *buf;
+    FILE *fp;
+    json_t *json;
+
+    if ((fp = fopen(path, "wb")) == NULL) return;
+    if ((fwrite(str, 1, len, fp) != len) | (fclose(fp) != 0)) goto fail;
+
+    for (round = 0; round != BENCH_ROUNDS; round++)
+    {
+        t0 = bench_now();
+        if ((buf = (char *)malloc(len)) == NULL) goto fail;
+        if ((fp = fopen(path, "rb")) == NULL)
+        {
+            free(buf);
+            goto fail;
+        }
+        if ((fread(buf, 1, len, fp) != len) | \
+                (json_load_ex(&json, buf, len, flags) != 0))
+        {
+            fclose(fp);
+            free(buf);
+            goto fail;
+        }
+        fclose(fp);
+        read_time += bench_now() - t0;
+        json_destroy(json);
+        free(buf);
+
+        t0 = bench_now();
+        if (json_load_file(&json, path, flags) != 0) goto fail;
+        map_time += bench_now() - t0;
+        json_destroy(json);
+    }
+
+    printf("%-24s read+load %8.1f MB/s  load_file %8.1f MB/s\n", \
+            (flags & JSON_LOAD_INSITU) ? "file in-situ" : "file", \
+            bench_mbps(len * BENCH_ROUNDS, read_time), \
+            bench_mbps(len * BENCH_ROUNDS, map_time));
+    remove(path);
+    return;
+
+fail:
+    printf("%-24s load failed\n", "file");
+    remove(path);
+}
+
+/* The binary form of a loaded document: its size, the dump, and a
+ * reload timed against json_load of the text, per document */
+static void bench_binary(char *str, size_t len, json_t *json)
+{
+    int round;
+    double dump_time = 0.0, text_time = 0.0, binary_time = 0.0, \
+        insitu_time = 0.0, t0;
+    size_t buf_len = 0;
+    char *buf = NULL;
+    json_t *new_json;
+
+    for (round = 0; round != BENCH_ROUNDS; round++)
+    {
+        if (buf != NULL) free(buf);
+        t0 = bench_now();
+        if (json_dump_binary(json, &buf, &buf_len) != 0)
+        { printf("%-24s dump failed\n", "binary"); return; }
+        dump_time += bench_now() - t0;
+    }
+    for (round = 0; round != BENCH_ROUNDS; round++)
+    {
+        t0 = bench_now();
+        if (json_load(&new_json, str, len) != 0) goto fail;
+        text_time += bench_now() - t0;
+        json_destroy(new_json);
+
+        t0 = bench_now();
+        if (json_load_binary(&new_json, buf, buf_len, JSON_LOAD_DEFAULT) != 0)
+        { goto fail; }
+        binary_time += bench_now() - t0;
+        json_destroy(new_json);
+
+        t0 = bench_now();
+        if (json_load_binary(&new_json, buf, buf_len, JSON_LOAD_INSITU) != 0)
+        { goto fail; }
+        insitu_time += bench_now() - t0;
+        json_destroy(new_json);
+    }
+
+    printf("%-24s size %10lu bytes (text %lu)  dump %8.1f MB/s\n", "binary", \
+            (unsigned long)buf_len, (unsigned long)len, \
+            bench_mbps(buf_len * BENCH_ROUNDS, dump_time));
+    printf("%-24s text %8.2f ms  binary %8.2f ms  binary in-situ %8.2f ms\n", \
+            "reload", text_time * 1000.0 / BENCH_ROUNDS, \
+            binary_time * 1000.0 / BENCH_ROUNDS, \
+            insitu_time * 1000.0 / BENCH_ROUNDS);
+    free(buf);
+    return;
+
+fail:
+    printf("%-24s load failed\n", "binary");
+    free(buf);
+}
+
+/* The tape of a root array of records: its size and dump, then one
+ * field of every record read from the tape where it lies, against
+ * json_load and a walk of the tree, and the tape loaded into a tree */
+static void bench_tape(char *str, size_t len, json_t *json, const char *key)
+{
+    int round;
+    double dump_time = 0.0, text_time = 0.0, tape_time = 0.0, \
+        load_time = 0.0, t0;
+    size_t buf_len = 0, key_len = strlen(key), found = 0, size, idx;
+    char *buf = NULL;
+    json_t *new_json;
+    json_tape_t *tape;
+    json_node_t *root;
+
+    for (round = 0; round != BENCH_ROUNDS; round++)
+    {
+        if (buf != NULL) free(buf);
+        t0 = bench_now();
+        if (json_tape_dump(json, &buf, &buf_len) != 0)
+        { printf("%-24s dump failed\n", "tape"); return; }
+        dump_time += bench_now() - t0;
+    }
+    for (round = 0; round != BENCH_ROUNDS; round++)
+    {
+        t0 = bench_now();
+        if (json_load(&new_json, str, len) != 0) goto fail;
+        root = new_json->root;
+        for (idx = 0; idx != json_node_array_size(root); idx++)
+        {
+            if (json_node_object_get(json_node_array_get(root, idx), \
+                        key, key_len) != NULL)
+            { found++; }
+        }
+        text_time += bench_now() - t0;
+        json_destroy(new_json);
+
+        t0 = bench_now();
+        if ((tape = json_tape_new(buf, buf_len)) == NULL) goto fail;
+        size = json_tape_size(tape, JSON_TAPE_ROOT);
+        for (idx = 0; idx != size; idx++)
+        {
+            if (json_tape_object_get(tape, json_tape_array_get(tape, \
+                            JSON_TAPE_ROOT, idx), key, key_len) != JSON_TAPE_NONE)
+            { found++; }
+        }
+        tape_time += bench_now() - t0;
+
+        t0 = bench_now();
+        if (json_tape_load(tape, &new_json, JSON_LOAD_DEFAULT) != 0)
+        {
+            json_tape_destroy(tape);
+            goto fail;
+        }
+        load_time += bench_now() - t0;
+        json_destroy(new_json);
+        json_tape_destroy(tape);
+    }
+
+    printf("%-24s size %10lu bytes (text %lu)  dump %8.1f MB/s\n", "tape", \
+            (unsigned long)buf_len, (unsigned long)len, \
+            bench_mbps(buf_len * BENCH_ROUNDS, dump_time));
+    printf("%-24s load+get %8.2f ms  tape get %8.2f ms  tape load %8.2f ms" \
+            "  (found %lu)\n", "tape pluck", text_time * 1000.0 / BENCH_ROUNDS, \
+            tape_time * 1000.0 / BENCH_ROUNDS, load_time * 1000.0 / BENCH_ROUNDS, \
+            (unsigned long)found);
+    free(buf);
+    return;
+
+fail:
+    printf("%-24s load failed\n", "tape");
+    free(buf);
+}
+
+static int bench_count_doc(void *ctx, size_t idx, json_t *json)
+{
+    (void)idx;
+    (*(size_t *)ctx)++;
+    json_destroy(json);
+    return 0;
+}
+
+static void bench_load_many(char *str, size_t len)
+{
+    static const size_t nthreads[5] = { 1, 2, 4, 8, 16 };
+    int round, idx;
+    double load_time, t0;
+    size_t docs;
+    char name[48];
+
+    for (idx = 0; idx != 5; idx++)
+    {
+        load_time = 0.0;
+        docs = 0;
+        for (round = 0; round != BENCH_ROUNDS; round++)
+        {
+            t0 = bench_now();
+            if (json_load_many(str, len, JSON_LOAD_DEFAULT, nthreads[idx], \
+                        bench_count_doc, &docs) != 0)
+            { printf("load many failed\n"); return; }
+            load_time += bench_now() - t0;
+        }
+        sprintf(name, "load many %lu threads", (unsigned long)nthreads[idx]);
+        printf("%-24s load %8.1f MB/s  (%lu docs)\n", name, \
+                bench_mbps(len * BENCH_ROUNDS, load_time), \
+                (unsigned long)(docs / BENCH_ROUNDS));
+    }
+}
+
+/* What callers had to do before json_node_object_get */
+static json_node_t *bench_object_scan(json_node_t *node, \
+        const char *key, size_t len)
+{
+    json_node_object_node_t *node_cur;
+
+    for (node_cur = node->u.object_part->begin; node_cur != NULL; \
+            node_cur = node_cur->next)
+    {
+        if ((node_cur->name->u.string_part.len == len) && \
+                (memcmp(node_cur->name->u.string_part.str, key, len) == 0))
+        { return node_cur->value; }
+    }
+    return NULL;
+}
+
+static void bench_object_get(size_t count)
+{
+    size_t len, idx, pos = 0;
+    size_t probes = (size_t)1000000;
+    long sum_scan = 0, sum_get = 0;
+    double t0, t1, t2;
+    char *keys = NULL;
+    size_t *key_lens = NULL;
+    char *str = bench_make_keys(count, &len);
+    json_t *json = NULL;
+
+    if (str == NULL) return;
+    keys = (char *)malloc(count * 32);
+    key_lens = (size_t *)malloc(count * sizeof(size_t));
+    if ((keys == NULL) || (key_lens == NULL)) goto done;
+    for (idx = 0; idx != count; idx++)
+    {
+        key_lens[idx] = (size_t)sprintf(keys + idx * 32, "key%lu", \
+                (unsigned long)idx);
+    }
+    if (json_load(&json, str, len) != 0)
+    { printf("object get load failed\n"); goto done; }
+
+    t0 = bench_now();
+    for (idx = 0; idx != probes; idx++)
+    {
+        pos = (pos + 7919) % count;
+        sum_scan += bench_object_scan(json->root, keys + pos * 32, \
+                key_lens[pos])->u.number_part.int_part;
+    }
+    t1 = bench_now();
+    for (idx = 0; idx != probes; idx++)
+    {
+        pos = (pos + 7919) % count;
+        sum_get += json_node_object_get(json->root, keys + pos * 32, \
+                key_lens[pos])->u.number_part.int_part;
+    }
+    t2 = bench_now();
+
+    printf("%-24s %lu keys  scan %8.1f ns/probe  index %6.1f ns/probe\n", \
+            "object get", (unsigned long)count, \
+            (t1 - t0) * 1e9 / (double)probes, \
+            (t2 - t1) * 1e9 / (double)probes);
+    if (sum_scan != sum_get) printf("object get mismatch\n");
+
+done:
+    if (json != NULL) json_destroy(json);
+    if (keys != NULL) free(keys);
+    if (key_lens != NULL) free(key_lens);
+    free(str);
+}
+
+/* 20 paths into a request-like document, compiled on every lookup
+ * against compiled once */
+static void bench_pointer(void)
+{
+    size_t probes = (size_t)1000000;
+    size_t len = 0, idx;
+    char *str = (char *)malloc(8192);
+    char paths[20][48];
+    json_pointer_t *pointers[20];
+    json_pointer_t *pointer;
+    json_t *json = NULL;
+    double t0, t1, t2;
+    size_t found_once = 0, found = 0;
+
+    if (str == NULL) return;
+    len += (size_t)sprintf(str + len, "{\"request\":{\"headers\":{");
+    for (idx = 0; idx != 40; idx++)
+    {
+        len += (size_t)sprintf(str + len, "%s\"header-%lu\":\"value\"", \
+                (idx != 0) ? "," : "", (unsigned long)idx);
+    }
+    len += (size_t)sprintf(str + len, "},\"body\":{\"items\":[");
+    for (idx = 0; idx != 100; idx++)
+    {
+        len += (size_t)sprintf(str + len, "%s{\"id\":%lu,\"qty\":1}", \
+                (idx != 0) ? "," : "", (unsigned long)idx);
+    }
+    len += (size_t)sprintf(str + len, "]}}}");
+    for (idx = 0; idx != 20; idx++)
+    {
+        if (idx % 2) sprintf(paths[idx], "/request/headers/header-%lu", \
+                (unsigned long)(idx * 2));
+        else sprintf(paths[idx], "/request/body/items/%lu/id", \
+                (unsigned long)(idx * 5));
+        pointers[idx] = json_pointer_compile(paths[idx], strlen(paths[idx]));
+    }
+    if (json_load(&json, str, len) != 0)
+    { printf("pointer load failed\n"); goto done; }
+
+    t0 = bench_now();
+    for (idx = 0; idx != probes; idx++)
+    {
+        pointer = json_pointer_compile(paths[idx % 20], strlen(paths[idx % 20]));
+        if (json_pointer_get(json, pointer) != NULL) found_once++;
+        json_pointer_destroy(pointer);
+    }
+    t1 = bench_now();
+    for (idx = 0; idx != probes; idx++)
+    {
+        if (json_pointer_get(json, pointers[idx % 20]) != NULL) found++;
+    }
+    t2 = bench_now();
+
+    printf("%-24s compile+get %6.1f ns/path  get %6.1f ns/path\n", \
+            "pointer", (t1 - t0) * 1e9 / (double)probes, \
+            (t2 - t1) * 1e9 / (double)probes);
+    if ((found != probes) || (found_once != probes))
+    { printf("pointer mismatch\n"); }
+
+done:
+    for (idx = 0; idx != 20; idx++)
+    {
+        if (pointers[idx] != NULL) json_pointer_destroy(pointers[idx]);
+    }
+    if (json != NULL) json_destroy(json);
+    free(str);
+}
+
+int main(void)
+{
+    size_t len;
+    json_t *json = NULL;
+    char *str = bench_make_records(BENCH_DOC_SIZE, &len);
+
+    if (str == NULL) return 1;
+    printf("records document: %lu bytes\n", (unsigned long)len);
+
+    bench_load("load heap", str, len, JSON_LOAD_HEAP);
+    bench_load("load arena", str, len, JSON_LOAD_DEFAULT);
+    bench_load("load heap in-situ", str, len, \
+            JSON_LOAD_HEAP | JSON_LOAD_INSITU);
+    bench_load("load arena in-situ", str, len, JSON_LOAD_INSITU);
+    bench_engines("engines records", str, len);
+    bench_sax_count(str, len);
+    bench_parser(str, len, (size_t)4096);
+    bench_parser(str, len, (size_t)65536);
+    bench_load_parallel("parallel", str, len);
+    bench_cursor("records", str, len, "name");
+    bench_load_file(str, len, JSON_LOAD_DEFAULT);
+    bench_load_file(str, len, JSON_LOAD_INSITU);
+
+    if (json_load(&json, str, len) == 0)
+    {
+        bench_dump("dump two-pass", json, JSON_DUMP_EXACT);
+        bench_dump("dump single-pass", json, JSON_DUMP_DEFAULT);
+        bench_dump_stream("dump stream", json);
+        bench_dump_parallel("dump parallel", json);
+        bench_binary(str, len, json);
+        bench_tape(str, len, json, "name");
+        json_destroy(json);
+    }
+
+    free(str);
+
+    if ((str = bench_make_pretty(BENCH_DOC_SIZE, &len)) == NULL) return 1;
+    printf("pretty records document: %lu bytes\n", (unsigned long)len);
+
+    bench_load("load arena", str, len, JSON_LOAD_DEFAULT);
+    bench_engines("engines pretty", str, len);
+    bench_parser(str, len, (size_t)65536);
+
+    free(str);
+
+    if ((str = bench_make_strings(BENCH_DOC_SIZE, &len)) == NULL) return 1;
+    printf("strings document: %lu bytes\n", (unsigned long)len);
+
+    bench_load("load arena", str, len, JSON_LOAD_DEFAULT);
+    bench_load("load arena in-situ", str, len, JSON_LOAD_INSITU);
+    bench_engines("engines strings", str, len);
+    bench_load_parallel("parallel", str, len);
+    bench_cursor("strings", str, len, "msg");
+    bench_load_file(str, len, JSON_LOAD_DEFAULT);
+    bench_load_file(str, len, JSON_LOAD_INSITU);
+    if (json_load(&json, str, len) == 0)
+    {
+        bench_dump("dump two-pass", json, JSON_DUMP_EXACT);
+        bench_dump("dump single-pass", json, JSON_DUMP_DEFAULT);
+        bench_dump_parallel("dump parallel", json);
+        bench_binary(str, len, json);
+        bench_tape(str, len, json, "msg");
+        json_destroy(json);
+    }
+
+    free(str);
+
+    if ((str = bench_make_floats(BENCH_DOC_SIZE, &len)) == NULL) return 1;
+    printf("floats document: %lu bytes\n", (unsigned long)len);
+
+    bench_load("load arena", str, len, JSON_LOAD_DEFAULT);
+    bench_engines("engines floats", str, len);
+    bench_strtod(str, len);
+    if (json_load(&json, str, len) == 0)
+    {
+        bench_dump("dump two-pass", json, JSON_DUMP_EXACT);
+        bench_dump("dump single-pass", json, JSON_DUMP_DEFAULT);
+        bench_snprintf(json, len);
+        bench_binary(str, len, json);
+        json_destroy(json);
+    }
+
+    free(str);
+
+    if ((str = bench_make_ndjson(BENCH_DOC_SIZE, &len)) == NULL) return 1;
+    printf("ndjson records: %lu bytes\n", (unsigned long)len);
+
+    bench_load_many(str, len);
+
+    free(str);
+
+    bench_array_index((size_t)100000);
+    bench_array_index((size_t)1000000);
+
+    bench_object_get((size_t)16);
+    bench_object_get((size_t)1000);
+    bench_object_get((size_t)5000);
+
+    bench_pointer();
+    return 0;
+}
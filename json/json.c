@@ -8,111 +8,275 @@
 #include <string.h>
 
 #include "json.h"
-
-#define IS_DIGIT(ch) (('0'<=(ch))&&((ch)<='9'))
-#define IS_ALPHA_LOWCASE(ch) (('a'<=(ch))&&((ch)<='z'))
+#include "json_internal.h"
 
 /* Declarations */
 
 void json_node_destroy(json_node_t *node);
 
-json_node_array_node_t *json_node_array_node_new(json_node_t *node);
-void json_node_array_node_destroy(json_node_array_node_t *node);
-json_node_array_t *json_node_array_new(void);
+json_node_array_t *json_node_array_new(json_arena_t *arena);
 void json_node_array_destroy(json_node_array_t *node_array);
-void json_node_array_append(json_node_array_t *node_array, \
-        json_node_array_node_t *new_node);
-
-json_node_object_node_t *json_node_object_node_new(json_node_t *name, json_node_t *value);
-void json_node_object_node_destroy(json_node_object_node_t *object_node);
-json_node_object_t *json_node_object_new(void);
+int json_node_array_grow(json_node_array_t *node_array, size_t capacity);
+int json_node_array_append(json_node_array_t *node_array, \
+        json_node_t *new_node);
+
+json_node_object_node_t *json_node_object_node_new(json_arena_t *arena, \
+        json_node_t *name, json_node_t *value);
+void json_node_object_node_destroy(json_node_object_node_t *object_node, \
+        int owned);
+json_node_object_t *json_node_object_new(json_arena_t *arena);
 void json_node_object_destroy(json_node_object_t *object);
 void json_node_object_append(json_node_object_t *object, \
         json_node_object_node_t *new_node);
 
-static int json_node_dump_array(json_node_t *node, char **p_io);
-static int json_node_dump_object(json_node_t *node, char **p_io);
-static int json_node_dump_string(json_node_t *node, char **p_io);
-static int json_node_dump_integer(json_node_t *node, char **p_io);
-static int json_node_dump(json_node_t *node, char **p_io);
+typedef struct json_writer json_writer_t;
 
-static int json_node_array_load(json_node_t **json_node_out, \
-        char **str_io, char *str_endp);
-/*static int json_node_object_load(json_node_t **json_node_out, \*/
-/*char **str_io, char *str_endp);*/
-static int json_node_load(json_node_t **json_node_out, \
-        char **str_io, char *str_endp);
+static int json_node_dump_array(json_node_t *node, json_writer_t *writer);
+static int json_node_dump_object(json_node_t *node, json_writer_t *writer);
+static int json_node_dump_string(json_node_t *node, json_writer_t *writer);
+static int json_node_dump_number(json_node_t *node, json_writer_t *writer);
+static int json_node_dump(json_node_t *node, json_writer_t *writer);
 
 
-/* Array */
 
-json_node_array_node_t *json_node_array_node_new(json_node_t *node)
+/* Arena */
+
+/* Nodes, list cells and string bodies of a loaded document are carved
+ * out of a few large chunks, so loading costs one malloc per chunk
+ * rather than one per value, and destroying the document frees the
+ * chunks without walking the tree. */
+
+#define JSON_ARENA_ALIGN(size) (((size) + 7) & ~(size_t)7)
+/* Small, as a stream of small documents keeps an arena per document */
+#define JSON_ARENA_CHUNK_SIZE_MIN ((size_t)1024)
+#define JSON_ARENA_CHUNK_SIZE_MAX ((size_t)1 << 20)
+
+typedef struct json_arena_chunk
+{
+    struct json_arena_chunk *next;
+    size_t size;
+    size_t used;
+} json_arena_chunk_t;
+
+struct json_arena
+{
+    json_arena_chunk_t *chunks;
+    size_t chunk_size;
+    /* Set once a malloc'd node is linked into the arena's tree */
+    int foreign;
+    /* Once merged into another arena: where its allocations go, and
+     * the next arena merged into the same one */
+    struct json_arena *forward;
+    struct json_arena *alias_next;
+    /* Arenas merged into this one, freed with it */
+    struct json_arena *aliases;
+};
+
+json_arena_t *json_arena_new(void)
+{
+    json_arena_t *new_arena = NULL;
+
+    if ((new_arena = (json_arena_t *)malloc( \
+                    sizeof(json_arena_t))) == NULL)
+    { return NULL; }
+    new_arena->chunks = NULL;
+    new_arena->chunk_size = JSON_ARENA_CHUNK_SIZE_MIN;
+    new_arena->foreign = 0;
+    new_arena->forward = NULL;
+    new_arena->alias_next = NULL;
+    new_arena->aliases = NULL;
+
+    return new_arena;
+}
+
+void json_arena_destroy(json_arena_t *arena)
+{
+    json_arena_chunk_t *chunk_cur = arena->chunks, *chunk_next;
+    json_arena_t *alias_cur = arena->aliases, *alias_next;
+
+    while (chunk_cur != NULL)
+    {
+        chunk_next = chunk_cur->next;
+        free(chunk_cur);
+        chunk_cur = chunk_next;
+    }
+    while (alias_cur != NULL)
+    {
+        alias_next = alias_cur->alias_next;
+        json_arena_destroy(alias_cur);
+        alias_cur = alias_next;
+    }
+    free(arena);
+}
+
+/* Hand the chunks of from over to arena. Containers built in from
+ * still name it as their arena, so from stays behind, empty, as an
+ * alias that allocates from arena and is freed along with it. */
+void json_arena_merge(json_arena_t *arena, json_arena_t *from)
+{
+    json_arena_chunk_t *chunk_last = from->chunks;
+
+    if (chunk_last != NULL)
+    {
+        while (chunk_last->next != NULL) chunk_last = chunk_last->next;
+        /* Behind the chunk arena is filling, which stays in front */
+        if (arena->chunks == NULL)
+        {
+            arena->chunks = from->chunks;
+        }
+        else
+        {
+            chunk_last->next = arena->chunks->next;
+            arena->chunks->next = from->chunks;
+        }
+        from->chunks = NULL;
+    }
+    arena->foreign |= from->foreign;
+    from->forward = arena;
+    from->alias_next = arena->aliases;
+    arena->aliases = from;
+}
+
+void *json_arena_alloc(json_arena_t *arena, size_t size)
 {
-    json_node_array_node_t *new_array_node = NULL;
+    json_arena_chunk_t *chunk = arena->chunks;
+    json_arena_chunk_t *new_chunk = NULL;
+    size_t chunk_size;
+    void *p;
+
+    size = JSON_ARENA_ALIGN(size);
+    if ((chunk != NULL) && (chunk->size - chunk->used >= size))
+    {
+        p = (char *)chunk + JSON_ARENA_ALIGN(sizeof(json_arena_chunk_t)) + chunk->used;
+        chunk->used += size;
+        return p;
+    }
+
+    if (arena->forward != NULL) return json_arena_alloc(arena->forward, size);
+
+    /* Chunks double up to a cap; oversized requests get their own */
+    chunk_size = arena->chunk_size;
+    if (chunk_size < JSON_ARENA_CHUNK_SIZE_MAX)
+    { arena->chunk_size = chunk_size * 2; }
+    if (chunk_size < size) chunk_size = size;
+
+    if ((new_chunk = (json_arena_chunk_t *)malloc( \
+                    JSON_ARENA_ALIGN(sizeof(json_arena_chunk_t)) + chunk_size)) == NULL)
+    { return NULL; }
+    new_chunk->size = chunk_size;
+    new_chunk->used = size;
 
-    new_array_node = (json_node_array_node_t *)malloc( \
-            sizeof(json_node_array_node_t));
-    if (new_array_node == NULL) return NULL;
-    new_array_node->node = node;
-    new_array_node->next = NULL;
+    if ((chunk != NULL) && (chunk_size - size < chunk->size - chunk->used))
+    {
+        /* Keep filling the current chunk, it has more room left */
+        new_chunk->next = chunk->next;
+        chunk->next = new_chunk;
+    }
+    else
+    {
+        new_chunk->next = chunk;
+        arena->chunks = new_chunk;
+    }
 
-    return new_array_node;
+    return (char *)new_chunk + JSON_ARENA_ALIGN(sizeof(json_arena_chunk_t));
 }
 
-void json_node_array_node_destroy(json_node_array_node_t *node)
+static void *json_alloc(json_arena_t *arena, size_t size)
 {
-    json_node_destroy(node->node);
-    free(node);
+    if (arena != NULL) return json_arena_alloc(arena, size);
+    return malloc(size);
 }
 
-json_node_array_t *json_node_array_new(void)
+/* Array */
+
+/* Elements live in one contiguous vector of node pointers that grows
+ * geometrically; arena vectors leave their old block behind in the
+ * arena when they move. */
+
+#define JSON_NODE_ARRAY_CAPACITY_MIN ((size_t)4)
+
+json_node_array_t *json_node_array_new(json_arena_t *arena)
 {
     json_node_array_t *new_array = NULL;
 
-    new_array = (json_node_array_t *)malloc( \
+    new_array = (json_node_array_t *)json_alloc(arena, \
             sizeof(json_node_array_t));
     if (new_array == NULL) return NULL;
-    new_array->begin = new_array->end = NULL;
+    new_array->items = NULL;
     new_array->size = 0;
+    new_array->capacity = 0;
+    new_array->arena = arena;
     return new_array;
 }
 
 void json_node_array_destroy(json_node_array_t *node_array)
 {
-    json_node_array_node_t *node_cur = node_array->begin;
-    json_node_array_node_t *node_next;
+    size_t idx;
 
-    while (node_cur != NULL)
+    for (idx = 0; idx != node_array->size; idx++)
+    { json_node_destroy(node_array->items[idx]); }
+    if (node_array->arena == NULL)
     {
-        node_next = node_cur->next;
-        json_node_array_node_destroy(node_cur);
-        node_cur = node_next;
+        if (node_array->items != NULL) free(node_array->items);
+        free(node_array);
     }
-    free(node_array);
 }
 
-void json_node_array_append(json_node_array_t *node_array, \
-        json_node_array_node_t *new_node)
+int json_node_array_grow(json_node_array_t *node_array, size_t capacity)
 {
-    if (node_array->begin == NULL)
+    json_node_t **new_items = NULL;
+
+    if (capacity <= node_array->capacity) return 0;
+    if (capacity > ((size_t)-1) / sizeof(json_node_t *)) return -1;
+
+    if (node_array->arena == NULL)
     {
-        node_array->begin = node_array->end = new_node;
+        if ((new_items = (json_node_t **)realloc(node_array->items, \
+                        sizeof(json_node_t *) * capacity)) == NULL)
+        { return -1; }
     }
     else
     {
-        node_array->end->next = new_node;
-        node_array->end = new_node;
+        if ((new_items = (json_node_t **)json_arena_alloc(node_array->arena, \
+                        sizeof(json_node_t *) * capacity)) == NULL)
+        { return -1; }
+        if (node_array->size != 0)
+        {
+            memcpy(new_items, node_array->items, \
+                    sizeof(json_node_t *) * node_array->size);
+        }
+    }
+    node_array->items = new_items;
+    node_array->capacity = capacity;
+
+    return 0;
+}
+
+int json_node_array_append(json_node_array_t *node_array, \
+        json_node_t *new_node)
+{
+    size_t capacity;
+
+    if (node_array->size == node_array->capacity)
+    {
+        capacity = node_array->capacity * 2;
+        if (capacity < JSON_NODE_ARRAY_CAPACITY_MIN)
+        { capacity = JSON_NODE_ARRAY_CAPACITY_MIN; }
+        if (json_node_array_grow(node_array, capacity) != 0)
+        { return -1; }
     }
-    node_array->size++;
+    node_array->items[node_array->size++] = new_node;
+    return 0;
 }
 
 /* Object */
 
-json_node_object_node_t *json_node_object_node_new(json_node_t *name, json_node_t *value)
+json_node_object_node_t *json_node_object_node_new(json_arena_t *arena, \
+        json_node_t *name, json_node_t *value)
 {
     json_node_object_node_t *new_object_node = NULL;
 
-    if ((new_object_node = (json_node_object_node_t *)malloc( \
+    if ((new_object_node = (json_node_object_node_t *)json_alloc(arena, \
                     sizeof(json_node_object_node_t))) == NULL)
     { return NULL; }
     new_object_node->name = name;
@@ -122,22 +286,26 @@ json_node_object_node_t *json_node_object_node_new(json_node_t *name, json_node_
     return new_object_node;
 }
 
-void json_node_object_node_destroy(json_node_object_node_t *object_node)
+void json_node_object_node_destroy(json_node_object_node_t *object_node, \
+        int owned)
 {
     json_node_destroy(object_node->name);
     json_node_destroy(object_node->value);
-    free(object_node);
+    if (owned) free(object_node);
 }
 
-json_node_object_t *json_node_object_new(void)
+json_node_object_t *json_node_object_new(json_arena_t *arena)
 {
     json_node_object_t *new_object = NULL;
 
-    if ((new_object = (json_node_object_t *)malloc( \
+    if ((new_object = (json_node_object_t *)json_alloc(arena, \
                     sizeof(json_node_object_t))) == NULL)
     { return NULL; }
     new_object->begin = new_object->end = NULL;
     new_object->size = 0;
+    new_object->arena = arena;
+    new_object->index = NULL;
+    new_object->index_capacity = 0;
 
     return new_object;
 }
@@ -145,14 +313,114 @@ json_node_object_t *json_node_object_new(void)
 void json_node_object_destroy(json_node_object_t *object)
 {
     json_node_object_node_t *node_cur = object->begin, *node_next;
+    int owned = (object->arena == NULL);
 
     while (node_cur != NULL)
     {
         node_next = node_cur->next;
-        json_node_object_node_destroy(node_cur);
+        json_node_object_node_destroy(node_cur, owned);
         node_cur = node_next;
     }
-    free(object);
+    if (owned)
+    {
+        if (object->index != NULL) free(object->index);
+        free(object);
+    }
+}
+
+/* Key index
+ *
+ * Members stay in their insertion-ordered list; the index is a
+ * power-of-two table of member pointers probed linearly, kept at most
+ * half full. Only the first member with a given key is indexed, which
+ * matches what a front-to-back scan would find. */
+
+#define JSON_NODE_OBJECT_INDEX_THRESHOLD ((size_t)8)
+
+size_t json_key_hash(const char *key, size_t len)
+{
+    /* FNV-1a */
+    size_t hash = (size_t)2166136261u;
+    size_t idx;
+
+    for (idx = 0; idx != len; idx++)
+    {
+        hash ^= (size_t)(unsigned char)key[idx];
+        hash *= (size_t)16777619u;
+    }
+    return hash;
+}
+
+static int json_key_equal(json_node_t *name, const char *key, size_t len)
+{
+    /* A key read off an interned name is that name's own body */
+    return (name->type == JSON_NODE_TYPE_STRING) && \
+        (name->u.string_part.len == len) && \
+        ((name->u.string_part.str == key) || \
+         (memcmp(name->u.string_part.str, key, len) == 0));
+}
+
+static json_node_object_node_t **json_node_object_index_slot( \
+        json_node_object_t *object, const char *key, size_t len, \
+        size_t hash)
+{
+    size_t mask = object->index_capacity - 1;
+    size_t pos = hash & mask;
+    json_node_object_node_t **slot;
+
+    for (;;)
+    {
+        slot = &object->index[pos];
+        if ((*slot == NULL) || (json_key_equal((*slot)->name, key, len)))
+        { return slot; }
+        pos = (pos + 1) & mask;
+    }
+}
+
+static void json_node_object_index_insert(json_node_object_t *object, \
+        json_node_object_node_t *object_node)
+{
+    json_node_object_node_t **slot;
+
+    if (object_node->name->type != JSON_NODE_TYPE_STRING) return;
+    slot = json_node_object_index_slot(object, \
+            object_node->name->u.string_part.str, \
+            object_node->name->u.string_part.len, \
+            json_key_hash(object_node->name->u.string_part.str, \
+                object_node->name->u.string_part.len));
+    if (*slot == NULL) *slot = object_node;
+}
+
+static int json_node_object_index_build(json_node_object_t *object, \
+        size_t capacity)
+{
+    json_node_object_node_t **new_index = NULL;
+    json_node_object_node_t *node_cur;
+
+    if (capacity > ((size_t)-1) / sizeof(json_node_object_node_t *))
+    { return -1; }
+    if ((new_index = (json_node_object_node_t **)json_alloc(object->arena, \
+                    sizeof(json_node_object_node_t *) * capacity)) == NULL)
+    { return -1; }
+    memset(new_index, 0, sizeof(json_node_object_node_t *) * capacity);
+
+    if ((object->arena == NULL) && (object->index != NULL))
+    { free(object->index); }
+    object->index = new_index;
+    object->index_capacity = capacity;
+
+    for (node_cur = object->begin; node_cur != NULL; node_cur = node_cur->next)
+    { json_node_object_index_insert(object, node_cur); }
+
+    return 0;
+}
+
+static void json_node_object_index_drop(json_node_object_t *object)
+{
+    if ((object->arena == NULL) && (object->index != NULL))
+    { free(object->index); }
+    object->index = NULL;
+    object->index_capacity = 0;
 }
 
 void json_node_object_append(json_node_object_t *object, \
@@ -168,17 +436,68 @@ void json_node_object_append(json_node_object_t *object, \
         object->end = new_node;
     }
     object->size++;
+
+    if (object->index != NULL)
+    {
+        if (object->size * 2 > object->index_capacity)
+        {
+            /* Rebuilding picks up the new member; without memory the
+             * object just falls back to scanning */
+            if (json_node_object_index_build(object, \
+                        object->index_capacity * 2) != 0)
+            { json_node_object_index_drop(object); }
+        }
+        else
+        {
+            json_node_object_index_insert(object, new_node);
+        }
+    }
+}
+
+/* hash is json_key_hash of key when the caller has it, NULL when it
+ * is to be worked out here if the index needs it. With build unset a
+ * missing index is not built, so the object is only read. */
+static json_node_t *json_node_object_find(json_node_object_t *object, \
+        const char *key, size_t len, const size_t *hash, int build)
+{
+    json_node_object_node_t *node_cur;
+    json_node_object_node_t **slot;
+    size_t capacity;
+
+    if (build && (object->index == NULL) && \
+            (object->size > JSON_NODE_OBJECT_INDEX_THRESHOLD))
+    {
+        capacity = JSON_NODE_OBJECT_INDEX_THRESHOLD * 4;
+        while (capacity < object->size * 2) capacity *= 2;
+        json_node_object_index_build(object, capacity);
+    }
+
+    if (object->index != NULL)
+    {
+        slot = json_node_object_index_slot(object, key, len, \
+                (hash != NULL) ? *hash : json_key_hash(key, len));
+        return (*slot != NULL) ? (*slot)->value : NULL;
+    }
+
+    for (node_cur = object->begin; node_cur != NULL; node_cur = node_cur->next)
+    {
+        if (json_key_equal(node_cur->name, key, len))
+        { return node_cur->value; }
+    }
+    return NULL;
 }
 
 
 /* Node */
 
-json_node_t *json_node_new(json_node_type_t type)
+static json_node_t *json_node_new_in(json_arena_t *arena, \
+        json_node_type_t type)
 {
-    json_node_t *new_json_node = (json_node_t *)malloc( \
+    json_node_t *new_json_node = (json_node_t *)json_alloc(arena, \
             sizeof(json_node_t));
     if (new_json_node == NULL) return NULL;
     new_json_node->type = JSON_NODE_TYPE_UNKNOWN;
+    new_json_node->flags = (arena != NULL) ? JSON_NODE_FLAG_ARENA : 0;
     switch (type)
     {
         case JSON_NODE_TYPE_OBJECT:
@@ -202,8 +521,15 @@ json_node_t *json_node_new(json_node_type_t type)
     return new_json_node;
 }
 
+json_node_t *json_node_new(json_node_type_t type)
+{
+    return json_node_new_in(NULL, type);
+}
+
 void json_node_destroy(json_node_t *node)
 {
+    int owned = ((node->flags & JSON_NODE_FLAG_ARENA) == 0);
+
     switch (node->type)
     {
         case JSON_NODE_TYPE_ARRAY:
@@ -215,7 +541,8 @@ void json_node_destroy(json_node_t *node)
             { json_node_object_destroy(node->u.object_part); }
             break;
         case JSON_NODE_TYPE_STRING:
-            if (node->u.string_part.str != NULL)
+            if ((owned) && (node->u.string_part.str != NULL) && \
+                    ((node->flags & JSON_NODE_FLAG_BORROWED) == 0))
             { free(node->u.string_part.str); }
             break;
         case JSON_NODE_TYPE_UNKNOWN:
@@ -226,353 +553,453 @@ void json_node_destroy(json_node_t *node)
         case JSON_NODE_TYPE_NULL:
             break;
     }
-    free(node);
+    if (owned) free(node);
 }
 
-static int json_node_length(json_node_t *node);
+static int json_node_length(json_node_t *node, size_t *length);
+
+/* Code unit of the \u escape at str_p, -1 if malformed */
+static long json_escape_unit(const char *str_p, const char *str_endp)
+{
+    long unit = 0;
+    int idx;
+
+    if ((str_endp - str_p < 6) || (str_p[0] != '\\') || (str_p[1] != 'u'))
+    { return -1; }
+    for (idx = 2; idx < 6; idx++)
+    {
+        if (!IS_HEX(str_p[idx])) return -1;
+        unit = (unit << 4) | ((str_p[idx] <= '9') ? (str_p[idx] - '0') : \
+                ((str_p[idx] | 0x20) - 'a' + 10));
+    }
+    return unit;
+}
 
-static int json_node_length_integer(int value)
+/* Length of the escape sequence at str_p, 0 if malformed. A UTF-16
+ * surrogate must come in a high-low pair, which counts as one. */
+static size_t json_escape_length(const char *str_p, const char *str_endp)
 {
-    int len = 0;
+    long unit;
+
+    if (str_endp - str_p < 2) return 0;
+    switch (str_p[1])
+    {
+        case '\"': case '\\': case '/':
+        case 'b': case 'f': case 'n': case 'r': case 't':
+            return 2;
+        case 'u':
+            if ((unit = json_escape_unit(str_p, str_endp)) < 0) return 0;
+            if ((unit < 0xd800) || (unit > 0xdfff)) return 6;
+            if (unit > 0xdbff) return 0;
+            unit = json_escape_unit(str_p + 6, str_endp);
+            if ((unit < 0xdc00) || (unit > 0xdfff)) return 0;
+            return 12;
+        default:
+            return 0;
+    }
+}
 
-    if (value == 0) return 1;
-    else if (value < 0) 
-    { value = -value; len++; }
+/* Escaped form of a quote, backslash or control character into buf,
+ * which needs 6 bytes; its length is returned */
+static size_t json_escape_char(char ch, char *buf)
+{
+    static const char hex[] = "0123456789abcdef";
 
-    while (value != 0)
-    { value /= 10; len++; } 
+    buf[0] = '\\';
+    switch (ch)
+    {
+        case '\"': buf[1] = '\"'; return 2;
+        case '\\': buf[1] = '\\'; return 2;
+        case '\b': buf[1] = 'b'; return 2;
+        case '\f': buf[1] = 'f'; return 2;
+        case '\n': buf[1] = 'n'; return 2;
+        case '\r': buf[1] = 'r'; return 2;
+        case '\t': buf[1] = 't'; return 2;
+        default:
+            buf[1] = 'u';
+            buf[2] = '0';
+            buf[3] = '0';
+            buf[4] = hex[((unsigned char)ch >> 4) & 0x0f];
+            buf[5] = hex[(unsigned char)ch & 0x0f];
+            return 6;
+    }
+}
 
-    return len;
+/* Adds n to *length, failing where the sum and the null byte ending a
+ * dump would not fit in a size_t */
+static int json_node_length_add(size_t *length, size_t n)
+{
+    if (n >= (size_t)-1 - *length) return -1;
+    *length += n;
+    return 0;
 }
 
-static int json_node_length_string(char *str, size_t str_len)
+static int json_node_length_string(char *str, size_t str_len, \
+        size_t *length)
 {
-    int len = 2;
     char *str_p = str, *str_endp = str_p + str_len;
+    char escape_buf[6];
 
-    while (str_p != str_endp)
+    if (json_node_length_add(length, str_len) != 0) return -1;
+    if (json_node_length_add(length, 2) != 0) return -1;
+    /* Plain runs count as-is, each special byte grows to its escape */
+    for (;;)
     {
-        switch (*str_p)
-        {
-            case '\\':
-                str_p++; len++;
-                if (str_p == str_endp) return -1;
-                if (*str_p == 'u')
-                {
-                    str_p++; len++;
-                    if (str_endp - str_p < 4) return -1;
-                    if (!((IS_DIGIT(*str_p))&& \
-                                (IS_DIGIT(*(str_p+1)))&&
-                                (IS_DIGIT(*(str_p+2)))&&
-                                (IS_DIGIT(*(str_p+3)))))
-                    { return -1; }
-                    str_p += 4; len += 4;
-                }
-                else if (*str_p == '\"')
-                { str_p++; len++; }
-                else if (*str_p == '\\')
-                { str_p++; len++; }
-                else if (*str_p == '/')
-                { str_p++; len++; }
-                else if (*str_p == 'b')
-                { str_p++; len++; }
-                else if (*str_p == 'f')
-                { str_p++; len++; }
-                else if (*str_p == 'n')
-                { str_p++; len++; }
-                else if (*str_p == 'r')
-                { str_p++; len++; }
-                else if (*str_p == 't')
-                { str_p++; len++; }
-                else
-                { return -1; }
-                break;
-            default:
-                str_p++; len++;
-                break;
-        }
+        str_p += json_simd_scan_string(str_p, (size_t)(str_endp - str_p));
+        if (str_p == str_endp) break;
+        if (json_node_length_add(length, \
+                    json_escape_char(*str_p++, escape_buf) - 1) != 0)
+        { return -1; }
     }
 
-    return len;
+    return 0;
 }
 
-static int json_node_length_array(json_node_t *node)
+static int json_node_length_array(json_node_t *node, size_t *length)
 {
     /* if size <= 1 then 
      *   '[' + ']'
      * else 
      *   '[' + ']' + ',' * (size - 1) 
      */
-    int length;
     size_t idx;
-    json_node_array_node_t *array_node_cur = node->u.array_part->begin;
+    json_node_array_t *node_array = node->u.array_part;
 
-    if (node->u.array_part->size <= 1)
-    {
-        length = 2;
-    }
-    else
-    {
-        length = 2 + ((int)(node->u.array_part->size) - 1);
-    }
+    if (json_node_length_add(length, 2) != 0) return -1;
+    if ((node_array->size > 1) && \
+            (json_node_length_add(length, node_array->size - 1) != 0))
+    { return -1; }
 
-    for (idx = 0; idx != node->u.array_part->size; idx++)
+    for (idx = 0; idx != node_array->size; idx++)
     {
-        length += json_node_length(array_node_cur->node);
-        array_node_cur = array_node_cur->next;
+        if (json_node_length(node_array->items[idx], length) != 0)
+        { return -1; }
     }
 
-    return length;
+    return 0;
 }
 
-static int json_node_length_object(json_node_t *node)
+static int json_node_length_object(json_node_t *node, size_t *length)
 {
     /* if size <= 1 then 
      *   '{' + '}' + ':' * size
      * else 
      *   '[' + ']' + ',' * (size - 1) + ':' * size
      */
-    int length;
     size_t idx;
+    size_t size = node->u.object_part->size;
     json_node_object_node_t *object_node_cur = node->u.object_part->begin;
 
-    if (node->u.object_part->size <= 1)
-    {
-        length = 2 + (int)(node->u.object_part->size);
-    }
-    else
-    {
-        length = 2 + ((int)(node->u.object_part->size) - 1) + (int)(node->u.object_part->size);
-    }
+    if (json_node_length_add(length, 2) != 0) return -1;
+    if (json_node_length_add(length, size) != 0) return -1;
+    if ((size > 1) && (json_node_length_add(length, size - 1) != 0))
+    { return -1; }
 
-    for (idx = 0; idx != node->u.object_part->size; idx++)
+    for (idx = 0; idx != size; idx++)
     {
-        length += json_node_length(object_node_cur->name);
-        length += json_node_length(object_node_cur->value);
+        if ((json_node_length(object_node_cur->name, length) != 0) || \
+                (json_node_length(object_node_cur->value, length) != 0))
+        { return -1; }
         object_node_cur = object_node_cur->next;
     }
 
-    return length;
+    return 0;
 }
 
-static int json_node_length(json_node_t *node)
+/* Adds the dumped length of node to *length; -1 if it overflows */
+static int json_node_length(json_node_t *node, size_t *length)
 {
-    int length = 0;
+    size_t node_length = 0;
+    char number_buf[JSON_NUMBER_FORMAT_MAX];
     switch (node->type)
     {
         case JSON_NODE_TYPE_ARRAY:
-            length = json_node_length_array(node);
-            break;
+            return json_node_length_array(node, length);
         case JSON_NODE_TYPE_OBJECT:
-            length = json_node_length_object(node);
-            break;
+            return json_node_length_object(node, length);
+        case JSON_NODE_TYPE_STRING:
+            return json_node_length_string(node->u.string_part.str, \
+                    node->u.string_part.len, length);
         case JSON_NODE_TYPE_INTEGER: 
-            length = json_node_length_integer(node->u.number_part.int_part); 
+            node_length = (size_t)json_number_length_integer( \
+                    node->u.number_part.int_part); 
             break;
-        case JSON_NODE_TYPE_STRING:
-            length = json_node_length_string(node->u.string_part.str, \
-                    node->u.string_part.len);
+        case JSON_NODE_TYPE_UNKNOWN: node_length = 0; break;
+        case JSON_NODE_TYPE_DOUBLE:
+            node_length = (size_t)json_number_format_double( \
+                    node->u.number_part.double_part, number_buf);
             break;
-        case JSON_NODE_TYPE_UNKNOWN: length = 0; break;
-        case JSON_NODE_TYPE_DOUBLE: length = 0; break;
-        case JSON_NODE_TYPE_TRUE: length = 4; break;
-        case JSON_NODE_TYPE_FALSE: length = 5; break;
-        case JSON_NODE_TYPE_NULL: length = 4; break;
+        case JSON_NODE_TYPE_TRUE: node_length = 4; break;
+        case JSON_NODE_TYPE_FALSE: node_length = 5; break;
+        case JSON_NODE_TYPE_NULL: node_length = 4; break;
+    }
+    return json_node_length_add(length, node_length);
+}
+
+/* Writer
+ *
+ * Serialization goes through one output buffer. A growable writer
+ * doubles its buffer on demand, so a dump is a single walk over the
+ * tree; a fixed writer fails instead of growing, which is what the
+ * exact-size and caller-buffer paths use. A streaming writer keeps a
+ * fixed staging buffer and hands it to a write callback whenever it
+ * fills, so memory stays bounded whatever the document size. */
+
+#define JSON_WRITER_CAPACITY_MIN ((size_t)256)
+#define JSON_WRITER_STAGING_SIZE ((size_t)65536)
+
+struct json_writer
+{
+    char *buf;
+    size_t len;
+    size_t capacity;
+    int growable;
+    json_write_fn_t write;
+    void *write_ctx;
+};
+
+static void json_writer_init(json_writer_t *writer, char *buf, \
+        size_t capacity, int growable)
+{
+    writer->buf = buf;
+    writer->len = 0;
+    writer->capacity = capacity;
+    writer->growable = growable;
+    writer->write = NULL;
+    writer->write_ctx = NULL;
+}
+
+static int json_writer_flush(json_writer_t *writer)
+{
+    if (writer->len == 0) return 0;
+    if (writer->write(writer->write_ctx, writer->buf, writer->len) != 0)
+    { return -1; }
+    writer->len = 0;
+    return 0;
+}
+
+static int json_writer_grow(json_writer_t *writer, size_t need)
+{
+    size_t capacity = writer->capacity;
+    char *new_buf = NULL;
+
+    if (writer->write != NULL)
+    {
+        if (json_writer_flush(writer) != 0) return -1;
+        return (need <= writer->capacity) ? 0 : -1;
+    }
+    if (!writer->growable) return -1;
+    if (need > ((size_t)-1) / 2 - writer->len) return -1;
+
+    if (capacity < JSON_WRITER_CAPACITY_MIN)
+    { capacity = JSON_WRITER_CAPACITY_MIN; }
+    while (capacity - writer->len < need) capacity *= 2;
+
+    if ((new_buf = (char *)realloc(writer->buf, capacity)) == NULL)
+    { return -1; }
+    writer->buf = new_buf;
+    writer->capacity = capacity;
+
+    return 0;
+}
+
+/* Make room for need contiguous bytes at buf + len; a streaming
+ * writer can only promise up to its staging size */
+static int json_writer_reserve(json_writer_t *writer, size_t need)
+{
+    if (writer->capacity - writer->len >= need) return 0;
+    return json_writer_grow(writer, need);
+}
+
+static int json_writer_put(json_writer_t *writer, const char *data, \
+        size_t len)
+{
+    size_t room;
+
+    /* Streaming writers pass long runs through in staging-sized pieces */
+    while ((writer->write != NULL) && (writer->capacity - writer->len < len))
+    {
+        room = writer->capacity - writer->len;
+        memcpy(writer->buf + writer->len, data, room);
+        writer->len += room;
+        data += room;
+        len -= room;
+        if (json_writer_flush(writer) != 0) return -1;
     }
-    return length;
+
+    if (json_writer_reserve(writer, len) != 0) return -1;
+    memcpy(writer->buf + writer->len, data, len);
+    writer->len += len;
+    return 0;
+}
+
+static int json_writer_putc(json_writer_t *writer, char ch)
+{
+    if (json_writer_reserve(writer, 1) != 0) return -1;
+    writer->buf[writer->len++] = ch;
+    return 0;
 }
 
-static int json_node_dump_array(json_node_t *node, char **p_io)
+static int json_node_dump_array(json_node_t *node, json_writer_t *writer)
 {
     int ret = 0;
-    char *p = *p_io;
-    json_node_array_node_t *array_node_cur = node->u.array_part->begin;
-    int first = 1;
+    json_node_array_t *node_array = node->u.array_part;
+    size_t idx;
 
-    *p++ = '[';
-    while (array_node_cur != NULL)
+    if ((ret = json_writer_putc(writer, '[')) != 0)
+    { goto fail; }
+    for (idx = 0; idx != node_array->size; idx++)
     {
-        if (first) first = 0;
-        else *p++ = ',';
-        if ((ret = json_node_dump(array_node_cur->node, &p)) != 0)
+        if (idx != 0)
+        {
+            if ((ret = json_writer_putc(writer, ',')) != 0)
+            { goto fail; }
+        }
+        if ((ret = json_node_dump(node_array->items[idx], writer)) != 0)
         { goto fail; }
-        array_node_cur = array_node_cur->next;
     }
-    *p++ = ']';
+    if ((ret = json_writer_putc(writer, ']')) != 0)
+    { goto fail; }
 
 fail:
-    *p_io = p;
     return ret;
 }
 
-static int json_node_dump_object(json_node_t *node, char **p_io)
+static int json_node_dump_object(json_node_t *node, json_writer_t *writer)
 {
     int ret = 0;
-    char *p = *p_io;
     json_node_object_node_t *object_node_cur = node->u.object_part->begin;
     int first = 1;
 
-    *p++ = '{';
+    if ((ret = json_writer_putc(writer, '{')) != 0)
+    { goto fail; }
     while (object_node_cur != NULL)
     {
         if (first) first = 0;
-        else *p++ = ',';
-        if ((ret = json_node_dump(object_node_cur->name, &p)) != 0)
+        else if ((ret = json_writer_putc(writer, ',')) != 0)
+        { goto fail; }
+        if ((ret = json_node_dump(object_node_cur->name, writer)) != 0)
         { goto fail; }
-        *p++ = ':';
-        if ((ret = json_node_dump(object_node_cur->value, &p)) != 0)
+        if ((ret = json_writer_putc(writer, ':')) != 0)
+        { goto fail; }
+        if ((ret = json_node_dump(object_node_cur->value, writer)) != 0)
         { goto fail; }
         object_node_cur = object_node_cur->next;
     }
-    *p++ = '}';
+    if ((ret = json_writer_putc(writer, '}')) != 0)
+    { goto fail; }
 
 fail:
-    *p_io = p;
     return ret;
 }
 
-static int json_node_dump_integer(json_node_t *node, char **p_io)
+/* Formatted straight into the output when there is room for the
+ * longest number, through a local buffer otherwise */
+static int json_node_dump_number(json_node_t *node, json_writer_t *writer)
 {
-    int ret = 0;
-    char *p = *p_io;
-    int value = node->u.number_part.int_part;
-    int len = json_node_length_integer(value);
-    int idx;
-
-    if (value == 0)
-    {
-        *p++ = '0';
-        goto finish;
-    }
-
-    if (value < 0)
-    {
-        value = -value;
-        *p++ = '-';
-        len--;
-    }
-    idx = len;
-    for (;;)
-    {
-        idx--;
-        p[idx] = (char)((int)('0') + (int)(value % 10));
-        value /= 10;
-        if (idx == 0) break;
-    }
-    p += len;
+    char number_buf[JSON_NUMBER_FORMAT_MAX];
+    char *buf = number_buf;
+    int direct = (writer->capacity - writer->len >= JSON_NUMBER_FORMAT_MAX);
+    int len;
+
+    if (direct) buf = writer->buf + writer->len;
+    if (node->type == JSON_NODE_TYPE_INTEGER)
+    { len = json_number_format_integer(node->u.number_part.int_part, buf); }
+    else
+    { len = json_number_format_double(node->u.number_part.double_part, buf); }
 
-finish:
-    *p_io = p;
-    return ret;
+    if (!direct) return json_writer_put(writer, number_buf, (size_t)len);
+    writer->len += (size_t)len;
+    return 0;
 }
 
-static int json_node_dump_string(json_node_t *node, char **p_io)
+static int json_node_dump_string(json_node_t *node, json_writer_t *writer)
 {
     int ret = 0;
-    char *p = *p_io;
     char *str_p = node->u.string_part.str, *str_endp = str_p + node->u.string_part.len;
+    char *special_p;
+    char escape_buf[6];
 
-    *p++ = '\"';
+    if ((ret = json_writer_putc(writer, '\"')) != 0)
+    { goto fail; }
 
-    while (str_p != str_endp)
+    /* Copy the runs that need no escaping whole; only quotes,
+     * backslashes and control bytes are escaped one by one */
+    for (;;)
     {
-        switch (*str_p)
-        {
-            case '\\':
-                *p++ = *str_p++;
-                if (*str_p == 'u')
-                {
-                    *p++ = *str_p++;
-                    *p++ = *str_p++;
-                    *p++ = *str_p++;
-                    *p++ = *str_p++;
-                    *p++ = *str_p++;
-                }
-                else if (*str_p == '\"')
-                { *p++ = *str_p++; }
-                else if (*str_p == '\\')
-                { *p++ = *str_p++; }
-                else if (*str_p == '/')
-                { *p++ = *str_p++; }
-                else if (*str_p == 'b')
-                { *p++ = *str_p++; }
-                else if (*str_p == 'f')
-                { *p++ = *str_p++; }
-                else if (*str_p == 'n')
-                { *p++ = *str_p++; }
-                else if (*str_p == 'r')
-                { *p++ = *str_p++; }
-                else if (*str_p == 't')
-                { *p++ = *str_p++; }
-                else
-                { return -1; }
-                break;
-            default:
-                *p++ = *str_p++;
-                break;
-        }
+        special_p = str_p + json_simd_scan_string(str_p, \
+                (size_t)(str_endp - str_p));
+        if ((ret = json_writer_put(writer, str_p, \
+                        (size_t)(special_p - str_p))) != 0)
+        { goto fail; }
+        if ((str_p = special_p) == str_endp) break;
+
+        if ((ret = json_writer_put(writer, escape_buf, \
+                        json_escape_char(*str_p++, escape_buf))) != 0)
+        { goto fail; }
     }
 
-    *p++ = '\"';
+    if ((ret = json_writer_putc(writer, '\"')) != 0)
+    { goto fail; }
 
-    *p_io = p;
+fail:
     return ret;
 }
 
-static int json_node_dump(json_node_t *node, char **p_io)
+static int json_node_dump(json_node_t *node, json_writer_t *writer)
 {
     int ret = 0;
-    char *p = *p_io;
 
     switch (node->type)
     {
         case JSON_NODE_TYPE_ARRAY:
-            if ((ret = json_node_dump_array(node, &p)) != 0)
+            if ((ret = json_node_dump_array(node, writer)) != 0)
             { goto fail; }
             break;
         case JSON_NODE_TYPE_OBJECT:
-            if ((ret = json_node_dump_object(node, &p)) != 0)
+            if ((ret = json_node_dump_object(node, writer)) != 0)
             { goto fail; }
             break;
-        case JSON_NODE_TYPE_INTEGER: 
-            if ((ret = json_node_dump_integer(node, &p)) != 0)
+        case JSON_NODE_TYPE_INTEGER:
+        case JSON_NODE_TYPE_DOUBLE:
+            if ((ret = json_node_dump_number(node, writer)) != 0)
             { goto fail; }
             break;
         case JSON_NODE_TYPE_STRING:
-            if ((ret = json_node_dump_string(node, &p)) != 0)
+            if ((ret = json_node_dump_string(node, writer)) != 0)
             { goto fail; }
             break;
-        case JSON_NODE_TYPE_UNKNOWN: 
+        case JSON_NODE_TYPE_UNKNOWN:
             break;
-        case JSON_NODE_TYPE_DOUBLE:
-            break;
-        case JSON_NODE_TYPE_TRUE: 
-            memcpy(p, "true", 4);
-            p += 4;
+        case JSON_NODE_TYPE_TRUE:
+            ret = json_writer_put(writer, "true", 4);
             break;
         case JSON_NODE_TYPE_FALSE:
-            memcpy(p, "false", 5);
-            p += 5;
+            ret = json_writer_put(writer, "false", 5);
             break;
         case JSON_NODE_TYPE_NULL:
-            memcpy(p, "null", 4);
-            p += 4;
+            ret = json_writer_put(writer, "null", 4);
             break;
     }
 
 fail:
-    *p_io = p;
     return ret;
 }
 
-json_node_t *json_node_new_integer(int value)
+static json_node_t *json_node_new_integer_in(json_arena_t *arena, \
+        int64_t value)
 {
-    json_node_t *new_node = json_node_new(JSON_NODE_TYPE_INTEGER);
+    json_node_t *new_node = json_node_new_in(arena, JSON_NODE_TYPE_INTEGER);
     if (new_node == NULL) return NULL;
     new_node->u.number_part.int_part = value;
     return new_node;
 }
 
+json_node_t *json_node_new_integer(int64_t value)
+{
+    return json_node_new_integer_in(NULL, value);
+}
+
 json_node_t *json_node_new_double(double value)
 {
     json_node_t *new_node = json_node_new(JSON_NODE_TYPE_DOUBLE);
@@ -596,11 +1023,12 @@ json_node_t *json_node_new_null(void)
     return json_node_new(JSON_NODE_TYPE_NULL);
 }
 
-json_node_t *json_node_new_string(char *str, size_t len)
+static json_node_t *json_node_new_string_in(json_arena_t *arena, \
+        char *str, size_t len)
 {
-    json_node_t *new_node = json_node_new(JSON_NODE_TYPE_STRING);
+    json_node_t *new_node = json_node_new_in(arena, JSON_NODE_TYPE_STRING);
     if (new_node == NULL) return NULL;
-    new_node->u.string_part.str = (char *)malloc(sizeof(char) * (len + 1));
+    new_node->u.string_part.str = (char *)json_alloc(arena, sizeof(char) * (len + 1));
     if (new_node->u.string_part.str == NULL)
     { json_node_destroy(new_node); return NULL; }
     memcpy(new_node->u.string_part.str, str, len);
@@ -609,45 +1037,133 @@ json_node_t *json_node_new_string(char *str, size_t len)
     return new_node;
 }
 
-json_node_t *json_node_new_array(void)
+/* The node holds the decoded form of the escaped body at str */
+static json_node_t *json_node_new_string_unescape_in(json_arena_t *arena, \
+        char *str, size_t len)
 {
-    json_node_t *new_node = json_node_new(JSON_NODE_TYPE_ARRAY);
+    json_node_t *new_node = json_node_new_in(arena, JSON_NODE_TYPE_STRING);
     if (new_node == NULL) return NULL;
-    new_node->u.array_part = json_node_array_new();
-    if (new_node->u.array_part == NULL)
+    /* Decoding never makes the body longer */
+    new_node->u.string_part.str = (char *)json_alloc(arena, sizeof(char) * (len + 1));
+    if (new_node->u.string_part.str == NULL)
     { json_node_destroy(new_node); return NULL; }
+    len = json_string_unescape(str, len, new_node->u.string_part.str);
+    new_node->u.string_part.str[len] = '\0';
+    new_node->u.string_part.len = len;
     return new_node;
 }
 
-json_node_t *json_node_new_object(void)
+/* The node refers to len bytes at str, which must outlive it */
+static json_node_t *json_node_new_string_borrowed_in(json_arena_t *arena, \
+        char *str, size_t len)
 {
-    json_node_t *new_node = json_node_new(JSON_NODE_TYPE_OBJECT);
+    json_node_t *new_node = json_node_new_in(arena, JSON_NODE_TYPE_STRING);
     if (new_node == NULL) return NULL;
-    new_node->u.array_part = json_node_array_new();
+    new_node->flags |= JSON_NODE_FLAG_BORROWED;
+    new_node->u.string_part.str = str;
+    new_node->u.string_part.len = len;
+    return new_node;
+}
+
+json_node_t *json_node_new_string(char *str, size_t len)
+{
+    return json_node_new_string_in(NULL, str, len);
+}
+
+static json_node_t *json_node_new_array_in(json_arena_t *arena)
+{
+    json_node_t *new_node = json_node_new_in(arena, JSON_NODE_TYPE_ARRAY);
+    if (new_node == NULL) return NULL;
+    new_node->u.array_part = json_node_array_new(arena);
     if (new_node->u.array_part == NULL)
     { json_node_destroy(new_node); return NULL; }
     return new_node;
 }
 
+json_node_t *json_node_new_array(void)
+{
+    return json_node_new_array_in(NULL);
+}
+
+static json_node_t *json_node_new_object_in(json_arena_t *arena)
+{
+    json_node_t *new_node = json_node_new_in(arena, JSON_NODE_TYPE_OBJECT);
+    if (new_node == NULL) return NULL;
+    new_node->u.object_part = json_node_object_new(arena);
+    if (new_node->u.object_part == NULL)
+    { json_node_destroy(new_node); return NULL; }
+    return new_node;
+}
+
+json_node_t *json_node_new_object(void)
+{
+    return json_node_new_object_in(NULL);
+}
+
+/* A malloc'd node linked under an arena node forces json_destroy
+ * to walk the tree instead of just dropping the chunks */
+static void json_arena_adopt(json_arena_t *arena, json_node_t *node)
+{
+    if ((arena != NULL) && ((node->flags & JSON_NODE_FLAG_ARENA) == 0))
+    {
+        while (arena->forward != NULL) arena = arena->forward;
+        arena->foreign = 1;
+    }
+}
+
 int json_node_as_array_append(json_node_t *node_array, \
         json_node_t *new_element)
 {
-    json_node_array_node_t *new_array_node = json_node_array_node_new(new_element);
-    if (new_array_node == NULL) return -1;
-    json_node_array_append(node_array->u.array_part, new_array_node);
+    if (json_node_array_append(node_array->u.array_part, \
+                new_element) != 0)
+    { return -1; }
+    json_arena_adopt(node_array->u.array_part->arena, new_element);
     return 0;
 }
 
 int json_node_as_object_append(json_node_t *node_object, \
         json_node_t *new_name, json_node_t *new_value)
 {
+    json_arena_t *arena = node_object->u.object_part->arena;
     json_node_object_node_t *new_object_node = json_node_object_node_new( \
-            new_name, new_value);
+            arena, new_name, new_value);
     if (new_object_node == NULL) return -1;
+    json_arena_adopt(arena, new_name);
+    json_arena_adopt(arena, new_value);
     json_node_object_append(node_object->u.object_part, new_object_node);
     return 0;
 }
 
+int json_node_array_reserve(json_node_t *node_array, size_t capacity)
+{
+    return json_node_array_grow(node_array->u.array_part, capacity);
+}
+
+size_t json_node_array_size(json_node_t *node_array)
+{
+    return node_array->u.array_part->size;
+}
+
+json_node_t *json_node_array_get(json_node_t *node_array, size_t idx)
+{
+    if (idx >= node_array->u.array_part->size) return NULL;
+    return node_array->u.array_part->items[idx];
+}
+
+json_node_t *json_node_object_get(json_node_t *node_object, \
+        const char *key, size_t len)
+{
+    return json_node_object_find(node_object->u.object_part, key, len, \
+            NULL, 1);
+}
+
+json_node_t *json_node_object_get_hashed(json_node_t *node_object, \
+        const char *key, size_t len, size_t hash)
+{
+    return json_node_object_find(node_object->u.object_part, key, len, \
+            &hash, 0);
+}
+
 
 /* JSON */
 
@@ -656,380 +1172,1059 @@ json_t *json_new(void)
     json_t *new_json = (json_t *)malloc(sizeof(json_t));
     if (new_json == NULL) return NULL; 
     new_json->root = NULL;
+    new_json->arena = NULL;
+    new_json->borrowed = NULL;
+    new_json->mapping = NULL;
+    new_json->mapping_len = 0;
     return new_json;
 }
 
 void json_destroy(json_t *json)
 {
-    json_node_destroy(json->root);
+    /* An arena holding only its own nodes is released without a walk */
+    if ((json->root != NULL) && \
+            ((json->arena == NULL) || (json->arena->foreign)))
+    { json_node_destroy(json->root); }
+    if (json->arena != NULL) json_arena_destroy(json->arena);
+    if (json->mapping != NULL) json_file_unmap(json->mapping, json->mapping_len);
     free(json);
 }
 
 void json_set_root(json_t *json, json_node_t *node)
 {
+    json_arena_adopt(json->arena, node);
     json->root = node;
 }
 
-int json_dump(json_t *json, char **str_out, size_t *len_out)
+int json_dump_ex(json_t *json, char **str_out, size_t *len_out, \
+        unsigned int flags, size_t size_hint)
 {
     int ret = 0;
-    int length = json_node_length(json->root);
-    char *str = NULL;
-    char *str_p = NULL;
+    json_writer_t writer;
+    char *new_buf = NULL;
 
-    if (length < 0) return -1;
+    json_writer_init(&writer, NULL, 0, 1);
 
-    str = (char *)malloc(sizeof(char) * ((size_t)length + 1));
-    if (str == NULL) 
+    if (flags & JSON_DUMP_EXACT)
+    {
+        /* Size the whole output first, then fill it without growing */
+        size_hint = 0;
+        if (json_node_length(json->root, &size_hint) != 0) return -1;
+        writer.growable = 0;
+    }
+
+    if ((writer.buf = (char *)malloc(size_hint + 1)) == NULL)
     { ret = -1; goto fail; }
-    str_p = str;
+    writer.capacity = size_hint + 1;
 
-    if ((ret = json_node_dump(json->root, &str_p)) != 0)
+    if ((ret = json_node_dump(json->root, &writer)) != 0)
+    { goto fail; }
+    if ((ret = json_writer_putc(&writer, '\0')) != 0)
     { goto fail; }
-    str[length] = '\0';
+    writer.len--;
+
+    /* Give back the slack left by the last doubling */
+    if (writer.capacity - writer.len > writer.len / 4 + JSON_WRITER_CAPACITY_MIN)
+    {
+        if ((new_buf = (char *)realloc(writer.buf, writer.len + 1)) != NULL)
+        { writer.buf = new_buf; }
+    }
 
-    *str_out = str;
-    *len_out = (size_t)length;
+    *str_out = writer.buf;
+    *len_out = writer.len;
     goto done;
 fail:
-    if (str != NULL)
-    { free(str); }
+    if (writer.buf != NULL)
+    { free(writer.buf); }
 done:
     return ret;
 }
 
+int json_dump(json_t *json, char **str_out, size_t *len_out)
+{
+    return json_dump_ex(json, str_out, len_out, JSON_DUMP_DEFAULT, 0);
+}
 
-static int json_node_array_load(json_node_t **json_node_out, \
-        char **str_io, char *str_endp)
+int json_dump_buffer(json_t *json, char *buf, size_t size, size_t *len_out)
 {
     int ret = 0;
-    char *str_p = *str_io;
-    json_node_t *new_array = NULL;
-    json_node_t *new_array_node = NULL;
+    json_writer_t writer;
 
-    /* Skip '[' */
-    str_p++;
+    json_writer_init(&writer, buf, size, 0);
 
-    if ((new_array = json_node_new_array()) == NULL)
-    { ret = -1; goto fail; }
+    if ((ret = json_node_dump(json->root, &writer)) != 0)
+    { return ret; }
+    if ((ret = json_writer_putc(&writer, '\0')) != 0)
+    { return ret; }
 
-    for (;;)
-    {
-        if (str_p == str_endp)
-        { ret = -1; goto fail; }
-        if (*str_p == ']') break;
-
-        if ((ret = json_node_load(&new_array_node, \
-                        &str_p, str_endp)) != 0)
-        { goto fail; }
-        if ((ret = json_node_as_array_append(new_array, \
-                        new_array_node)) != 0)
-        { goto fail; }
-        new_array_node = NULL;
+    *len_out = writer.len - 1;
+    return 0;
+}
 
-        /* ',' */
-        if (str_p == str_endp) 
-        { ret = -1; goto fail; }
-        if (*str_p == ']') break;
-        else if (*str_p == ',')
-        {
-            /* Skip ',' */
-            str_p++;
-        }
-        else
-        { ret = -1; goto fail; }
-    }
+int json_dump_cb(json_t *json, json_write_fn_t write, void *ctx)
+{
+    int ret = 0;
+    json_writer_t writer;
+    char *staging = NULL;
 
-    /* Skip ']' */
-    str_p++;
+    if ((staging = (char *)malloc(JSON_WRITER_STAGING_SIZE)) == NULL)
+    { return -1; }
+    json_writer_init(&writer, staging, JSON_WRITER_STAGING_SIZE, 0);
+    writer.write = write;
+    writer.write_ctx = ctx;
 
-    *json_node_out = new_array;
+    if ((ret = json_node_dump(json->root, &writer)) != 0)
+    { goto fail; }
+    if ((ret = json_writer_flush(&writer)) != 0)
+    { goto fail; }
 
-    goto done;
 fail:
-    if (new_array != NULL) json_node_destroy(new_array);
-    if (new_array_node != NULL) json_node_destroy(new_array_node);
-done:
-    *str_io = str_p;
+    free(staging);
     return ret;
 }
 
-static int json_node_object_load(json_node_t **json_node_out, \
-        char **str_io, char *str_endp)
+static int json_dump_file_write(void *ctx, const char *data, size_t len)
+{
+    return (fwrite(data, 1, len, (FILE *)ctx) == len) ? 0 : -1;
+}
+
+int json_dump_file(json_t *json, FILE *fp)
+{
+    return json_dump_cb(json, json_dump_file_write, fp);
+}
+
+int json_buffer_dump(json_buffer_t *buffer, json_node_t *node)
 {
     int ret = 0;
+    json_writer_t writer;
+
+    json_writer_init(&writer, buffer->buf, buffer->capacity, 1);
+    writer.len = buffer->len;
+    ret = json_node_dump(node, &writer);
+    buffer->buf = writer.buf;
+    buffer->len = writer.len;
+    buffer->capacity = writer.capacity;
+    return ret;
+}
+
+int json_buffer_put(json_buffer_t *buffer, const char *data, size_t len)
+{
+    int ret = 0;
+    json_writer_t writer;
+
+    json_writer_init(&writer, buffer->buf, buffer->capacity, 1);
+    writer.len = buffer->len;
+    ret = json_writer_put(&writer, data, len);
+    buffer->buf = writer.buf;
+    buffer->len = writer.len;
+    buffer->capacity = writer.capacity;
+    return ret;
+}
+
+/* Scalar decoders
+ *
+ * Each takes *str_io at the first byte of a token and leaves it just
+ * past the token. They allocate nothing, so every consumer of the
+ * grammar (the tree builder included) decodes values the same way. */
+
+/* String body between the quotes, still in its escaped form. The body
+ * must be well-formed UTF-8 with no raw control characters, and every
+ * escape must decode. */
+int json_string_scan(char **str_io, char *str_endp, \
+        char **body_out, size_t *len_out)
+{
     char *str_p = *str_io;
-    json_node_t *new_object = NULL;
-    json_node_t *new_object_name = NULL;
-    json_node_t *new_object_value = NULL;
+    char *str_start_p;
+    size_t escape_len;
 
-    /* Skip '{' */
+    /* Skip \" */
     str_p++;
-
-    if ((new_object = json_node_new_object()) == NULL)
-    { ret = -1; goto fail; }
+    str_start_p = str_p;
 
     for (;;)
     {
-        if (str_p == str_endp)
-        { ret = -1; goto fail; }
-        if (*str_p == '}') break;
+        /* Validate the plain run up to the next quote, escape or
+         * control character in the same pass */
+        str_p += json_simd_scan_string_utf8(str_p, \
+                (size_t)(str_endp - str_p));
+        if (str_p == str_endp) return -1;
 
-        /* Name */
-        if ((ret = json_node_load(&new_object_name, \
-                        &str_p, str_endp)) != 0)
-        { goto fail; }
+        if (*str_p == '\"') break;
+        /* A control character or a byte that is not UTF-8 */
+        if (*str_p != '\\') return -1;
 
-        /* ':' */
-        if (str_p == str_endp) 
-        { ret = -1; goto fail; }
-        if (*str_p != ':') break;
-        str_p++;
+        if ((escape_len = json_escape_length(str_p, str_endp)) == 0)
+        { return -1; }
+        str_p += escape_len;
+    }
 
-        /* Value */
-        if ((ret = json_node_load(&new_object_value, \
-                        &str_p, str_endp)) != 0)
-        { goto fail; }
+    *body_out = str_start_p;
+    *len_out = (size_t)(str_p - str_start_p);
 
-        if ((ret = json_node_as_object_append(new_object, \
-                        new_object_name, new_object_value)) != 0)
-        { goto fail; }
-        new_object_name = NULL;
-        new_object_value = NULL;
+    /* Skip \" */
+    *str_io = str_p + 1;
+    return 0;
+}
 
-        /* ',' */
-        if (str_p == str_endp) 
-        { ret = -1; goto fail; }
-        if (*str_p == '}') break;
-        else if (*str_p == ',')
+size_t json_string_unescape(const char *str, size_t len, char *out)
+{
+    const char *str_p = str, *str_endp = str + len;
+    const char *escape_p;
+    char *out_p = out;
+    unsigned long code;
+
+    while (str_p != str_endp)
+    {
+        /* Copy the run up to the next escape whole */
+        escape_p = (const char *)memchr(str_p, '\\', \
+                (size_t)(str_endp - str_p));
+        if (escape_p == NULL) escape_p = str_endp;
+        memmove(out_p, str_p, (size_t)(escape_p - str_p));
+        out_p += escape_p - str_p;
+        if ((str_p = escape_p) == str_endp) break;
+
+        switch (str_p[1])
         {
-            /* Skip ',' */
-            str_p++;
+            case 'b': *out_p++ = '\b'; break;
+            case 'f': *out_p++ = '\f'; break;
+            case 'n': *out_p++ = '\n'; break;
+            case 'r': *out_p++ = '\r'; break;
+            case 't': *out_p++ = '\t'; break;
+            case 'u':
+                code = (unsigned long)json_escape_unit(str_p, str_endp);
+                if ((code >= 0xd800) && (code <= 0xdbff))
+                {
+                    /* Surrogate pair */
+                    code = 0x10000 + ((code - 0xd800) << 10) + \
+                           ((unsigned long)json_escape_unit(str_p + 6, \
+                                                            str_endp) - 0xdc00);
+                    str_p += 6;
+                }
+                if (code < 0x80)
+                { *out_p++ = (char)code; }
+                else if (code < 0x800)
+                {
+                    *out_p++ = (char)(0xc0 | (code >> 6));
+                    *out_p++ = (char)(0x80 | (code & 0x3f));
+                }
+                else if (code < 0x10000)
+                {
+                    *out_p++ = (char)(0xe0 | (code >> 12));
+                    *out_p++ = (char)(0x80 | ((code >> 6) & 0x3f));
+                    *out_p++ = (char)(0x80 | (code & 0x3f));
+                }
+                else
+                {
+                    *out_p++ = (char)(0xf0 | (code >> 18));
+                    *out_p++ = (char)(0x80 | ((code >> 12) & 0x3f));
+                    *out_p++ = (char)(0x80 | ((code >> 6) & 0x3f));
+                    *out_p++ = (char)(0x80 | (code & 0x3f));
+                }
+                str_p += 4;
+                break;
+            default:
+                /* \" \\ \/ */
+                *out_p++ = str_p[1];
+                break;
         }
-        else
-        { ret = -1; goto fail; }
+        str_p += 2;
     }
+    return (size_t)(out_p - out);
+}
 
-    /* Skip '}' */
-    str_p++;
+/* null, true or false */
+int json_literal_scan(char **str_io, char *str_endp, \
+        json_node_type_t *type_out)
+{
+    char *str_p = *str_io;
+    char *str_start_p = str_p;
+    size_t len;
 
-    *json_node_out = new_object;
+    while (str_p != str_endp)
+    {
+        if (IS_ALPHA_LOWCASE(*str_p))
+        { str_p++; }
+        else { break; }
+    }
+
+    len = (size_t)(str_p - str_start_p);
+    if ((len == 4) && (strncmp(str_start_p, "null", 4) == 0))
+    { *type_out = JSON_NODE_TYPE_NULL; }
+    else if ((len == 4) && (strncmp(str_start_p, "true", 4) == 0))
+    { *type_out = JSON_NODE_TYPE_TRUE; }
+    else if ((len == 5) && (strncmp(str_start_p, "false", 5) == 0))
+    { *type_out = JSON_NODE_TYPE_FALSE; }
+    else
+    { return -1; }
 
-    goto done;
-fail:
-    if (new_object != NULL) json_node_destroy(new_object);
-    if (new_object_name != NULL) json_node_destroy(new_object_name);
-    if (new_object_value != NULL) json_node_destroy(new_object_value);
-done:
     *str_io = str_p;
-    return ret;
+    return 0;
 }
 
-static int json_node_string_load(json_node_t **json_node_out, \
+
+/* Grammar
+ *
+ * The loader below recognizes the document and reports it as a stream
+ * of json_sax_t events; it builds nothing itself. A NULL callback
+ * skips its event, a nonzero return from a callback stops the parse.
+ * Whitespace is allowed around every token and skipped before looking
+ * at the next structural character.
+ *
+ * Nesting is tracked on a json_stack_t, one byte per open container,
+ * instead of by recursion: a deep document costs heap rather than C
+ * stack, and one nested past the stack's max_depth fails the parse
+ * like any other malformed input. */
+
+#define JSON_STACK_MIN ((size_t)16)
+
+void json_stack_init(json_stack_t *stack, size_t max_depth)
+{
+    stack->items = NULL;
+    stack->depth = 0;
+    stack->capacity = 0;
+    stack->max_depth = (max_depth == 0) ? JSON_DEPTH_DEFAULT : max_depth;
+}
+
+int json_stack_push(json_stack_t *stack, char ch)
+{
+    char *new_items = NULL;
+    size_t capacity;
+
+    if (stack->depth == stack->max_depth) return -1;
+    if (stack->depth == stack->capacity)
+    {
+        capacity = stack->capacity * 2;
+        if (capacity < JSON_STACK_MIN) capacity = JSON_STACK_MIN;
+        if ((new_items = (char *)realloc(stack->items, capacity)) == NULL)
+        { return -1; }
+        stack->items = new_items;
+        stack->capacity = capacity;
+    }
+    stack->items[stack->depth++] = ch;
+    return 0;
+}
+
+void json_stack_fini(json_stack_t *stack)
+{
+    if (stack->items != NULL) free(stack->items);
+    stack->items = NULL;
+    stack->depth = 0;
+    stack->capacity = 0;
+}
+
+static int json_node_string_load(const json_sax_t *sax, void *ctx, \
+        char **str_io, char *str_endp)
+{
+    char *str;
+    size_t len;
+
+    if (json_string_scan(str_io, str_endp, &str, &len) != 0)
+    { return -1; }
+    JSON_SAX_EMIT(sax, on_string, (ctx, str, len));
+    return 0;
+}
+
+static int json_node_number_load(const json_sax_t *sax, void *ctx, \
         char **str_io, char *str_endp)
+{
+    json_number_t number;
+
+    if (json_number_scan(str_io, str_endp, &number) != 0)
+    { return -1; }
+    if (number.type == JSON_NODE_TYPE_INTEGER)
+    { JSON_SAX_EMIT(sax, on_integer, (ctx, number.int_value)); }
+    else
+    { JSON_SAX_EMIT(sax, on_double, (ctx, number.double_value)); }
+    return 0;
+}
+
+static int json_node_alpha_lowcase_load(const json_sax_t *sax, void *ctx, \
+        char **str_io, char *str_endp)
+{
+    json_node_type_t type;
+
+    if (json_literal_scan(str_io, str_endp, &type) != 0)
+    { return -1; }
+    if (type == JSON_NODE_TYPE_NULL)
+    { JSON_SAX_EMIT(sax, on_null, (ctx)); }
+    else
+    { JSON_SAX_EMIT(sax, on_bool, (ctx, type == JSON_NODE_TYPE_TRUE)); }
+    return 0;
+}
+
+static int json_node_scalar_load(const json_sax_t *sax, void *ctx, \
+        char **str_io, char *str_endp)
+{
+    char ch = **str_io;
+
+    if (ch == '\"')
+    {
+        return json_node_string_load(sax, ctx, str_io, str_endp);
+    }
+    else if ((IS_DIGIT(ch))||(ch == '-'))
+    {
+        return json_node_number_load(sax, ctx, str_io, str_endp);
+    }
+    else if (IS_ALPHA_LOWCASE(ch))
+    {
+        return json_node_alpha_lowcase_load(sax, ctx, str_io, str_endp);
+    }
+    else
+    {
+        return -1;
+    }
+}
+
+/* One complete value at *str_io, containers and all; stack comes in
+ * empty and leaves empty on success */
+static int json_node_load(const json_sax_t *sax, void *ctx, \
+        char **str_io, char *str_endp, json_stack_t *stack)
 {
     int ret = 0;
     char *str_p = *str_io;
-    char *str_start_p;
-    json_node_t *new_json_node = NULL;
-
-    /* Skip \" */
-    str_p++;
-    str_start_p = str_p;
+    char *name;
+    size_t name_len;
+    char open;
 
-    while (str_p != str_endp)
+    for (;;)
     {
-        if (*str_p == '\"') break;
-        else if (*str_p == '\\')
+        /* Value */
+        JSON_SKIP_WHITESPACE(str_p, str_endp);
+        if (str_p == str_endp)
+        { ret = -1; goto fail; }
+        if ((*str_p == '[') || (*str_p == '{'))
         {
-            /* Escape */
-            if (++str_p == str_endp) return -1;
-
-            if (*str_p == 'u')
+            open = *str_p++;
+            if ((ret = json_stack_push(stack, open)) != 0)
+            { goto fail; }
+            if (open == '[')
+            { JSON_SAX_EMIT(sax, on_start_array, (ctx)); }
+            else
+            { JSON_SAX_EMIT(sax, on_start_object, (ctx)); }
+
+            /* An empty container is closed below like any other */
+            JSON_SKIP_WHITESPACE(str_p, str_endp);
+            if (str_p == str_endp)
+            { ret = -1; goto fail; }
+            if (*str_p != ((open == '[') ? ']' : '}'))
             {
-                if (str_endp - str_p >= 5)
-                {
-                    /* FIXME */
-                    return -1;
-                }
-                str_p += 5;
+                if (open == '[') continue;
+                goto key;
             }
-            else if (*str_p == '\"')
+        }
+        else
+        {
+            if ((ret = json_node_scalar_load(sax, ctx, &str_p, str_endp)) != 0)
+            { goto fail; }
+        }
+
+        /* Close every container that ends here, then go on with the
+         * next member of the innermost one left open */
+        for (;;)
+        {
+            /* Like json_sax_parse always has, ignore whatever follows
+             * the document */
+            if (stack->depth == 0) goto fail;
+
+            JSON_SKIP_WHITESPACE(str_p, str_endp);
+            if (str_p == str_endp)
+            { ret = -1; goto fail; }
+            open = stack->items[stack->depth - 1];
+            if (*str_p == ',')
             {
-                return -1;
+                /* A closing bracket after a comma is accepted */
+                str_p++;
+                JSON_SKIP_WHITESPACE(str_p, str_endp);
+                if (str_p == str_endp)
+                { ret = -1; goto fail; }
+                if (*str_p != ((open == '[') ? ']' : '}')) break;
             }
-        }
-        str_p++;
-    }
-    if (str_p == str_endp) return -1;
+            else if (*str_p != ((open == '[') ? ']' : '}'))
+            { ret = -1; goto fail; }
 
-    if ((new_json_node = json_node_new_string( \
-                    str_start_p, \
-                    (size_t)(str_p - str_start_p))) == NULL)
-    { ret = -1; goto fail; }
+            /* Skip ']' or '}' */
+            str_p++;
+            stack->depth--;
+            if (open == '[')
+            { JSON_SAX_EMIT(sax, on_end_array, (ctx)); }
+            else
+            { JSON_SAX_EMIT(sax, on_end_object, (ctx)); }
+        }
+        if (open == '[') continue;
 
-    /* Skip \" */
-    str_p++;
+key:
+        /* Name */
+        if (*str_p != '\"')
+        { ret = -1; goto fail; }
+        if ((ret = json_string_scan(&str_p, str_endp, \
+                        &name, &name_len)) != 0)
+        { goto fail; }
+        JSON_SAX_EMIT(sax, on_key, (ctx, name, name_len));
 
-    *json_node_out = new_json_node;
+        /* ':' */
+        JSON_SKIP_WHITESPACE(str_p, str_endp);
+        if (str_p == str_endp) 
+        { ret = -1; goto fail; }
+        if (*str_p != ':')
+        { ret = -1; goto fail; }
+        str_p++;
+    }
 
-    goto done;
 fail:
-    if (new_json_node != NULL)
-    { json_node_destroy(new_json_node); }
-done:
     *str_io = str_p;
     return ret;
 }
 
-static int json_node_number_load(json_node_t **json_node_out, \
-        char **str_io, char *str_endp)
+int json_sax_parse_in(char *str, size_t len, const json_sax_t *sax, \
+        void *ctx, json_stack_t *stack, size_t *used_out)
 {
     int ret = 0;
-    char *str_p = *str_io;
-    int value = 0;
-    json_node_t *new_json_node = NULL;
-    int negative = 0;
+    char *str_p = str;
+    char *str_endp = str + len;
 
-    if (str_p == str_endp) goto fail;
+    stack->depth = 0;
+    if ((ret = json_node_load(sax, ctx, &str_p, str_endp, stack)) != 0)
+    { return ret; }
+    if (used_out != NULL) *used_out = (size_t)(str_p - str);
+    return 0;
+}
 
-    if (*str_p == '-')
-    { negative = 1; str_p++; }
+int json_sax_parse_members(char *str, size_t len, const json_sax_t *sax, \
+        void *ctx, json_stack_t *stack, char open, int last)
+{
+    int ret = 0;
+    char *str_p = str;
+    char *str_endp = str + len;
+    char *name;
+    size_t name_len;
 
-    while (str_p != str_endp)
+    /* Only the last slice may be empty: the body of an empty container
+     * or what follows a trailing comma */
+    JSON_SKIP_WHITESPACE(str_p, str_endp);
+    if (str_p == str_endp) return last ? 0 : -1;
+
+    for (;;)
     {
-        if (IS_DIGIT(*str_p))
+        if (open == '{')
         {
-            value = value * 10 + ((int)(*str_p) - (int)'0');
+            if (*str_p != '\"') return -1;
+            if ((ret = json_string_scan(&str_p, str_endp, \
+                            &name, &name_len)) != 0)
+            { return ret; }
+            JSON_SAX_EMIT(sax, on_key, (ctx, name, name_len));
+            JSON_SKIP_WHITESPACE(str_p, str_endp);
+            if ((str_p == str_endp) || (*str_p != ':')) return -1;
             str_p++;
         }
-        else { break; }
+
+        stack->depth = 0;
+        if ((ret = json_node_load(sax, ctx, &str_p, str_endp, stack)) != 0)
+        { return ret; }
+
+        JSON_SKIP_WHITESPACE(str_p, str_endp);
+        if (str_p == str_endp) return 0;
+        if (*str_p != ',') return -1;
+        str_p++;
+        JSON_SKIP_WHITESPACE(str_p, str_endp);
+        if (str_p == str_endp) return last ? 0 : -1;
     }
+}
 
-    if (negative) value = -value;
-    if ((new_json_node = json_node_new_integer(value)) == NULL)
-    { ret = -1; goto fail; }
+int json_sax_parse(char *str, size_t len, const json_sax_t *sax, void *ctx)
+{
+    int ret = 0;
+    json_stack_t stack;
 
-    *json_node_out = new_json_node;
+    json_stack_init(&stack, 0);
+    ret = json_sax_parse_in(str, len, sax, ctx, &stack, NULL);
+    json_stack_fini(&stack);
+    return ret;
+}
 
-    goto done;
-fail:
-    if (new_json_node != NULL)
-    { json_node_destroy(new_json_node); }
-done:
-    *str_io = str_p;
+
+/* Tree builder
+ *
+ * json_load is one more consumer of the grammar: it turns events into
+ * nodes, keeping the open containers on a stack. Every node is linked
+ * into the tree as soon as it exists, so a failed load only has to
+ * drop the root (or the arena) and a dangling key. */
+
+#define JSON_BUILDER_STACK_MIN ((size_t)16)
+/* Key interning: arena loads make one node per distinct key, shared by
+ * every member with that key. Only short keys are interned, and only
+ * so many, which keeps a document whose keys never repeat from paying
+ * for a table that never hits. */
+#define JSON_BUILDER_KEYS_MIN ((size_t)16)
+#define JSON_BUILDER_KEYS_MAX ((size_t)1024)
+#define JSON_BUILDER_KEY_LEN_MAX ((size_t)64)
+
+static int json_builder_attach(json_builder_t *builder, json_node_t *node)
+{
+    json_node_t *parent;
+    int ret;
+
+    if (node == NULL) return -1;
+    if (builder->depth == 0)
+    {
+        builder->root = node;
+        return 0;
+    }
+
+    parent = builder->stack[builder->depth - 1];
+    if (parent->type == JSON_NODE_TYPE_ARRAY)
+    {
+        ret = json_node_array_append(parent->u.array_part, node);
+    }
+    else
+    {
+        ret = json_node_as_object_append(parent, builder->key, node);
+        if (ret == 0) builder->key = NULL;
+    }
+    if ((ret != 0) && (builder->arena == NULL))
+    { json_node_destroy(node); }
     return ret;
 }
 
-static int json_node_alpha_lowcase_load(json_node_t **json_node_out, \
-        char **str_io, char *str_endp)
+static int json_builder_open(json_builder_t *builder, json_node_t *node)
 {
-    int ret = 0;
-    char *str_p = *str_io;
-    char *str_start_p = str_p;
-    size_t len;
-    json_node_t *new_json_node = NULL;
+    json_node_t **new_stack = NULL;
+    size_t capacity;
 
-    if (str_p == str_endp) goto fail;
+    if (builder->depth == builder->capacity)
+    {
+        capacity = builder->capacity * 2;
+        if (capacity < JSON_BUILDER_STACK_MIN) capacity = JSON_BUILDER_STACK_MIN;
+        if ((new_stack = (json_node_t **)realloc(builder->stack, \
+                        sizeof(json_node_t *) * capacity)) == NULL)
+        {
+            if (builder->arena == NULL) json_node_destroy(node);
+            return -1;
+        }
+        builder->stack = new_stack;
+        builder->capacity = capacity;
+    }
+    if (json_builder_attach(builder, node) != 0) return -1;
+    builder->stack[builder->depth++] = node;
+    return 0;
+}
 
-    while (str_p != str_endp)
+static int json_builder_on_start_object(void *ctx)
+{
+    json_builder_t *builder = (json_builder_t *)ctx;
+    return json_builder_open(builder, json_node_new_object_in(builder->arena));
+}
+
+static int json_builder_on_start_array(void *ctx)
+{
+    json_builder_t *builder = (json_builder_t *)ctx;
+    return json_builder_open(builder, json_node_new_array_in(builder->arena));
+}
+
+static int json_builder_on_end(void *ctx)
+{
+    json_builder_t *builder = (json_builder_t *)ctx;
+    builder->depth--;
+    return 0;
+}
+
+/* Nodes hold the decoded text; in-situ loads borrow the bodies that
+ * have nothing to decode */
+static json_node_t *json_builder_new_string(json_builder_t *builder, \
+        char *str, size_t len)
+{
+    if ((builder->flags & JSON_LOAD_INSITU) && \
+            (memchr(str, '\\', len) == NULL))
+    { return json_node_new_string_borrowed_in(builder->arena, str, len); }
+    return json_node_new_string_unescape_in(builder->arena, str, len);
+}
+
+/* The same for a body with nothing left to decode */
+static json_node_t *json_builder_new_decoded(json_builder_t *builder, \
+        char *str, size_t len)
+{
+    if (builder->flags & JSON_LOAD_INSITU)
+    { return json_node_new_string_borrowed_in(builder->arena, str, len); }
+    return json_node_new_string_in(builder->arena, str, len);
+}
+
+/* Grow the key table to capacity slots, keeping it at most half full */
+static int json_builder_keys_grow(json_builder_t *builder, size_t capacity)
+{
+    json_node_t **new_keys;
+    json_node_t *key;
+    size_t idx, pos;
+
+    if ((new_keys = (json_node_t **)calloc(capacity, \
+                    sizeof(json_node_t *))) == NULL)
+    { return -1; }
+    for (idx = 0; idx != builder->keys_capacity; idx++)
     {
-        if (IS_ALPHA_LOWCASE(*str_p))
-        { str_p++; }
-        else { break; }
+        if ((key = builder->keys[idx]) == NULL) continue;
+        pos = json_key_hash(key->u.string_part.str, key->u.string_part.len) & \
+              (capacity - 1);
+        while (new_keys[pos] != NULL) pos = (pos + 1) & (capacity - 1);
+        new_keys[pos] = key;
     }
+    if (builder->keys != NULL) free(builder->keys);
+    builder->keys = new_keys;
+    builder->keys_capacity = capacity;
+    return 0;
+}
 
-    len = (size_t)(str_p - str_start_p);
-    if ((len == 4) && (strncmp(str_start_p, "null", 4) == 0))
+/* The node for a key whose body is already decoded: the one an equal
+ * key got before, when there was one */
+static json_node_t *json_builder_intern(json_builder_t *builder, \
+        char *str, size_t len)
+{
+    json_node_t *key;
+    size_t pos;
+
+    if ((builder->arena == NULL) || (len > JSON_BUILDER_KEY_LEN_MAX))
+    { return json_builder_new_decoded(builder, str, len); }
+    if ((builder->keys_count * 2 >= builder->keys_capacity) && \
+            (builder->keys_count < JSON_BUILDER_KEYS_MAX))
     {
-        if ((new_json_node = json_node_new_null()) == NULL)
-        { ret = -1; goto fail; }
+        if (json_builder_keys_grow(builder, (builder->keys_capacity != 0) ? \
+                    builder->keys_capacity * 2 : JSON_BUILDER_KEYS_MIN) != 0)
+        { return NULL; }
     }
-    else if ((len == 4) && (strncmp(str_start_p, "true", 4) == 0))
+
+    pos = json_key_hash(str, len) & (builder->keys_capacity - 1);
+    while ((key = builder->keys[pos]) != NULL)
     {
-        if ((new_json_node = json_node_new_true()) == NULL)
-        { ret = -1; goto fail; }
+        if ((key->u.string_part.len == len) && \
+                (memcmp(key->u.string_part.str, str, len) == 0))
+        { return key; }
+        pos = (pos + 1) & (builder->keys_capacity - 1);
     }
-    else if ((len == 5) && (strncmp(str_start_p, "false", 5) == 0))
+
+    key = json_builder_new_decoded(builder, str, len);
+    if ((key != NULL) && (builder->keys_count < JSON_BUILDER_KEYS_MAX))
     {
-        if ((new_json_node = json_node_new_false()) == NULL)
-        { ret = -1; goto fail; }
+        builder->keys[pos] = key;
+        builder->keys_count++;
     }
+    return key;
+}
 
-    *json_node_out = new_json_node;
+static int json_builder_on_key(void *ctx, char *str, size_t len)
+{
+    json_builder_t *builder = (json_builder_t *)ctx;
 
-    goto done;
-fail:
-    if (new_json_node != NULL)
-    { json_node_destroy(new_json_node); }
-done:
-    *str_io = str_p;
-    return ret;
+    if (memchr(str, '\\', len) == NULL)
+    { builder->key = json_builder_intern(builder, str, len); }
+    else
+    { builder->key = json_node_new_string_unescape_in(builder->arena, str, len); }
+    return (builder->key != NULL) ? 0 : -1;
 }
 
-static int json_node_load(json_node_t **json_node_out, \
-        char **str_io, char *str_endp)
+static int json_builder_on_string(void *ctx, char *str, size_t len)
 {
-    char *str_p = *str_io;
+    json_builder_t *builder = (json_builder_t *)ctx;
+    return json_builder_attach(builder, \
+            json_builder_new_string(builder, str, len));
+}
+
+int json_builder_string(json_builder_t *builder, char *str, size_t len, \
+        int key)
+{
+    if (!key)
+    { return json_builder_attach(builder, json_builder_new_decoded(builder, str, len)); }
+    builder->key = json_builder_intern(builder, str, len);
+    return (builder->key != NULL) ? 0 : -1;
+}
+
+static int json_builder_on_integer(void *ctx, int64_t value)
+{
+    json_builder_t *builder = (json_builder_t *)ctx;
+    return json_builder_attach(builder, \
+            json_node_new_integer_in(builder->arena, value));
+}
+
+static int json_builder_on_double(void *ctx, double value)
+{
+    json_builder_t *builder = (json_builder_t *)ctx;
+    json_node_t *new_node = json_node_new_in(builder->arena, JSON_NODE_TYPE_DOUBLE);
+
+    if (new_node != NULL) new_node->u.number_part.double_part = value;
+    return json_builder_attach(builder, new_node);
+}
+
+static int json_builder_on_bool(void *ctx, int value)
+{
+    json_builder_t *builder = (json_builder_t *)ctx;
+    return json_builder_attach(builder, json_node_new_in(builder->arena, \
+                value ? JSON_NODE_TYPE_TRUE : JSON_NODE_TYPE_FALSE));
+}
 
-    if (str_p == str_endp) return -1;
+static int json_builder_on_null(void *ctx)
+{
+    json_builder_t *builder = (json_builder_t *)ctx;
+    return json_builder_attach(builder, \
+            json_node_new_in(builder->arena, JSON_NODE_TYPE_NULL));
+}
 
-    if (*str_p == '[')
+const json_sax_t json_builder_sax =
+{
+    json_builder_on_start_object,
+    json_builder_on_end,
+    json_builder_on_start_array,
+    json_builder_on_end,
+    json_builder_on_key,
+    json_builder_on_string,
+    json_builder_on_integer,
+    json_builder_on_double,
+    json_builder_on_bool,
+    json_builder_on_null,
+};
+
+int json_builder_init(json_builder_t *builder, unsigned int flags)
+{
+    builder->arena = NULL;
+    builder->root = NULL;
+    builder->key = NULL;
+    builder->stack = NULL;
+    builder->depth = 0;
+    builder->capacity = 0;
+    builder->keys = NULL;
+    builder->keys_count = 0;
+    builder->keys_capacity = 0;
+    builder->flags = flags;
+
+    if ((flags & JSON_LOAD_HEAP) == 0)
     {
-        return json_node_array_load(json_node_out, \
-                str_io, str_endp);
+        if ((builder->arena = json_arena_new()) == NULL)
+        { return -1; }
     }
-    else if (*str_p == '{')
+    return 0;
+}
+
+/* Hand the finished tree and its arena over to a new document */
+int json_builder_finish(json_builder_t *builder, json_t **json_out)
+{
+    json_t *new_json = NULL;
+
+    if ((builder->root == NULL) || (builder->depth != 0)) return -1;
+    if ((new_json = json_new()) == NULL) return -1;
+    new_json->arena = builder->arena;
+    builder->arena = NULL;
+    json_set_root(new_json, builder->root);
+    builder->root = NULL;
+
+    *json_out = new_json;
+    return 0;
+}
+
+/* Move the members of each part's root, loaded from consecutive
+ * slices of the container open in builder, to the end of it in order.
+ * The parts are left empty; on failure nothing has moved. */
+int json_builder_splice(json_builder_t *builder, json_builder_t *parts, \
+        size_t count)
+{
+    json_node_t *parent = builder->stack[builder->depth - 1];
+    json_node_array_t *array, *array_from;
+    json_node_object_t *object, *object_from;
+    size_t idx, size = 0;
+
+    if (parent->type == JSON_NODE_TYPE_ARRAY)
     {
-        return json_node_object_load(json_node_out, \
-                str_io, str_endp);
+        array = parent->u.array_part;
+        for (idx = 0; idx != count; idx++)
+        { size += parts[idx].root->u.array_part->size; }
+        if (json_node_array_grow(array, array->size + size) != 0)
+        { return -1; }
+        for (idx = 0; idx != count; idx++)
+        {
+            array_from = parts[idx].root->u.array_part;
+            if (array_from->size != 0)
+            {
+                memcpy(array->items + array->size, array_from->items, \
+                        sizeof(json_node_t *) * array_from->size);
+            }
+            array->size += array_from->size;
+            array_from->size = 0;
+        }
     }
-    else if (*str_p == '\"')
+    else
     {
-        return json_node_string_load(json_node_out, \
-                str_io, str_endp);
+        object = parent->u.object_part;
+        for (idx = 0; idx != count; idx++)
+        {
+            object_from = parts[idx].root->u.object_part;
+            if (object_from->begin == NULL) continue;
+            if (object->end == NULL) object->begin = object_from->begin;
+            else object->end->next = object_from->begin;
+            object->end = object_from->end;
+            object->size += object_from->size;
+            object_from->begin = NULL;
+            object_from->end = NULL;
+            object_from->size = 0;
+        }
     }
-    else if ((IS_DIGIT(*str_p))||(*str_p == '-'))
+
+    /* The emptied roots go with their arenas, or on their own */
+    for (idx = 0; idx != count; idx++)
     {
-        return json_node_number_load(json_node_out, \
-                str_io, str_endp);
+        if (builder->arena != NULL)
+        {
+            json_arena_merge(builder->arena, parts[idx].arena);
+            parts[idx].arena = NULL;
+        }
+        else
+        {
+            json_node_destroy(parts[idx].root);
+        }
+        parts[idx].root = NULL;
     }
-    else if (IS_ALPHA_LOWCASE(*str_p))
+    return 0;
+}
+
+/* Release whatever a failed or finished build still holds */
+void json_builder_fini(json_builder_t *builder)
+{
+    if (builder->arena == NULL)
     {
-        return json_node_alpha_lowcase_load(json_node_out, \
-                str_io, str_endp);
+        if (builder->root != NULL) json_node_destroy(builder->root);
+        if (builder->key != NULL) json_node_destroy(builder->key);
     }
     else
     {
-        return -1;
+        json_arena_destroy(builder->arena);
     }
+    if (builder->stack != NULL) free(builder->stack);
+    if (builder->keys != NULL) free(builder->keys);
+    builder->arena = NULL;
+    builder->root = NULL;
+    builder->key = NULL;
+    builder->stack = NULL;
+    builder->depth = 0;
+    builder->capacity = 0;
+    builder->keys = NULL;
+    builder->keys_count = 0;
+    builder->keys_capacity = 0;
 }
 
-int json_load(json_t **json_out, char *str, size_t len)
+
+/* Loader
+ *
+ * What a load needs besides the builder: the syntax stack and room for
+ * the builder's stack of open nodes. A loader keeps both between
+ * loads; json_load_ex runs a throwaway one. */
+
+struct json_loader
+{
+    unsigned int flags;
+    json_stack_t stack;
+    json_node_t **nodes;
+    size_t nodes_capacity;
+};
+
+static void json_loader_init(json_loader_t *loader, unsigned int flags, \
+        size_t max_depth)
+{
+    loader->flags = flags;
+    json_stack_init(&loader->stack, max_depth);
+    loader->nodes = NULL;
+    loader->nodes_capacity = 0;
+}
+
+static void json_loader_fini(json_loader_t *loader)
+{
+    json_stack_fini(&loader->stack);
+    if (loader->nodes != NULL) free(loader->nodes);
+    loader->nodes = NULL;
+    loader->nodes_capacity = 0;
+}
+
+json_loader_t *json_loader_new(unsigned int flags, size_t max_depth)
+{
+    json_loader_t *new_loader = NULL;
+
+    if ((new_loader = (json_loader_t *)malloc(sizeof(json_loader_t))) == NULL)
+    { return NULL; }
+    json_loader_init(new_loader, flags, max_depth);
+    return new_loader;
+}
+
+void json_loader_destroy(json_loader_t *loader)
+{
+    json_loader_fini(loader);
+    free(loader);
+}
+
+int json_loader_sax_parse(json_loader_t *loader, char *str, size_t len, \
+        const json_sax_t *sax, void *ctx)
+{
+    if (loader->flags & JSON_LOAD_INDEXED)
+    { return json_index_parse(str, len, sax, ctx, &loader->stack); }
+    return json_sax_parse_in(str, len, sax, ctx, &loader->stack, NULL);
+}
+
+/* With used_out set, only the leading document is loaded, by the
+ * one-pass engine, and its length stored */
+static int json_loader_build(json_loader_t *loader, json_t **json_out, \
+        char *str, size_t len, size_t *used_out)
 {
     int ret = 0;
-    char *str_p = str;
-    char *str_endp = str_p + len;
-    json_node_t *new_json_node_root = NULL;
-    json_t *new_json = NULL;
+    json_builder_t builder;
 
-    if ((ret = json_node_load(&new_json_node_root, \
-                    &str_p, str_endp)) != 0)
-    { goto fail; }
+    if ((ret = json_builder_init(&builder, loader->flags)) != 0)
+    { return ret; }
+    builder.stack = loader->nodes;
+    builder.capacity = loader->nodes_capacity;
 
-    if ((new_json = json_new()) == NULL)
+    if (used_out != NULL)
+    {
+        ret = json_sax_parse_in(str, len, &json_builder_sax, &builder, \
+                &loader->stack, used_out);
+    }
+    else
+    {
+        ret = json_loader_sax_parse(loader, str, len, \
+                &json_builder_sax, &builder);
+    }
+    if (ret != 0)
     { goto fail; }
-    json_set_root(new_json, new_json_node_root);
-    new_json_node_root = NULL;
-
-    *json_out = new_json;
-    new_json = NULL;
+    if ((ret = json_builder_finish(&builder, json_out)) != 0)
+    { goto fail; }
+    if (loader->flags & JSON_LOAD_INSITU)
+    { (*json_out)->borrowed = str; }
 
-    goto done;
 fail:
-done:
-    if (new_json != NULL) json_destroy(new_json);
-    if (new_json_node_root != NULL) json_node_destroy(new_json_node_root);
+    /* Keep the node stack, however far it grew, for the next load */
+    loader->nodes = builder.stack;
+    loader->nodes_capacity = builder.capacity;
+    builder.stack = NULL;
+    json_builder_fini(&builder);
+    return ret;
+}
+
+int json_loader_load(json_loader_t *loader, json_t **json_out, \
+        char *str, size_t len)
+{
+    return json_loader_build(loader, json_out, str, len, NULL);
+}
+
+int json_loader_load_prefix(json_loader_t *loader, json_t **json_out, \
+        char *str, size_t len, size_t *used_out)
+{
+    return json_loader_build(loader, json_out, str, len, used_out);
+}
+
+int json_load_ex(json_t **json_out, char *str, size_t len, \
+        unsigned int flags)
+{
+    int ret = 0;
+    json_loader_t loader;
+
+    json_loader_init(&loader, flags, 0);
+    ret = json_loader_load(&loader, json_out, str, len);
+    json_loader_fini(&loader);
     return ret;
 }
 
+int json_load(json_t **json_out, char *str, size_t len)
+{
+    return json_load_ex(json_out, str, len, JSON_LOAD_DEFAULT);
+}
+
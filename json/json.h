@@ -3,11 +3,16 @@
 #ifndef _JSON_H_
 #define _JSON_H_
 
+#include <stdint.h>
 #include <stdio.h>
 
 struct json_node;
 typedef struct json_node json_node_t;
 
+/* Chunked allocator owning every node of a loaded document */
+struct json_arena;
+typedef struct json_arena json_arena_t;
+
 typedef enum json_node_type
 {
     JSON_NODE_TYPE_UNKNOWN,
@@ -21,16 +26,12 @@ typedef enum json_node_type
     JSON_NODE_TYPE_NULL,
 } json_node_type_t;
 
-typedef struct json_node_array_node
-{
-    json_node_t *node;
-    struct json_node_array_node *next;
-} json_node_array_node_t;
-
 typedef struct json_node_array
 {
-    json_node_array_node_t *begin, *end;
+    json_node_t **items;
     size_t size;
+    size_t capacity;
+    json_arena_t *arena;
 } json_node_array_t;
 
 typedef struct json_node_object_node
@@ -44,13 +45,28 @@ typedef struct json_node_object
 {
     json_node_object_node_t *begin, *end;
     size_t size;
+    json_arena_t *arena;
+    /* Open-addressing key index, built on the first lookup once the
+     * object is big enough; NULL until then */
+    json_node_object_node_t **index;
+    size_t index_capacity;
 } json_node_object_t;
 
+typedef enum json_node_flag
+{
+    /* Node memory belongs to an arena, never free() it */
+    JSON_NODE_FLAG_ARENA = 1 << 0,
+    /* String body points into the loaded input, never free() it */
+    JSON_NODE_FLAG_BORROWED = 1 << 1,
+} json_node_flag_t;
+
 struct json_node
 {
     json_node_type_t type;
+    unsigned int flags;
     union
     {
+        /* Decoded text, which may hold NUL bytes; dumps escape it */
         struct 
         {
             char *str;
@@ -58,7 +74,7 @@ struct json_node
         } string_part;
         union
         {
-            int int_part;
+            int64_t int_part;
             double double_part;
         } number_part;
         json_node_array_t *array_part;
@@ -68,7 +84,7 @@ struct json_node
 
 json_node_t *json_node_new(json_node_type_t type);
 void json_node_destroy(json_node_t *node);
-json_node_t *json_node_new_integer(int value);
+json_node_t *json_node_new_integer(int64_t value);
 json_node_t *json_node_new_double(double value);
 json_node_t *json_node_new_false(void);
 json_node_t *json_node_new_true(void);
@@ -80,18 +96,251 @@ int json_node_as_array_append(json_node_t *node_array, \
         json_node_t *new_element);
 int json_node_as_object_append(json_node_t *node_object, \
         json_node_t *new_name, json_node_t *new_value);
+int json_node_array_reserve(json_node_t *node_array, size_t capacity);
+size_t json_node_array_size(json_node_t *node_array);
+json_node_t *json_node_array_get(json_node_t *node_array, size_t idx);
+/* The first member named key. A lookup into an object of more than 8
+ * members builds its key index when it has none, allocating from the
+ * document arena or the heap: it modifies the object, so lookups from
+ * several threads at once need a lock. A lookup that fails for want of
+ * memory falls back to scanning. */
+json_node_t *json_node_object_get(json_node_t *node_object, \
+        const char *key, size_t len);
+
+
+/* Parse events; any callback may be NULL, a nonzero return stops the
+ * parse. String and key bodies point into the input, escapes intact;
+ * they are checked to be valid UTF-8 with well-formed escapes. */
+typedef struct json_sax
+{
+    int (*on_start_object)(void *ctx);
+    int (*on_end_object)(void *ctx);
+    int (*on_start_array)(void *ctx);
+    int (*on_end_array)(void *ctx);
+    int (*on_key)(void *ctx, char *str, size_t len);
+    int (*on_string)(void *ctx, char *str, size_t len);
+    int (*on_integer)(void *ctx, int64_t value);
+    int (*on_double)(void *ctx, double value);
+    int (*on_bool)(void *ctx, int value);
+    int (*on_null)(void *ctx);
+} json_sax_t;
+
+/* Nesting depth past which a parse fails, unless a loader sets its own */
+#define JSON_DEPTH_DEFAULT ((size_t)1024)
+
+int json_sax_parse(char *str, size_t len, const json_sax_t *sax, void *ctx);
+
+/* Decode the escapes of a string body from the parser into out, which
+ * needs len bytes; surrogate pairs become one UTF-8 character and
+ * \u0000 a NUL byte. Returns the decoded length. out may be str. */
+size_t json_string_unescape(const char *str, size_t len, char *out);
 
 
 typedef struct json
 {
     json_node_t *root;
+    json_arena_t *arena;
+    /* Input buffer the strings of an in-situ load point into; it must
+     * outlive the document and is never freed by it */
+    const char *borrowed;
+    /* File mapping of an in-situ json_load_file, which borrowed points
+     * into; unmapped by json_destroy */
+    void *mapping;
+    size_t mapping_len;
 } json_t;
 
+/* Receives serialized output piece by piece; nonzero aborts the dump */
+typedef int (*json_write_fn_t)(void *ctx, const char *data, size_t len);
+
+typedef enum json_dump_flag
+{
+    JSON_DUMP_DEFAULT = 0,
+    /* Size the output with a length pass before writing it */
+    JSON_DUMP_EXACT = 1 << 0,
+} json_dump_flag_t;
+
+typedef enum json_load_flag
+{
+    JSON_LOAD_DEFAULT = 0,
+    /* One malloc per node instead of the document arena. Arena loads
+     * give members with the same short key one shared name node, which
+     * is thus not to be changed in place. */
+    JSON_LOAD_HEAP = 1 << 0,
+    /* String nodes point into the input instead of copying it; their
+     * bodies are not NUL-terminated. Strings with escapes are still
+     * decoded into a copy. Ignored by the push parser. */
+    JSON_LOAD_INSITU = 1 << 1,
+    /* Two-stage parse: a vectorized pass indexes the structural
+     * characters, a second pass builds the tree from that index. Same
+     * tree, same accepted input. Ignored by the push parser. */
+    JSON_LOAD_INDEXED = 1 << 2,
+} json_load_flag_t;
+
 json_t *json_new(void);
 void json_destroy(json_t *json);
 void json_set_root(json_t *json, json_node_t *node);
 int json_dump(json_t *json, char **str_out, size_t *len_out);
+int json_dump_ex(json_t *json, char **str_out, size_t *len_out, \
+        unsigned int flags, size_t size_hint);
+int json_dump_buffer(json_t *json, char *buf, size_t size, size_t *len_out);
+int json_dump_cb(json_t *json, json_write_fn_t write, void *ctx);
+int json_dump_file(json_t *json, FILE *fp);
+/* json_dump on up to nthreads threads (0: one per CPU): big arrays and
+ * objects are cut into runs of members serialized side by side, then
+ * joined. The output is the same as json_dump's; small documents are
+ * dumped by it. */
+int json_dump_parallel(json_t *json, char **str_out, size_t *len_out, \
+        size_t nthreads);
 int json_load(json_t **json_out, char *str, size_t len);
+int json_load_ex(json_t **json_out, char *str, size_t len, \
+        unsigned int flags);
+/* json_load_ex on the file at path, parsed straight from a read-only
+ * mapping of it. With JSON_LOAD_INSITU the document keeps the mapping
+ * for its strings to point into, until json_destroy. */
+int json_load_file(json_t **json_out, const char *path, unsigned int flags);
+
+/* Binary form: typed values with their sizes up front, numbers in
+ * their native bits, little-endian. json_load_binary reads it back
+ * with no tokenizing, unescaping or number conversion, honouring the
+ * HEAP and INSITU load flags; the tree is the same one that was
+ * dumped, so its text dump is too. The buffer from json_dump_binary is
+ * malloc'd. */
+int json_dump_binary(json_t *json, char **buf_out, size_t *len_out);
+int json_load_binary(json_t **json_out, char *buf, size_t len, \
+        unsigned int flags);
+
+/* Loader: json_load_ex with its own nesting limit (0 for the default)
+ * and parse stacks kept from one load to the next. No parser recurses
+ * per nesting level; dumping and destroying a heap-loaded tree do, so
+ * the limit bounds their C stack use too. */
+struct json_loader;
+typedef struct json_loader json_loader_t;
+
+json_loader_t *json_loader_new(unsigned int flags, size_t max_depth);
+void json_loader_destroy(json_loader_t *loader);
+int json_loader_load(json_loader_t *loader, json_t **json_out, \
+        char *str, size_t len);
+int json_loader_sax_parse(json_loader_t *loader, char *str, size_t len, \
+        const json_sax_t *sax, void *ctx);
+
+/* Batch loader: whitespace-separated documents, one per line in
+ * NDJSON, loaded on up to nthreads threads (0: one per CPU) and passed
+ * to fn in input order with their index. fn owns each document it is
+ * given; a nonzero return stops the load. JSON_LOAD_INDEXED is
+ * ignored. Documents go out as they are loaded, window by window on
+ * several threads and one by one on one, so a failure can come after
+ * some were delivered. */
+typedef int (*json_doc_fn_t)(void *ctx, size_t idx, json_t *json);
+
+int json_load_many(char *str, size_t len, unsigned int flags, \
+        size_t nthreads, json_doc_fn_t fn, void *ctx);
+
+/* json_load_ex for a document whose root is a big array or object:
+ * its members are loaded in slices on up to nthreads threads (0: one
+ * per CPU) and joined in order, giving the same tree. Other documents,
+ * small ones and a single thread load as json_load_ex would.
+ * JSON_LOAD_INDEXED is ignored. */
+int json_load_parallel(json_t **json_out, char *str, size_t len, \
+        unsigned int flags, size_t nthreads);
+
+/* Cursor: reads values straight from the input, without loading it.
+ * The cursor stands at one value at a time, the root at first. enter
+ * steps into the array or object it stands at, onto the first member;
+ * next steps to the member after the current one, skipping whatever is
+ * left of it; find steps onward, in the object the cursor is in, to the
+ * member named key, the current one included. Those three return 1
+ * when there is no such member, the cursor then being past the
+ * container, among its siblings; leave takes it there straight away.
+ * The get calls read the scalar the cursor stands at, decoded as a
+ * load would, and step past it; load builds a tree of the value, with
+ * flags as for json_load_ex. Strings and keys without escapes point
+ * into the input, unterminated; others are decoded into a buffer kept
+ * until the next string or key of the same kind. Skipped containers
+ * are only checked for balanced brackets and what follows the root is
+ * not looked at. After an error, -1, only json_cursor_destroy is
+ * safe. */
+struct json_cursor;
+typedef struct json_cursor json_cursor_t;
+
+json_cursor_t *json_cursor_new(char *str, size_t len, unsigned int flags);
+void json_cursor_destroy(json_cursor_t *cursor);
+/* JSON_NODE_TYPE_UNKNOWN when the cursor is past its value */
+json_node_type_t json_cursor_type(json_cursor_t *cursor);
+int json_cursor_enter(json_cursor_t *cursor);
+int json_cursor_next(json_cursor_t *cursor);
+int json_cursor_find(json_cursor_t *cursor, const char *key, size_t len);
+int json_cursor_leave(json_cursor_t *cursor);
+int json_cursor_key(json_cursor_t *cursor, const char **key_out, \
+        size_t *len_out);
+int json_cursor_get_string(json_cursor_t *cursor, const char **str_out, \
+        size_t *len_out);
+/* Fails on a number with a fraction, an exponent or out of range */
+int json_cursor_get_integer(json_cursor_t *cursor, int64_t *value_out);
+int json_cursor_get_double(json_cursor_t *cursor, double *value_out);
+int json_cursor_get_bool(json_cursor_t *cursor, int *value_out);
+int json_cursor_get_null(json_cursor_t *cursor);
+int json_cursor_load(json_cursor_t *cursor, json_t **json_out);
+
+/* JSON Pointer (RFC 6901): "" for the root, "/a/b/3" for the member 3
+ * of the member b of the member a, ~1 and ~0 escaping / and ~ in keys.
+ * Compiling decodes and hashes the tokens up front, so getting does not
+ * parse, allocate or build key indexes; it only reads the document, and
+ * gets may run side by side as long as nothing changes it. Compiling
+ * returns NULL for a malformed pointer; getting returns NULL when there
+ * is no such value. */
+struct json_pointer;
+typedef struct json_pointer json_pointer_t;
+
+json_pointer_t *json_pointer_compile(const char *str, size_t len);
+void json_pointer_destroy(json_pointer_t *pointer);
+json_node_t *json_pointer_get(json_t *json, const json_pointer_t *pointer);
+
+/* Tape: a document flattened into one relocatable buffer, offsets in
+ * place of pointers and its strings in a pool, to be saved to a file
+ * and read where it lies, mapped by any number of processes. Values
+ * are numbered, JSON_TAPE_ROOT being the root; lookups return
+ * JSON_TAPE_NONE when there is no such value. json_tape_dump writes a
+ * malloc'd tape; json_tape_new reads one in memory, 8-byte aligned and
+ * kept for the tape's lifetime, json_tape_new_file maps one from disk.
+ * A tape is only read on the kind of machine that wrote it. Strings
+ * are NUL-terminated and read-only. load builds a tree, with flags as
+ * for json_load_ex; an in-situ one borrows the tape's strings. */
+#define JSON_TAPE_ROOT ((size_t)0)
+#define JSON_TAPE_NONE ((size_t)-1)
+
+struct json_tape;
+typedef struct json_tape json_tape_t;
+
+int json_tape_dump(json_t *json, char **buf_out, size_t *len_out);
+json_tape_t *json_tape_new(const char *buf, size_t len);
+json_tape_t *json_tape_new_file(const char *path);
+void json_tape_destroy(json_tape_t *tape);
+/* JSON_NODE_TYPE_UNKNOWN for no value */
+json_node_type_t json_tape_type(const json_tape_t *tape, size_t value);
+/* Members of an array or object, 0 for anything else */
+size_t json_tape_size(const json_tape_t *tape, size_t value);
+size_t json_tape_array_get(const json_tape_t *tape, size_t value, size_t idx);
+size_t json_tape_object_get(const json_tape_t *tape, size_t value, \
+        const char *key, size_t len);
+/* Member idx of an object in order, its key in *key_out */
+size_t json_tape_object_member(const json_tape_t *tape, size_t value, \
+        size_t idx, const char **key_out, size_t *len_out);
+int json_tape_get_string(const json_tape_t *tape, size_t value, \
+        const char **str_out, size_t *len_out);
+int json_tape_get_integer(const json_tape_t *tape, size_t value, \
+        int64_t *value_out);
+int json_tape_get_double(const json_tape_t *tape, size_t value, \
+        double *value_out);
+int json_tape_load(json_tape_t *tape, json_t **json_out, unsigned int flags);
+
+/* Push parser: feed a document in chunks of any size, then finish */
+struct json_parser;
+typedef struct json_parser json_parser_t;
+
+json_parser_t *json_parser_new(unsigned int flags);
+void json_parser_destroy(json_parser_t *parser);
+int json_parser_feed(json_parser_t *parser, char *chunk, size_t len);
+int json_parser_finish(json_parser_t *parser, json_t **json_out);
 
 
 #endif
@@ -0,0 +1,410 @@
+/* JSON Library - binary format */
+
+/* json_dump_binary writes a tree in a compact binary form that
+ * json_load_binary reads back without tokenizing, unescaping or
+ * converting numbers: a reload is a walk over sizes given up front and
+ * a copy of the string bytes.
+ *
+ * The form is the magic "JSNB", a version byte, then the root value.
+ * A value is a tag byte followed by its payload:
+ *
+ *   0 null, 1 false, 2 true      nothing
+ *   3 integer                    8 bytes, two's complement
+ *   4 double                     8 bytes, IEEE 754 binary64
+ *   5 string                     length, then the decoded bytes
+ *   6 array                      item count, then the items
+ *   7 object                     member count, then per member the key
+ *                                length, its bytes and the value
+ *
+ * Multi-byte numbers are little-endian; lengths and counts are
+ * unsigned LEB128. Numbers keep their bits, so text dumped from a
+ * reloaded tree is the same as from the original.
+ *
+ * Loading checks every size against the bytes left and fails on
+ * anything malformed, but takes string bytes as they are: the input
+ * is meant to be a file this library wrote. */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "json_internal.h"
+
+#define JSON_BINARY_MAGIC "JSNB"
+#define JSON_BINARY_MAGIC_LEN ((size_t)4)
+#define JSON_BINARY_VERSION 1
+/* Longest LEB128 encoding of a 64 bit value */
+#define JSON_BINARY_VARINT_MAX ((size_t)10)
+#define JSON_BINARY_STACK_MIN ((size_t)16)
+
+typedef enum json_binary_tag
+{
+    JSON_BINARY_TAG_NULL = 0,
+    JSON_BINARY_TAG_FALSE = 1,
+    JSON_BINARY_TAG_TRUE = 2,
+    JSON_BINARY_TAG_INTEGER = 3,
+    JSON_BINARY_TAG_DOUBLE = 4,
+    JSON_BINARY_TAG_STRING = 5,
+    JSON_BINARY_TAG_ARRAY = 6,
+    JSON_BINARY_TAG_OBJECT = 7,
+} json_binary_tag_t;
+
+
+/* Dump
+ *
+ * A first walk adds up the exact size, a second fills a buffer of
+ * that size. */
+
+static size_t json_binary_varint_length(size_t value)
+{
+    size_t len = 1;
+
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        len++;
+    }
+    return len;
+}
+
+static char *json_binary_put_varint(char *out_p, size_t value)
+{
+    while (value >= 0x80)
+    {
+        *out_p++ = (char)((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    *out_p++ = (char)value;
+    return out_p;
+}
+
+static char *json_binary_put_u64(char *out_p, uint64_t value)
+{
+    size_t idx;
+
+    for (idx = 0; idx != 8; idx++)
+    {
+        *out_p++ = (char)(value & 0xff);
+        value >>= 8;
+    }
+    return out_p;
+}
+
+static int json_binary_length(json_node_t *node, size_t *len_io)
+{
+    json_node_object_node_t *member;
+    json_node_t *name;
+    size_t idx;
+
+    switch (node->type)
+    {
+        case JSON_NODE_TYPE_NULL:
+        case JSON_NODE_TYPE_FALSE:
+        case JSON_NODE_TYPE_TRUE:
+            *len_io += 1;
+            return 0;
+        case JSON_NODE_TYPE_INTEGER:
+        case JSON_NODE_TYPE_DOUBLE:
+            *len_io += 9;
+            return 0;
+        case JSON_NODE_TYPE_STRING:
+            *len_io += 1 + json_binary_varint_length(node->u.string_part.len) + \
+                       node->u.string_part.len;
+            return 0;
+        case JSON_NODE_TYPE_ARRAY:
+            *len_io += 1 + json_binary_varint_length(node->u.array_part->size);
+            for (idx = 0; idx != node->u.array_part->size; idx++)
+            {
+                if (json_binary_length(node->u.array_part->items[idx], \
+                            len_io) != 0)
+                { return -1; }
+            }
+            return 0;
+        case JSON_NODE_TYPE_OBJECT:
+            *len_io += 1 + json_binary_varint_length(node->u.object_part->size);
+            for (member = node->u.object_part->begin; member != NULL; \
+                    member = member->next)
+            {
+                name = member->name;
+                if (name->type != JSON_NODE_TYPE_STRING) return -1;
+                *len_io += json_binary_varint_length(name->u.string_part.len) + \
+                           name->u.string_part.len;
+                if (json_binary_length(member->value, len_io) != 0)
+                { return -1; }
+            }
+            return 0;
+        case JSON_NODE_TYPE_UNKNOWN:
+            break;
+    }
+    /* An unknown node has no text form to round-trip with */
+    return -1;
+}
+
+static char *json_binary_put(json_node_t *node, char *out_p)
+{
+    json_node_object_node_t *member;
+    uint64_t bits;
+    size_t idx;
+
+    switch (node->type)
+    {
+        case JSON_NODE_TYPE_NULL:
+            *out_p++ = (char)JSON_BINARY_TAG_NULL;
+            break;
+        case JSON_NODE_TYPE_FALSE:
+            *out_p++ = (char)JSON_BINARY_TAG_FALSE;
+            break;
+        case JSON_NODE_TYPE_TRUE:
+            *out_p++ = (char)JSON_BINARY_TAG_TRUE;
+            break;
+        case JSON_NODE_TYPE_INTEGER:
+            *out_p++ = (char)JSON_BINARY_TAG_INTEGER;
+            out_p = json_binary_put_u64(out_p, \
+                    (uint64_t)node->u.number_part.int_part);
+            break;
+        case JSON_NODE_TYPE_DOUBLE:
+            *out_p++ = (char)JSON_BINARY_TAG_DOUBLE;
+            memcpy(&bits, &node->u.number_part.double_part, sizeof(bits));
+            out_p = json_binary_put_u64(out_p, bits);
+            break;
+        case JSON_NODE_TYPE_STRING:
+            *out_p++ = (char)JSON_BINARY_TAG_STRING;
+            out_p = json_binary_put_varint(out_p, node->u.string_part.len);
+            memcpy(out_p, node->u.string_part.str, node->u.string_part.len);
+            out_p += node->u.string_part.len;
+            break;
+        case JSON_NODE_TYPE_ARRAY:
+            *out_p++ = (char)JSON_BINARY_TAG_ARRAY;
+            out_p = json_binary_put_varint(out_p, node->u.array_part->size);
+            for (idx = 0; idx != node->u.array_part->size; idx++)
+            { out_p = json_binary_put(node->u.array_part->items[idx], out_p); }
+            break;
+        case JSON_NODE_TYPE_OBJECT:
+            *out_p++ = (char)JSON_BINARY_TAG_OBJECT;
+            out_p = json_binary_put_varint(out_p, node->u.object_part->size);
+            for (member = node->u.object_part->begin; member != NULL; \
+                    member = member->next)
+            {
+                out_p = json_binary_put_varint(out_p, \
+                        member->name->u.string_part.len);
+                memcpy(out_p, member->name->u.string_part.str, \
+                        member->name->u.string_part.len);
+                out_p += member->name->u.string_part.len;
+                out_p = json_binary_put(member->value, out_p);
+            }
+            break;
+        case JSON_NODE_TYPE_UNKNOWN:
+            break;
+    }
+    return out_p;
+}
+
+int json_dump_binary(json_t *json, char **buf_out, size_t *len_out)
+{
+    size_t len = JSON_BINARY_MAGIC_LEN + 1;
+    char *buf, *out_p;
+
+    if (json_binary_length(json->root, &len) != 0) return -1;
+    if ((buf = (char *)malloc(len)) == NULL) return -1;
+
+    memcpy(buf, JSON_BINARY_MAGIC, JSON_BINARY_MAGIC_LEN);
+    buf[JSON_BINARY_MAGIC_LEN] = (char)JSON_BINARY_VERSION;
+    out_p = json_binary_put(json->root, buf + JSON_BINARY_MAGIC_LEN + 1);
+
+    *buf_out = buf;
+    *len_out = (size_t)(out_p - buf);
+    return 0;
+}
+
+
+/* Load
+ *
+ * No container has an end marker, so the loader keeps for each open
+ * one how many members it still expects, and closes it on the last. */
+
+typedef struct json_binary_loader
+{
+    char *str_p;
+    char *str_endp;
+    json_builder_t builder;
+    size_t *left;
+    size_t capacity;
+} json_binary_loader_t;
+
+static int json_binary_get_varint(json_binary_loader_t *loader, \
+        size_t *value_out)
+{
+    uint64_t value = 0;
+    unsigned int shift;
+    unsigned char byte;
+
+    for (shift = 0; shift < 7 * JSON_BINARY_VARINT_MAX; shift += 7)
+    {
+        if (loader->str_p == loader->str_endp) return -1;
+        byte = (unsigned char)*loader->str_p++;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            *value_out = (size_t)value;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int json_binary_get_u64(json_binary_loader_t *loader, \
+        uint64_t *value_out)
+{
+    const unsigned char *str_p = (const unsigned char *)loader->str_p;
+    uint64_t value = 0;
+    size_t idx;
+
+    if (loader->str_endp - loader->str_p < 8) return -1;
+    for (idx = 8; idx != 0; idx--)
+    { value = (value << 8) | str_p[idx - 1]; }
+    loader->str_p += 8;
+    *value_out = value;
+    return 0;
+}
+
+/* A length, then that many bytes, handed to the builder */
+static int json_binary_get_string(json_binary_loader_t *loader, int key)
+{
+    char *str_p;
+    size_t len;
+
+    if (json_binary_get_varint(loader, &len) != 0) return -1;
+    if ((size_t)(loader->str_endp - loader->str_p) < len) return -1;
+    str_p = loader->str_p;
+    loader->str_p += len;
+    return json_builder_string(&loader->builder, str_p, len, key);
+}
+
+/* Open a container of count members; every member takes a byte at
+ * least, which bounds count before anything is reserved */
+static int json_binary_open(json_binary_loader_t *loader, \
+        json_binary_tag_t tag, size_t count)
+{
+    json_builder_t *builder = &loader->builder;
+    size_t *new_left, capacity;
+
+    if (count > (size_t)(loader->str_endp - loader->str_p)) return -1;
+    if (tag == JSON_BINARY_TAG_ARRAY)
+    {
+        if (json_builder_sax.on_start_array(builder) != 0) return -1;
+        if ((count != 0) && (json_node_array_reserve( \
+                        builder->stack[builder->depth - 1], count) != 0))
+        { return -1; }
+    }
+    else if (json_builder_sax.on_start_object(builder) != 0)
+    {
+        return -1;
+    }
+    if (count == 0) return json_builder_sax.on_end_array(builder);
+
+    if (builder->depth > JSON_DEPTH_DEFAULT) return -1;
+    if (builder->depth > loader->capacity)
+    {
+        capacity = loader->capacity * 2;
+        if (capacity < JSON_BINARY_STACK_MIN) capacity = JSON_BINARY_STACK_MIN;
+        if ((new_left = (size_t *)realloc(loader->left, \
+                        sizeof(size_t) * capacity)) == NULL)
+        { return -1; }
+        loader->left = new_left;
+        loader->capacity = capacity;
+    }
+    loader->left[builder->depth - 1] = count;
+    return 0;
+}
+
+static int json_binary_load_value(json_binary_loader_t *loader)
+{
+    json_builder_t *builder = &loader->builder;
+    json_binary_tag_t tag;
+    uint64_t bits;
+    int64_t int_value;
+    double double_value;
+    size_t count;
+
+    if (loader->str_p == loader->str_endp) return -1;
+    tag = (json_binary_tag_t)(unsigned char)*loader->str_p++;
+    switch (tag)
+    {
+        case JSON_BINARY_TAG_NULL:
+            return json_builder_sax.on_null(builder);
+        case JSON_BINARY_TAG_FALSE:
+        case JSON_BINARY_TAG_TRUE:
+            return json_builder_sax.on_bool(builder, \
+                    tag == JSON_BINARY_TAG_TRUE);
+        case JSON_BINARY_TAG_INTEGER:
+            if (json_binary_get_u64(loader, &bits) != 0) return -1;
+            memcpy(&int_value, &bits, sizeof(int_value));
+            return json_builder_sax.on_integer(builder, int_value);
+        case JSON_BINARY_TAG_DOUBLE:
+            if (json_binary_get_u64(loader, &bits) != 0) return -1;
+            memcpy(&double_value, &bits, sizeof(double_value));
+            return json_builder_sax.on_double(builder, double_value);
+        case JSON_BINARY_TAG_STRING:
+            return json_binary_get_string(loader, 0);
+        case JSON_BINARY_TAG_ARRAY:
+        case JSON_BINARY_TAG_OBJECT:
+            if (json_binary_get_varint(loader, &count) != 0) return -1;
+            return json_binary_open(loader, tag, count);
+    }
+    return -1;
+}
+
+int json_load_binary(json_t **json_out, char *buf, size_t len, \
+        unsigned int flags)
+{
+    int ret = 0;
+    json_binary_loader_t loader;
+    json_builder_t *builder = &loader.builder;
+    size_t depth;
+
+    loader.left = NULL;
+    loader.capacity = 0;
+    if ((ret = json_builder_init(builder, flags)) != 0)
+    { return ret; }
+    if ((len <= JSON_BINARY_MAGIC_LEN) || \
+            (memcmp(buf, JSON_BINARY_MAGIC, JSON_BINARY_MAGIC_LEN) != 0) || \
+            (buf[JSON_BINARY_MAGIC_LEN] != (char)JSON_BINARY_VERSION))
+    { ret = -1; goto fail; }
+    loader.str_p = buf + JSON_BINARY_MAGIC_LEN + 1;
+    loader.str_endp = buf + len;
+
+    do
+    {
+        depth = builder->depth;
+        if ((depth != 0) && \
+                (builder->stack[depth - 1]->type == JSON_NODE_TYPE_OBJECT))
+        {
+            if ((ret = json_binary_get_string(&loader, 1)) != 0)
+            { goto fail; }
+        }
+        if ((ret = json_binary_load_value(&loader)) != 0)
+        { goto fail; }
+        /* A container just opened waits for its members */
+        if (builder->depth > depth) continue;
+
+        while ((builder->depth != 0) && \
+                (--loader.left[builder->depth - 1] == 0))
+        {
+            if ((ret = json_builder_sax.on_end_array(builder)) != 0)
+            { goto fail; }
+        }
+    } while (builder->depth != 0);
+
+    if (loader.str_p != loader.str_endp)
+    { ret = -1; goto fail; }
+    if ((ret = json_builder_finish(builder, json_out)) != 0)
+    { goto fail; }
+    if (flags & JSON_LOAD_INSITU)
+    { (*json_out)->borrowed = buf; }
+
+fail:
+    if (loader.left != NULL) free(loader.left);
+    json_builder_fini(builder);
+    return ret;
+}
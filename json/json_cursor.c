@@ -0,0 +1,423 @@
+/* JSON Library - cursor */
+
+/* A cursor reads a document straight from the input, one value at a
+ * time, without building a tree. It keeps only where it stands, the
+ * containers it is in and the key of the current member.
+ *
+ * Values read go through the scalar decoders the loaders use, so they
+ * come out exactly as in a loaded tree. Values stepped over are not
+ * decoded: scalars are scanned, containers are skipped a 64 byte block
+ * at a time with the classifier of the two-stage parser, which only
+ * tracks strings and brackets. Skipped containers are therefore only
+ * checked for balanced brackets. */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "json_internal.h"
+
+#define JSON_CURSOR_BLOCK ((size_t)64)
+
+struct json_cursor
+{
+    char *str_p;
+    char *str_endp;
+    /* Containers entered, '[' or '{' each */
+    json_stack_t stack;
+    /* Whether str_p is at the current value, or past it */
+    int at_value;
+    /* Body of the current member's key, escapes and all */
+    char *key;
+    size_t key_len;
+    /* Decoded keys and strings that had escapes */
+    char *key_buf;
+    size_t key_capacity;
+    char *string_buf;
+    size_t string_capacity;
+    unsigned int flags;
+    json_loader_t *loader;
+};
+
+json_cursor_t *json_cursor_new(char *str, size_t len, unsigned int flags)
+{
+    json_cursor_t *cursor = (json_cursor_t *)malloc(sizeof(json_cursor_t));
+
+    if (cursor == NULL) return NULL;
+    cursor->str_p = str;
+    cursor->str_endp = str + len;
+    json_stack_init(&cursor->stack, 0);
+    cursor->key = NULL;
+    cursor->key_len = 0;
+    cursor->key_buf = NULL;
+    cursor->key_capacity = 0;
+    cursor->string_buf = NULL;
+    cursor->string_capacity = 0;
+    cursor->flags = flags;
+    cursor->loader = NULL;
+
+    JSON_SKIP_WHITESPACE(cursor->str_p, cursor->str_endp);
+    cursor->at_value = (cursor->str_p != cursor->str_endp);
+    return cursor;
+}
+
+void json_cursor_destroy(json_cursor_t *cursor)
+{
+    json_stack_fini(&cursor->stack);
+    if (cursor->key_buf != NULL) free(cursor->key_buf);
+    if (cursor->string_buf != NULL) free(cursor->string_buf);
+    if (cursor->loader != NULL) json_loader_destroy(cursor->loader);
+    free(cursor);
+}
+
+/* Decode a string body into *buf_io when it has escapes */
+static int json_cursor_decode(char *str, size_t len, char **buf_io, \
+        size_t *capacity_io, const char **str_out, size_t *len_out)
+{
+    char *new_buf;
+
+    if (memchr(str, '\\', len) == NULL)
+    {
+        *str_out = str;
+        *len_out = len;
+        return 0;
+    }
+    if (len > *capacity_io)
+    {
+        if ((new_buf = (char *)realloc(*buf_io, len)) == NULL) return -1;
+        *buf_io = new_buf;
+        *capacity_io = len;
+    }
+    *len_out = json_string_unescape(str, len, *buf_io);
+    *str_out = *buf_io;
+    return 0;
+}
+
+/* Up to the closing bracket of the container depth levels out from
+ * str_p, 0 for the one opening at str_p; strings are only told apart
+ * by their quotes */
+static int json_cursor_skip_container(json_cursor_t *cursor, long depth)
+{
+    char tail[JSON_CURSOR_BLOCK];
+    const char *block;
+    json_simd_masks_t masks;
+    uint64_t escape_carry = 0, string_carry = 0;
+    uint64_t valid, escaped, quote, in_string, bits;
+    char *str_p = cursor->str_p;
+    size_t len;
+    int bit;
+    char ch;
+
+    while (str_p < cursor->str_endp)
+    {
+        len = (size_t)(cursor->str_endp - str_p);
+        block = str_p;
+        valid = ~(uint64_t)0;
+        if (len < JSON_CURSOR_BLOCK)
+        {
+            memset(tail, ' ', JSON_CURSOR_BLOCK);
+            memcpy(tail, str_p, len);
+            block = tail;
+            valid = ((uint64_t)1 << len) - 1;
+        }
+        json_simd_classify(block, &masks);
+        escaped = 0;
+        if ((masks.backslash | escape_carry) != 0)
+        { escaped = json_index_escaped(masks.backslash, &escape_carry); }
+        quote = masks.quote & ~escaped & valid;
+        in_string = json_index_prefix_xor(quote) ^ string_carry;
+        string_carry = (uint64_t)0 - (in_string >> 63);
+
+        bits = masks.structural & ~in_string & valid;
+        while (bits != 0)
+        {
+            bit = __builtin_ctzll(bits);
+            bits &= bits - 1;
+            ch = block[bit];
+            if ((ch == '[') || (ch == '{'))
+            {
+                depth++;
+            }
+            else if (((ch == ']') || (ch == '}')) && (--depth == 0))
+            {
+                cursor->str_p = str_p + bit + 1;
+                return 0;
+            }
+        }
+        str_p += JSON_CURSOR_BLOCK;
+    }
+    return -1;
+}
+
+/* Step over the value at str_p */
+static int json_cursor_skip(json_cursor_t *cursor)
+{
+    json_number_t number;
+    json_node_type_t type;
+    char *str;
+    size_t len;
+    char ch = *cursor->str_p;
+
+    if ((ch == '[') || (ch == '{'))
+    { return json_cursor_skip_container(cursor, 0); }
+    if (ch == '\"')
+    { return json_string_scan(&cursor->str_p, cursor->str_endp, &str, &len); }
+    if ((IS_DIGIT(ch)) || (ch == '-'))
+    { return json_number_scan(&cursor->str_p, cursor->str_endp, &number); }
+    if (IS_ALPHA_LOWCASE(ch))
+    { return json_literal_scan(&cursor->str_p, cursor->str_endp, &type); }
+    return -1;
+}
+
+/* The key of the member starting at str_p, then its colon */
+static int json_cursor_member(json_cursor_t *cursor)
+{
+    if ((cursor->str_p == cursor->str_endp) || (*cursor->str_p != '\"'))
+    { return -1; }
+    if (json_string_scan(&cursor->str_p, cursor->str_endp, \
+                &cursor->key, &cursor->key_len) != 0)
+    { return -1; }
+    JSON_SKIP_WHITESPACE(cursor->str_p, cursor->str_endp);
+    if ((cursor->str_p == cursor->str_endp) || (*cursor->str_p != ':'))
+    { return -1; }
+    cursor->str_p++;
+    JSON_SKIP_WHITESPACE(cursor->str_p, cursor->str_endp);
+    if (cursor->str_p == cursor->str_endp) return -1;
+    cursor->at_value = 1;
+    return 0;
+}
+
+/* Leave the innermost container when its closing bracket is at str_p */
+static int json_cursor_close(json_cursor_t *cursor)
+{
+    char open = cursor->stack.items[cursor->stack.depth - 1];
+
+    if (*cursor->str_p != ((open == '[') ? ']' : '}')) return 0;
+    cursor->str_p++;
+    cursor->stack.depth--;
+    cursor->at_value = 0;
+    cursor->key = NULL;
+    cursor->key_len = 0;
+    return 1;
+}
+
+json_node_type_t json_cursor_type(json_cursor_t *cursor)
+{
+    char *str_p = cursor->str_p;
+    json_number_t number;
+    char ch;
+
+    if (!cursor->at_value) return JSON_NODE_TYPE_UNKNOWN;
+    ch = *str_p;
+    switch (ch)
+    {
+        case '{': return JSON_NODE_TYPE_OBJECT;
+        case '[': return JSON_NODE_TYPE_ARRAY;
+        case '\"': return JSON_NODE_TYPE_STRING;
+        case 't': return JSON_NODE_TYPE_TRUE;
+        case 'f': return JSON_NODE_TYPE_FALSE;
+        case 'n': return JSON_NODE_TYPE_NULL;
+        default: break;
+    }
+    if (((IS_DIGIT(ch)) || (ch == '-')) && \
+            (json_number_scan(&str_p, cursor->str_endp, &number) == 0))
+    { return number.type; }
+    return JSON_NODE_TYPE_UNKNOWN;
+}
+
+int json_cursor_enter(json_cursor_t *cursor)
+{
+    char open;
+
+    if (!cursor->at_value) return -1;
+    open = *cursor->str_p;
+    if ((open != '[') && (open != '{')) return -1;
+    if (json_stack_push(&cursor->stack, open) != 0) return -1;
+    cursor->str_p++;
+    cursor->key = NULL;
+    cursor->key_len = 0;
+
+    JSON_SKIP_WHITESPACE(cursor->str_p, cursor->str_endp);
+    if (cursor->str_p == cursor->str_endp) return -1;
+    if (json_cursor_close(cursor)) return 1;
+    if (open == '{') return json_cursor_member(cursor);
+    cursor->at_value = 1;
+    return 0;
+}
+
+int json_cursor_next(json_cursor_t *cursor)
+{
+    if (cursor->at_value)
+    {
+        if (json_cursor_skip(cursor) != 0) return -1;
+        cursor->at_value = 0;
+    }
+    /* Nothing follows the root */
+    if (cursor->stack.depth == 0) return 1;
+
+    JSON_SKIP_WHITESPACE(cursor->str_p, cursor->str_endp);
+    if (cursor->str_p == cursor->str_endp) return -1;
+    if (json_cursor_close(cursor)) return 1;
+    if (*cursor->str_p != ',') return -1;
+    cursor->str_p++;
+    JSON_SKIP_WHITESPACE(cursor->str_p, cursor->str_endp);
+    if (cursor->str_p == cursor->str_endp) return -1;
+    if (cursor->stack.items[cursor->stack.depth - 1] == '{')
+    { return json_cursor_member(cursor); }
+    cursor->at_value = 1;
+    return 0;
+}
+
+int json_cursor_leave(json_cursor_t *cursor)
+{
+    if (cursor->stack.depth == 0) return -1;
+    if (json_cursor_skip_container(cursor, 1) != 0) return -1;
+    cursor->stack.depth--;
+    cursor->at_value = 0;
+    cursor->key = NULL;
+    cursor->key_len = 0;
+    return 0;
+}
+
+int json_cursor_key(json_cursor_t *cursor, const char **key_out, \
+        size_t *len_out)
+{
+    if (cursor->key == NULL) return -1;
+    return json_cursor_decode(cursor->key, cursor->key_len, \
+            &cursor->key_buf, &cursor->key_capacity, key_out, len_out);
+}
+
+int json_cursor_find(json_cursor_t *cursor, const char *key, size_t len)
+{
+    int ret;
+    const char *member_key;
+    size_t member_len;
+
+    if ((cursor->stack.depth == 0) || \
+            (cursor->stack.items[cursor->stack.depth - 1] != '{'))
+    { return -1; }
+
+    for (;;)
+    {
+        if (cursor->at_value)
+        {
+            if (json_cursor_key(cursor, &member_key, &member_len) != 0)
+            { return -1; }
+            if ((member_len == len) && (memcmp(member_key, key, len) == 0))
+            { return 0; }
+        }
+        if ((ret = json_cursor_next(cursor)) != 0) return ret;
+    }
+}
+
+int json_cursor_get_string(json_cursor_t *cursor, const char **str_out, \
+        size_t *len_out)
+{
+    char *str_p = cursor->str_p;
+    char *str;
+    size_t len;
+
+    if ((!cursor->at_value) || (*str_p != '\"')) return -1;
+    if (json_string_scan(&str_p, cursor->str_endp, &str, &len) != 0)
+    { return -1; }
+    if (json_cursor_decode(str, len, &cursor->string_buf, \
+                &cursor->string_capacity, str_out, len_out) != 0)
+    { return -1; }
+    cursor->str_p = str_p;
+    cursor->at_value = 0;
+    return 0;
+}
+
+/* The number at the cursor, which it only moves past when the caller
+ * takes it */
+static int json_cursor_number(json_cursor_t *cursor, json_number_t *number, \
+        char **str_out)
+{
+    char ch;
+
+    *str_out = cursor->str_p;
+    if (!cursor->at_value) return -1;
+    ch = *cursor->str_p;
+    if ((!IS_DIGIT(ch)) && (ch != '-')) return -1;
+    return json_number_scan(str_out, cursor->str_endp, number);
+}
+
+int json_cursor_get_integer(json_cursor_t *cursor, int64_t *value_out)
+{
+    json_number_t number;
+    char *str_p;
+
+    if (json_cursor_number(cursor, &number, &str_p) != 0) return -1;
+    if (number.type != JSON_NODE_TYPE_INTEGER) return -1;
+    *value_out = number.int_value;
+    cursor->str_p = str_p;
+    cursor->at_value = 0;
+    return 0;
+}
+
+int json_cursor_get_double(json_cursor_t *cursor, double *value_out)
+{
+    json_number_t number;
+    char *str_p;
+
+    if (json_cursor_number(cursor, &number, &str_p) != 0) return -1;
+    if (number.type == JSON_NODE_TYPE_INTEGER)
+    { *value_out = (double)number.int_value; }
+    else
+    { *value_out = number.double_value; }
+    cursor->str_p = str_p;
+    cursor->at_value = 0;
+    return 0;
+}
+
+/* true, false or null at the cursor, moved past when it is of type */
+static int json_cursor_literal(json_cursor_t *cursor, json_node_type_t type)
+{
+    char *str_p = cursor->str_p;
+    json_node_type_t literal_type;
+
+    if ((!cursor->at_value) || (!IS_ALPHA_LOWCASE(*str_p))) return -1;
+    if (json_literal_scan(&str_p, cursor->str_endp, &literal_type) != 0)
+    { return -1; }
+    if (literal_type != type) return -1;
+    cursor->str_p = str_p;
+    cursor->at_value = 0;
+    return 0;
+}
+
+int json_cursor_get_bool(json_cursor_t *cursor, int *value_out)
+{
+    if (json_cursor_literal(cursor, JSON_NODE_TYPE_TRUE) == 0)
+    {
+        *value_out = 1;
+        return 0;
+    }
+    if (json_cursor_literal(cursor, JSON_NODE_TYPE_FALSE) == 0)
+    {
+        *value_out = 0;
+        return 0;
+    }
+    return -1;
+}
+
+int json_cursor_get_null(json_cursor_t *cursor)
+{
+    return json_cursor_literal(cursor, JSON_NODE_TYPE_NULL);
+}
+
+int json_cursor_load(json_cursor_t *cursor, json_t **json_out)
+{
+    size_t used;
+
+    if (!cursor->at_value) return -1;
+    if ((cursor->loader == NULL) && \
+            ((cursor->loader = json_loader_new(cursor->flags, 0)) == NULL))
+    { return -1; }
+    if (json_loader_load_prefix(cursor->loader, json_out, cursor->str_p, \
+                (size_t)(cursor->str_endp - cursor->str_p), &used) != 0)
+    { return -1; }
+    cursor->str_p += used;
+    cursor->at_value = 0;
+    return 0;
+}
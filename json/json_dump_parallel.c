@@ -0,0 +1,328 @@
+/* JSON Library - parallel dump */
+
+/* json_dump_parallel serializes a document on several threads by
+ * cutting the tree into parts whose output is simply concatenated.
+ *
+ * A plan is drawn up first, on the calling thread: an array or object
+ * with enough members is cut into runs of consecutive members, one
+ * part each; a smaller one is opened and its members planned in turn,
+ * a few levels down at most, so that a big array held by a wrapper
+ * object is still cut. Whatever is left is a part of its own. The
+ * brackets, keys and colons between the parts are written while
+ * planning, into text parts.
+ *
+ * The workers then dump the parts into private buffers. A running sum
+ * of their lengths gives each part its offset in the output, which is
+ * allocated once, and the buffers are copied there side by side.
+ * Every part is written by the same code as json_dump, so the output
+ * is the same byte for byte.
+ *
+ * A document whose output is likely small is dumped by json_dump: a
+ * walk bounded by JSON_DUMP_PARALLEL_SIZE_MIN estimates its size. */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "json_internal.h"
+
+/* Smaller output is dumped serially */
+#define JSON_DUMP_PARALLEL_SIZE_MIN ((size_t)128 << 10)
+/* Containers with fewer members are opened instead of cut */
+#define JSON_DUMP_PARALLEL_CUT_MIN ((size_t)8)
+/* How many levels containers are opened to, counting the root */
+#define JSON_DUMP_PARALLEL_DEPTH ((size_t)8)
+/* Parts per thread, so uneven parts even out */
+#define JSON_DUMP_PARALLEL_SPLIT ((size_t)8)
+
+/* Members [begin, begin + count) of container node, object ones from
+ * member on; the whole of node when count is 0, and text written while
+ * planning when node is NULL */
+typedef struct json_dump_part
+{
+    json_node_t *node;
+    size_t begin;
+    size_t count;
+    json_node_object_node_t *member;
+    json_buffer_t out;
+    size_t offset;
+} json_dump_part_t;
+
+typedef struct json_dump_parallel
+{
+    json_dump_part_t *parts;
+    size_t count;
+    size_t capacity;
+    /* Once there are this many parts nothing more is cut or opened */
+    size_t budget;
+    size_t split;
+    char *str;
+} json_dump_parallel_t;
+
+/* Estimated output of node, counted down from *left until it is used
+ * up; the walk stops there */
+static void json_dump_parallel_estimate(json_node_t *node, size_t *left)
+{
+    json_node_object_node_t *member;
+    size_t idx, size = 5;
+
+    if (node->type == JSON_NODE_TYPE_STRING)
+    { size = node->u.string_part.len + 3; }
+    *left = (size < *left) ? *left - size : 0;
+
+    if (node->type == JSON_NODE_TYPE_ARRAY)
+    {
+        for (idx = 0; (idx != node->u.array_part->size) && (*left != 0); idx++)
+        { json_dump_parallel_estimate(node->u.array_part->items[idx], left); }
+    }
+    else if (node->type == JSON_NODE_TYPE_OBJECT)
+    {
+        for (member = node->u.object_part->begin; \
+                (member != NULL) && (*left != 0); member = member->next)
+        {
+            json_dump_parallel_estimate(member->name, left);
+            json_dump_parallel_estimate(member->value, left);
+        }
+    }
+}
+
+static json_dump_part_t *json_dump_parallel_push(json_dump_parallel_t *parallel, \
+        json_node_t *node, size_t begin, size_t count)
+{
+    json_dump_part_t *part, *new_parts;
+    size_t capacity;
+
+    if (parallel->count == parallel->capacity)
+    {
+        capacity = (parallel->capacity == 0) ? 64 : parallel->capacity * 2;
+        if ((new_parts = (json_dump_part_t *)realloc(parallel->parts, \
+                        sizeof(json_dump_part_t) * capacity)) == NULL)
+        { return NULL; }
+        parallel->parts = new_parts;
+        parallel->capacity = capacity;
+    }
+
+    part = &parallel->parts[parallel->count++];
+    part->node = node;
+    part->begin = begin;
+    part->count = count;
+    part->member = NULL;
+    part->out.buf = NULL;
+    part->out.len = 0;
+    part->out.capacity = 0;
+    part->offset = 0;
+    return part;
+}
+
+/* The text part output goes to, the last part when it is one */
+static json_buffer_t *json_dump_parallel_text(json_dump_parallel_t *parallel)
+{
+    json_dump_part_t *part;
+
+    if ((parallel->count != 0) && \
+            (parallel->parts[parallel->count - 1].node == NULL))
+    { return &parallel->parts[parallel->count - 1].out; }
+    if ((part = json_dump_parallel_push(parallel, NULL, 0, 0)) == NULL)
+    { return NULL; }
+    return &part->out;
+}
+
+static int json_dump_parallel_putc(json_dump_parallel_t *parallel, char ch)
+{
+    json_buffer_t *text;
+
+    if ((text = json_dump_parallel_text(parallel)) == NULL) return -1;
+    return json_buffer_put(text, &ch, 1);
+}
+
+/* Cut the members of a container into about split runs */
+static int json_dump_parallel_cut(json_dump_parallel_t *parallel, \
+        json_node_t *node, size_t size)
+{
+    json_dump_part_t *part;
+    json_node_object_node_t *member = NULL;
+    size_t count, idx, begin, end, skip;
+
+    count = (size < parallel->split) ? size : parallel->split;
+    if (node->type == JSON_NODE_TYPE_OBJECT)
+    { member = node->u.object_part->begin; }
+
+    for (idx = 0, begin = 0; idx != count; idx++, begin = end)
+    {
+        end = size / count * (idx + 1) + size % count * (idx + 1) / count;
+        if ((part = json_dump_parallel_push(parallel, node, begin, \
+                        end - begin)) == NULL)
+        { return -1; }
+        part->member = member;
+        for (skip = begin; (member != NULL) && (skip != end); skip++)
+        { member = member->next; }
+    }
+    return 0;
+}
+
+static int json_dump_parallel_plan(json_dump_parallel_t *parallel, \
+        json_node_t *node, size_t depth)
+{
+    int ret = 0;
+    json_node_object_node_t *member;
+    json_buffer_t *text;
+    size_t idx, size = 0;
+    int is_array = (node->type == JSON_NODE_TYPE_ARRAY);
+
+    if (is_array) size = node->u.array_part->size;
+    else if (node->type == JSON_NODE_TYPE_OBJECT)
+    { size = node->u.object_part->size; }
+
+    if ((size == 0) || (parallel->count >= parallel->budget) || \
+            ((size < JSON_DUMP_PARALLEL_CUT_MIN) && \
+             (depth == JSON_DUMP_PARALLEL_DEPTH)))
+    {
+        return (json_dump_parallel_push(parallel, node, 0, 0) != NULL) ? \
+            0 : -1;
+    }
+
+    if ((ret = json_dump_parallel_putc(parallel, is_array ? '[' : '{')) != 0)
+    { goto fail; }
+    if (size >= JSON_DUMP_PARALLEL_CUT_MIN)
+    {
+        if ((ret = json_dump_parallel_cut(parallel, node, size)) != 0)
+        { goto fail; }
+    }
+    else if (is_array)
+    {
+        for (idx = 0; idx != size; idx++)
+        {
+            if ((idx != 0) && \
+                    ((ret = json_dump_parallel_putc(parallel, ',')) != 0))
+            { goto fail; }
+            if ((ret = json_dump_parallel_plan(parallel, \
+                            node->u.array_part->items[idx], depth + 1)) != 0)
+            { goto fail; }
+        }
+    }
+    else
+    {
+        for (member = node->u.object_part->begin; member != NULL; \
+                member = member->next)
+        {
+            if ((member != node->u.object_part->begin) && \
+                    ((ret = json_dump_parallel_putc(parallel, ',')) != 0))
+            { goto fail; }
+            if ((text = json_dump_parallel_text(parallel)) == NULL)
+            { ret = -1; goto fail; }
+            if ((ret = json_buffer_dump(text, member->name)) != 0)
+            { goto fail; }
+            if ((ret = json_buffer_put(text, ":", 1)) != 0)
+            { goto fail; }
+            if ((ret = json_dump_parallel_plan(parallel, member->value, \
+                            depth + 1)) != 0)
+            { goto fail; }
+        }
+    }
+    if ((ret = json_dump_parallel_putc(parallel, is_array ? ']' : '}')) != 0)
+    { goto fail; }
+
+fail:
+    return ret;
+}
+
+static int json_dump_parallel_task(void *ctx, size_t idx)
+{
+    int ret = 0;
+    json_dump_parallel_t *parallel = (json_dump_parallel_t *)ctx;
+    json_dump_part_t *part = &parallel->parts[idx];
+    json_node_object_node_t *member = part->member;
+    size_t cur, end = part->begin + part->count;
+
+    if (part->node == NULL) return 0;
+    if (part->count == 0) return json_buffer_dump(&part->out, part->node);
+
+    for (cur = part->begin; cur != end; cur++)
+    {
+        if ((cur != 0) && ((ret = json_buffer_put(&part->out, ",", 1)) != 0))
+        { goto fail; }
+        if (part->node->type == JSON_NODE_TYPE_ARRAY)
+        {
+            if ((ret = json_buffer_dump(&part->out, \
+                            part->node->u.array_part->items[cur])) != 0)
+            { goto fail; }
+            continue;
+        }
+        if ((ret = json_buffer_dump(&part->out, member->name)) != 0)
+        { goto fail; }
+        if ((ret = json_buffer_put(&part->out, ":", 1)) != 0)
+        { goto fail; }
+        if ((ret = json_buffer_dump(&part->out, member->value)) != 0)
+        { goto fail; }
+        member = member->next;
+    }
+
+fail:
+    return ret;
+}
+
+static int json_dump_parallel_copy_task(void *ctx, size_t idx)
+{
+    json_dump_parallel_t *parallel = (json_dump_parallel_t *)ctx;
+    json_dump_part_t *part = &parallel->parts[idx];
+
+    if (part->out.len != 0)
+    { memcpy(parallel->str + part->offset, part->out.buf, part->out.len); }
+    /* Gone as soon as copied, so the peak stays near twice the output */
+    if (part->out.buf != NULL) free(part->out.buf);
+    part->out.buf = NULL;
+    return 0;
+}
+
+int json_dump_parallel(json_t *json, char **str_out, size_t *len_out, \
+        size_t nthreads)
+{
+    int ret = 0;
+    json_dump_parallel_t parallel;
+    size_t idx, len = 0, left = JSON_DUMP_PARALLEL_SIZE_MIN;
+
+    nthreads = json_thread_count(nthreads);
+    if (nthreads != 1) json_dump_parallel_estimate(json->root, &left);
+    if ((nthreads == 1) || (left != 0))
+    { return json_dump(json, str_out, len_out); }
+
+    parallel.parts = NULL;
+    parallel.count = 0;
+    parallel.capacity = 0;
+    parallel.split = nthreads * JSON_DUMP_PARALLEL_SPLIT;
+    parallel.budget = parallel.split * 4;
+    parallel.str = NULL;
+
+    if ((ret = json_dump_parallel_plan(&parallel, json->root, 1)) != 0)
+    { goto fail; }
+    if ((ret = json_thread_run(nthreads, parallel.count, \
+                    json_dump_parallel_task, &parallel)) != 0)
+    { goto fail; }
+
+    for (idx = 0; idx != parallel.count; idx++)
+    {
+        parallel.parts[idx].offset = len;
+        len += parallel.parts[idx].out.len;
+    }
+    if ((parallel.str = (char *)malloc(len + 1)) == NULL)
+    { ret = -1; goto fail; }
+    if ((ret = json_thread_run(nthreads, parallel.count, \
+                    json_dump_parallel_copy_task, &parallel)) != 0)
+    { goto fail; }
+    parallel.str[len] = '\0';
+
+    *str_out = parallel.str;
+    *len_out = len;
+    parallel.str = NULL;
+
+fail:
+    for (idx = 0; idx != parallel.count; idx++)
+    {
+        if (parallel.parts[idx].out.buf != NULL)
+        { free(parallel.parts[idx].out.buf); }
+    }
+    if (parallel.parts != NULL) free(parallel.parts);
+    if (parallel.str != NULL) free(parallel.str);
+    return ret;
+}
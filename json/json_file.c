@@ -0,0 +1,71 @@
+/* JSON Library - file loading */
+
+/* json_load_file parses a file straight from a read-only mapping of
+ * it, so its bytes are never copied into a buffer of ours first; the
+ * page cache holds them and the kernel is told they are read front to
+ * back. No parser writes to its input, which is what lets the mapping
+ * be read-only.
+ *
+ * An in-situ load leaves string nodes pointing into the mapping, so
+ * the document takes it over and json_destroy unmaps it; any other
+ * load is done with it before returning. */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "json.h"
+#include "json_internal.h"
+
+int json_file_map(const char *path, void **mapping_out, size_t *len_out)
+{
+    int ret = 0;
+    int fd;
+    struct stat st;
+    void *mapping;
+
+    if ((fd = open(path, O_RDONLY)) < 0) return -1;
+    if ((fstat(fd, &st) != 0) || (!S_ISREG(st.st_mode)) || (st.st_size <= 0))
+    { ret = -1; goto fail; }
+    if ((mapping = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, \
+                    fd, 0)) == MAP_FAILED)
+    { ret = -1; goto fail; }
+    *mapping_out = mapping;
+    *len_out = (size_t)st.st_size;
+
+fail:
+    close(fd);
+    return ret;
+}
+
+void json_file_unmap(void *mapping, size_t len)
+{
+    munmap(mapping, len);
+}
+
+int json_load_file(json_t **json_out, const char *path, unsigned int flags)
+{
+    int ret = 0;
+    void *mapping;
+    size_t len;
+
+    if (json_file_map(path, &mapping, &len) != 0) return -1;
+    /* Only a hint: read-ahead may be larger, pages behind may go */
+    posix_madvise(mapping, len, POSIX_MADV_SEQUENTIAL);
+
+    if ((ret = json_load_ex(json_out, (char *)mapping, len, flags)) != 0)
+    { goto fail; }
+    if (flags & JSON_LOAD_INSITU)
+    {
+        (*json_out)->mapping = mapping;
+        (*json_out)->mapping_len = len;
+        mapping = NULL;
+    }
+
+fail:
+    if (mapping != NULL) json_file_unmap(mapping, len);
+    return ret;
+}
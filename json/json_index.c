@@ -0,0 +1,424 @@
+/* JSON Library - two-stage parser */
+
+/* Stage 1 classifies the input 64 bytes at a time and records the
+ * offset of every structural character, both quotes of every string
+ * and the first byte of every number or literal. Quotes escaped by an
+ * odd run of backslashes are dropped first; a prefix xor over the
+ * remaining quotes then marks the bytes inside strings, so nothing in
+ * a string body reaches the index.
+ *
+ * The index is built one window of input at a time and consumed
+ * before the next window is classified, so stage 2 reads bytes that
+ * stage 1 has just pulled into cache and the index itself never grows
+ * past one window.
+ *
+ * Stage 2 walks the index with an explicit stack and reports the same
+ * json_sax_t events as json_sax_parse. A string without backslashes is
+ * taken straight from its two quotes; anything else goes through the
+ * shared decoders. Each token has to be followed by nothing but
+ * whitespace up to the next indexed one, which keeps the accepted
+ * language identical. */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "json_internal.h"
+
+#define JSON_INDEX_BLOCK ((size_t)64)
+#define JSON_INDEX_WINDOW ((size_t)16 << 10)
+
+#define JSON_INDEX_EVEN_BITS ((uint64_t)0x5555555555555555ULL)
+
+typedef enum json_index_state
+{
+    JSON_INDEX_STATE_VALUE,
+    JSON_INDEX_STATE_VALUE_OR_END,
+    JSON_INDEX_STATE_KEY_OR_END,
+    JSON_INDEX_STATE_COLON,
+    JSON_INDEX_STATE_COMMA_OR_END,
+} json_index_state_t;
+
+typedef struct json_index
+{
+    char *str;
+    size_t len;
+    /* Start of the next window to classify, and what carries over
+     * from the last block of the previous one */
+    size_t base;
+    uint64_t escape_carry;
+    uint64_t string_carry;
+    uint64_t scalar_carry;
+    /* Offsets of the indexed bytes of the current window, relative to
+     * window, in input order; one window never holds more than
+     * JSON_INDEX_WINDOW of them, plus the slack the flattening loop
+     * writes past the end */
+    char *window;
+    uint32_t *pos;
+    size_t size;
+    size_t cursor;
+    /* Open containers */
+    json_stack_t *stack;
+} json_index_t;
+
+
+/* Stage 1 */
+
+/* Bits of the characters that follow an odd run of backslashes. *carry_io
+ * is 1 when the previous block ended inside such a run. */
+uint64_t json_index_escaped(uint64_t backslash, uint64_t *carry_io)
+{
+    uint64_t start_edges = backslash & ~(backslash << 1);
+    uint64_t even_start_mask = JSON_INDEX_EVEN_BITS ^ *carry_io;
+    uint64_t even_starts = start_edges & even_start_mask;
+    uint64_t odd_starts = start_edges & ~even_start_mask;
+    uint64_t even_carries = backslash + even_starts;
+    uint64_t odd_carries = backslash + odd_starts;
+    uint64_t odd_ends;
+
+    /* A run reaching bit 63 overflows out of the odd-start sum */
+    odd_ends = (odd_carries < backslash) ? 1 : 0;
+    odd_carries |= *carry_io;
+    *carry_io = odd_ends;
+
+    /* Where a run ends relative to where it started gives its parity */
+    even_carries &= ~backslash;
+    odd_carries &= ~backslash;
+    return (even_carries & ~JSON_INDEX_EVEN_BITS) | \
+        (odd_carries & JSON_INDEX_EVEN_BITS);
+}
+
+/* Bit i set when an odd number of bits at or below i are set */
+uint64_t json_index_prefix_xor(uint64_t bits)
+{
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+/* Store the lowest set bit of bits and clear it; bit 63 stands in
+ * for an exhausted mask so the count is never undefined */
+#define JSON_INDEX_FLATTEN_STEP(pos_p, offset, bits, idx) \
+    do { \
+        (pos_p)[idx] = (uint32_t)((offset) + \
+                (size_t)__builtin_ctzll((bits) | ((uint64_t)1 << 63))); \
+        (bits) &= (bits) - 1; \
+    } while (0)
+
+/* Classify the next window of input into index->pos */
+static void json_index_build(json_index_t *index)
+{
+    char tail[JSON_INDEX_BLOCK];
+    const char *block;
+    json_simd_masks_t masks;
+    uint64_t escape_carry = index->escape_carry;
+    uint64_t string_carry = index->string_carry;
+    uint64_t scalar_carry = index->scalar_carry;
+    uint64_t valid, escaped, quote, in_string, scalar, bits;
+    size_t offset, len, count;
+    uint32_t *pos_p = index->pos;
+
+    index->window = index->str + index->base;
+    len = index->len - index->base;
+    if (len > JSON_INDEX_WINDOW) len = JSON_INDEX_WINDOW;
+    index->base += len;
+
+    for (offset = 0; offset < len; offset += JSON_INDEX_BLOCK)
+    {
+        valid = ~(uint64_t)0;
+        block = index->window + offset;
+        if (len - offset < JSON_INDEX_BLOCK)
+        {
+            memset(tail, ' ', JSON_INDEX_BLOCK);
+            memcpy(tail, block, len - offset);
+            block = tail;
+            valid = ((uint64_t)1 << (len - offset)) - 1;
+        }
+
+        json_simd_classify(block, &masks);
+        escaped = 0;
+        if ((masks.backslash | escape_carry) != 0)
+        { escaped = json_index_escaped(masks.backslash, &escape_carry); }
+        quote = masks.quote & ~escaped;
+
+        /* Opening quotes and string bodies, the closing quote excluded */
+        in_string = json_index_prefix_xor(quote) ^ string_carry;
+        string_carry = (uint64_t)0 - (in_string >> 63);
+
+        /* Numbers and literals are the runs of everything else; only
+         * their first byte is indexed */
+        scalar = ~(masks.structural | masks.whitespace | quote | in_string);
+        bits = scalar & ~((scalar << 1) | scalar_carry);
+        scalar_carry = scalar >> 63;
+
+        bits |= (masks.structural & ~in_string) | quote;
+        bits &= valid;
+        if (bits == 0) continue;
+
+        /* Write offsets eight at a time without branching on each bit;
+         * the slots past count are overwritten by the next block */
+        count = (size_t)__builtin_popcountll(bits);
+        while (bits != 0)
+        {
+            JSON_INDEX_FLATTEN_STEP(pos_p, offset, bits, 0);
+            JSON_INDEX_FLATTEN_STEP(pos_p, offset, bits, 1);
+            JSON_INDEX_FLATTEN_STEP(pos_p, offset, bits, 2);
+            JSON_INDEX_FLATTEN_STEP(pos_p, offset, bits, 3);
+            JSON_INDEX_FLATTEN_STEP(pos_p, offset, bits, 4);
+            JSON_INDEX_FLATTEN_STEP(pos_p, offset, bits, 5);
+            JSON_INDEX_FLATTEN_STEP(pos_p, offset, bits, 6);
+            JSON_INDEX_FLATTEN_STEP(pos_p, offset, bits, 7);
+            pos_p += 8;
+        }
+        pos_p -= (8 - count % 8) % 8;
+    }
+
+    index->escape_carry = escape_carry;
+    index->string_carry = string_carry;
+    index->scalar_carry = scalar_carry;
+    index->size = (size_t)(pos_p - index->pos);
+    index->cursor = 0;
+}
+
+/* Next indexed byte, classifying more input as needed; NULL once the
+ * input is used up */
+static char *json_index_next(json_index_t *index)
+{
+    while (index->cursor == index->size)
+    {
+        if (index->base == index->len) return NULL;
+        json_index_build(index);
+    }
+    return index->window + index->pos[index->cursor++];
+}
+
+
+/* Stage 2 */
+
+/* Body of the string between the quotes at token_p and close_p */
+static int json_index_string(char *token_p, char *close_p, \
+        char **body_out, size_t *len_out)
+{
+    char *str_p = token_p;
+    size_t plain_len;
+
+    *body_out = token_p + 1;
+    *len_out = (size_t)(close_p - token_p - 1);
+    /* The closing quote is known already; only escapes, control
+     * characters and bad UTF-8 can stop the run short of it */
+    plain_len = json_simd_scan_string_utf8(*body_out, *len_out);
+    if (plain_len == *len_out) return 0;
+    if ((*body_out)[plain_len] != '\\') return -1;
+
+    /* Escapes still need checking */
+    return json_string_scan(&str_p, close_p + 1, body_out, len_out);
+}
+
+/* A value starting at token_p; *str_io gets the end of a scalar.
+ * close_p is the closing quote when the value is a string. */
+static int json_index_value(json_index_t *index, \
+        const json_sax_t *sax, void *ctx, \
+        char *token_p, char *close_p, char **str_io, char *str_endp, \
+        json_index_state_t *state_out)
+{
+    char *str_p = token_p;
+    char *body;
+    size_t len;
+    json_number_t number;
+    json_node_type_t type;
+
+    switch (*str_p)
+    {
+        case '[':
+            if (json_stack_push(index->stack, '[') != 0) return -1;
+            JSON_SAX_EMIT(sax, on_start_array, (ctx));
+            *state_out = JSON_INDEX_STATE_VALUE_OR_END;
+            return 0;
+        case '{':
+            if (json_stack_push(index->stack, '{') != 0) return -1;
+            JSON_SAX_EMIT(sax, on_start_object, (ctx));
+            *state_out = JSON_INDEX_STATE_KEY_OR_END;
+            return 0;
+        case '\"':
+            if (json_index_string(token_p, close_p, &body, &len) != 0)
+            { return -1; }
+            JSON_SAX_EMIT(sax, on_string, (ctx, body, len));
+            str_p = close_p + 1;
+            break;
+        default:
+            if ((IS_DIGIT(*str_p))||(*str_p == '-'))
+            {
+                if (json_number_scan(&str_p, str_endp, &number) != 0)
+                { return -1; }
+                if (number.type == JSON_NODE_TYPE_INTEGER)
+                { JSON_SAX_EMIT(sax, on_integer, (ctx, number.int_value)); }
+                else
+                { JSON_SAX_EMIT(sax, on_double, (ctx, number.double_value)); }
+            }
+            else if (IS_ALPHA_LOWCASE(*str_p))
+            {
+                if (json_literal_scan(&str_p, str_endp, &type) != 0)
+                { return -1; }
+                if (type == JSON_NODE_TYPE_NULL)
+                { JSON_SAX_EMIT(sax, on_null, (ctx)); }
+                else
+                { JSON_SAX_EMIT(sax, on_bool, (ctx, type == JSON_NODE_TYPE_TRUE)); }
+            }
+            else
+            {
+                return -1;
+            }
+            break;
+    }
+    *str_io = str_p;
+    *state_out = JSON_INDEX_STATE_COMMA_OR_END;
+    return 0;
+}
+
+static int json_index_key(const json_sax_t *sax, void *ctx, \
+        char *token_p, char *close_p, char **str_io, \
+        json_index_state_t *state_out)
+{
+    char *name;
+    size_t name_len;
+
+    if (*token_p != '\"') return -1;
+    if (json_index_string(token_p, close_p, &name, &name_len) != 0)
+    { return -1; }
+    JSON_SAX_EMIT(sax, on_key, (ctx, name, name_len));
+    *str_io = close_p + 1;
+    *state_out = JSON_INDEX_STATE_COLON;
+    return 0;
+}
+
+static int json_index_end(json_index_t *index, \
+        const json_sax_t *sax, void *ctx, char ch, \
+        json_index_state_t *state_out)
+{
+    char open;
+
+    if (ch == ']') open = '[';
+    else if (ch == '}') open = '{';
+    else return -1;
+
+    if ((index->stack->depth == 0) || \
+            (index->stack->items[index->stack->depth - 1] != open))
+    { return -1; }
+    index->stack->depth--;
+    if (ch == ']')
+    { JSON_SAX_EMIT(sax, on_end_array, (ctx)); }
+    else
+    { JSON_SAX_EMIT(sax, on_end_object, (ctx)); }
+    *state_out = JSON_INDEX_STATE_COMMA_OR_END;
+    return 0;
+}
+
+static int json_index_walk(json_index_t *index, \
+        const json_sax_t *sax, void *ctx)
+{
+    int ret = 0;
+    json_index_state_t state = JSON_INDEX_STATE_VALUE;
+    char *str_endp = index->str + index->len;
+    char *str_p = index->str;
+    char *token_p, *close_p = NULL;
+    char ch;
+
+    while ((token_p = json_index_next(index)) != NULL)
+    {
+        /* Every byte up to here has to belong to some token or be
+         * whitespace between tokens */
+        if (token_p != str_p)
+        {
+            str_p += json_simd_skip_whitespace(str_p, \
+                    (size_t)(token_p - str_p));
+            if (token_p != str_p) return -1;
+        }
+        ch = *token_p;
+        str_p = token_p + 1;
+        if (ch == '\"')
+        {
+            /* The closing quote is always the next entry */
+            if ((close_p = json_index_next(index)) == NULL) return -1;
+        }
+
+        switch (state)
+        {
+            case JSON_INDEX_STATE_VALUE:
+                ret = json_index_value(index, sax, ctx, \
+                        token_p, close_p, &str_p, str_endp, &state);
+                break;
+            case JSON_INDEX_STATE_VALUE_OR_END:
+                if (ch == ']')
+                { ret = json_index_end(index, sax, ctx, ch, &state); }
+                else
+                {
+                    ret = json_index_value(index, sax, ctx, \
+                            token_p, close_p, &str_p, str_endp, &state);
+                }
+                break;
+            case JSON_INDEX_STATE_KEY_OR_END:
+                if (ch == '}')
+                { ret = json_index_end(index, sax, ctx, ch, &state); }
+                else
+                { ret = json_index_key(sax, ctx, token_p, close_p, &str_p, &state); }
+                break;
+            case JSON_INDEX_STATE_COLON:
+                if (ch != ':') ret = -1;
+                state = JSON_INDEX_STATE_VALUE;
+                break;
+            case JSON_INDEX_STATE_COMMA_OR_END:
+                if (ch == ',')
+                {
+                    /* json_load accepts a closing bracket after a comma */
+                    state = (index->stack->items[index->stack->depth - 1] == '[') ? \
+                        JSON_INDEX_STATE_VALUE_OR_END : JSON_INDEX_STATE_KEY_OR_END;
+                }
+                else
+                { ret = json_index_end(index, sax, ctx, ch, &state); }
+                break;
+        }
+        if (ret != 0) return ret;
+
+        /* Like json_load, ignore whatever follows the document */
+        if ((state == JSON_INDEX_STATE_COMMA_OR_END) && \
+                (index->stack->depth == 0))
+        { return 0; }
+    }
+
+    return -1;
+}
+
+int json_index_parse(char *str, size_t len, const json_sax_t *sax, \
+        void *ctx, json_stack_t *stack)
+{
+    int ret = 0;
+    json_index_t index;
+
+    index.str = str;
+    index.len = len;
+    index.base = 0;
+    index.escape_carry = 0;
+    index.string_carry = 0;
+    index.scalar_carry = 0;
+    index.window = str;
+    index.size = 0;
+    index.cursor = 0;
+    index.stack = stack;
+    stack->depth = 0;
+
+    if ((index.pos = (uint32_t *)malloc( \
+                    (JSON_INDEX_WINDOW + 8) * sizeof(uint32_t))) == NULL)
+    { return -1; }
+    if ((ret = json_index_walk(&index, sax, ctx)) != 0)
+    { goto fail; }
+
+fail:
+    if (index.pos != NULL) free(index.pos);
+    return ret;
+}
+
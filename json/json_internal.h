@@ -0,0 +1,200 @@
+/* JSON Library internals shared between translation units */
+
+#ifndef _JSON_INTERNAL_H_
+#define _JSON_INTERNAL_H_
+
+#include <stdint.h>
+
+#include "json.h"
+
+#define IS_DIGIT(ch) (('0'<=(ch))&&((ch)<='9'))
+#define IS_HEX(ch) ((IS_DIGIT(ch))||(('a'<=(ch))&&((ch)<='f'))||(('A'<=(ch))&&((ch)<='F')))
+#define IS_ALPHA_LOWCASE(ch) (('a'<=(ch))&&((ch)<='z'))
+#define IS_NUMBER_PART(ch) ((IS_DIGIT(ch))||((ch)=='.')||((ch)=='e')||((ch)=='E')||((ch)=='+')||((ch)=='-'))
+#define IS_WHITESPACE(ch) (((ch)==' ')||((ch)=='\t')||((ch)=='\n')||((ch)=='\r'))
+
+/* Move str_p past whitespace. A lone separator byte is stepped over
+ * inline; only longer runs, like indentation, go to the vector kernel. */
+#define JSON_SKIP_WHITESPACE(str_p, str_endp) \
+    do { \
+        if (((str_p) != (str_endp)) && (IS_WHITESPACE(*(str_p)))) \
+        { \
+            (str_p)++; \
+            if (((str_p) != (str_endp)) && (IS_WHITESPACE(*(str_p)))) \
+            { \
+                (str_p) += json_simd_skip_whitespace((str_p), \
+                        (size_t)((str_endp) - (str_p))); \
+            } \
+        } \
+    } while (0)
+
+/* Object key lookup with the key's hash worked out beforehand; it
+ * probes the key index when the object has one and scans otherwise,
+ * never building one, so it neither allocates nor writes */
+size_t json_key_hash(const char *key, size_t len);
+json_node_t *json_node_object_get_hashed(json_node_t *node_object, \
+        const char *key, size_t len, size_t hash);
+
+/* Arena */
+
+json_arena_t *json_arena_new(void);
+void json_arena_destroy(json_arena_t *arena);
+void *json_arena_alloc(json_arena_t *arena, size_t size);
+void json_arena_merge(json_arena_t *arena, json_arena_t *from);
+
+/* Character classes of one 64 byte block, bit i for block[i] */
+typedef struct json_simd_masks
+{
+    uint64_t backslash;
+    uint64_t quote;
+    uint64_t whitespace;
+    uint64_t structural;
+} json_simd_masks_t;
+
+void json_simd_classify(const char *block, json_simd_masks_t *masks);
+
+/* Offset of the first quote, backslash or control character in
+ * str[0, len), len if there is none; vectorized when the CPU allows */
+size_t json_simd_scan_string(const char *str, size_t len);
+
+/* Like json_simd_scan_string, except that when str[0, offset) is not
+ * well-formed UTF-8 the offset returned is that of a byte >= 0x80 */
+size_t json_simd_scan_string_utf8(const char *str, size_t len);
+
+/* Offset of the first byte in str[0, len) that is not whitespace */
+size_t json_simd_skip_whitespace(const char *str, size_t len);
+
+/* Scalar decoders */
+
+int json_string_scan(char **str_io, char *str_endp, \
+        char **body_out, size_t *len_out);
+/* An integer when the text has no fraction or exponent and fits in
+ * int64_t, a double otherwise */
+typedef struct json_number
+{
+    json_node_type_t type;
+    int64_t int_value;
+    double double_value;
+} json_number_t;
+
+int json_number_scan(char **str_io, char *str_endp, json_number_t *number_out);
+
+/* Number formatting; buf needs JSON_NUMBER_FORMAT_MAX bytes, the
+ * length written is returned */
+#define JSON_NUMBER_FORMAT_MAX 32
+
+int json_number_length_integer(int64_t value);
+int json_number_format_integer(int64_t value, char *buf);
+int json_number_format_double(double value, char *buf);
+int json_literal_scan(char **str_io, char *str_endp, \
+        json_node_type_t *type_out);
+
+/* Report a json_sax_t event, returning -1 from the caller when the
+ * callback asks to stop */
+#define JSON_SAX_EMIT(sax, event, args) \
+    if (((sax)->event != NULL) && ((sax)->event args != 0)) return -1
+
+/* Open containers of a parse, '[' or '{' each. A push past max_depth
+ * fails; max_depth 0 at init means JSON_DEPTH_DEFAULT. */
+typedef struct json_stack
+{
+    char *items;
+    size_t depth;
+    size_t capacity;
+    size_t max_depth;
+} json_stack_t;
+
+void json_stack_init(json_stack_t *stack, size_t max_depth);
+int json_stack_push(json_stack_t *stack, char ch);
+void json_stack_fini(json_stack_t *stack);
+
+/* json_sax_parse on a caller's stack; used_out, when not NULL, gets
+ * the length of the document, whatever follows it being ignored */
+int json_sax_parse_in(char *str, size_t len, const json_sax_t *sax, \
+        void *ctx, json_stack_t *stack, size_t *used_out);
+
+/* The members of a container whose bracket is open, from one slice
+ * of its body cut at its own commas; only the last slice, last set,
+ * can be empty or end with a comma. Each value starts on an empty
+ * stack. */
+int json_sax_parse_members(char *str, size_t len, const json_sax_t *sax, \
+        void *ctx, json_stack_t *stack, char open, int last);
+
+/* Two-stage parse over a structural index */
+int json_index_parse(char *str, size_t len, const json_sax_t *sax, \
+        void *ctx, json_stack_t *stack);
+
+/* Stage 1 bit tricks: the bits escaped by odd backslash runs, carry_io
+ * being 1 when the previous block ended inside one, and the running
+ * parity of bits */
+uint64_t json_index_escaped(uint64_t backslash, uint64_t *carry_io);
+uint64_t json_index_prefix_xor(uint64_t bits);
+
+/* Tree builder */
+
+typedef struct json_builder
+{
+    json_arena_t *arena;
+    json_node_t *root;
+    json_node_t *key;
+    json_node_t **stack;
+    size_t depth;
+    size_t capacity;
+    /* Keys interned so far, an open-addressing table */
+    json_node_t **keys;
+    size_t keys_count;
+    size_t keys_capacity;
+    unsigned int flags;
+} json_builder_t;
+
+extern const json_sax_t json_builder_sax;
+
+int json_builder_init(json_builder_t *builder, unsigned int flags);
+/* A string, or with key set a key, whose body is already decoded; it
+ * is copied, or borrowed in-situ, keys being interned as parsed ones are */
+int json_builder_string(json_builder_t *builder, char *str, size_t len, \
+        int key);
+int json_builder_finish(json_builder_t *builder, json_t **json_out);
+int json_builder_splice(json_builder_t *builder, json_builder_t *parts, \
+        size_t count);
+void json_builder_fini(json_builder_t *builder);
+
+/* Load the document at the start of str, one-pass engine whatever the
+ * flags; *used_out gets its length, whatever follows is left alone */
+int json_loader_load_prefix(json_loader_t *loader, json_t **json_out, \
+        char *str, size_t len, size_t *used_out);
+
+/* Map the regular, non-empty file at path read-only; release the
+ * mapping with json_file_unmap */
+int json_file_map(const char *path, void **mapping_out, size_t *len_out);
+void json_file_unmap(void *mapping, size_t len);
+
+/* Dump buffer: serialized output appended at buf + len, buf being
+ * malloc'd and grown by doubling as a json_dump one is; start from all
+ * zeroes and free buf when done */
+typedef struct json_buffer
+{
+    char *buf;
+    size_t len;
+    size_t capacity;
+} json_buffer_t;
+
+int json_buffer_dump(json_buffer_t *buffer, json_node_t *node);
+int json_buffer_put(json_buffer_t *buffer, const char *data, size_t len);
+
+/* Workers */
+
+/* Run task(ctx, idx) for every idx in [0, count) on up to nthreads
+ * threads, the calling one included, 0 meaning one per online CPU.
+ * Tasks are handed out one at a time as threads free up. Returns
+ * nonzero when any task did. */
+typedef int (*json_task_fn_t)(void *ctx, size_t idx);
+
+/* nthreads, or the number of online CPUs when it is 0 */
+size_t json_thread_count(size_t nthreads);
+
+int json_thread_run(size_t nthreads, size_t count, \
+        json_task_fn_t task, void *ctx);
+
+
+#endif
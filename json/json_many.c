@@ -0,0 +1,365 @@
+/* JSON Library - batch loader */
+
+/* json_load_many loads a stream of whitespace-separated documents, as
+ * in NDJSON, on several threads.
+ *
+ * The input is taken a window at a time and each window is cut into
+ * chunks right after newline bytes. A valid string never holds a raw
+ * newline, so every chunk starts outside of any string, though maybe
+ * inside a document. A first parallel pass counts how each chunk
+ * changes the nesting depth; a running sum over the chunks then gives
+ * the depth each one starts at. In the second pass every chunk steps
+ * over the tail of a document begun before it and loads the documents
+ * that begin inside it, running past its end when one does.
+ *
+ * Finally the documents have to tile the window, with only whitespace
+ * between them; any input the passes misread, being invalid, fails a
+ * load or this check. They are handed out in input order before the
+ * next window is read. A window is a few hundred KB per thread: every
+ * document of it stays loaded until then, and a small working set both
+ * bounds memory use and keeps it in cache.
+ *
+ * On one thread, or for a stream that would make a single chunk, none
+ * of this pays: documents are loaded one after the other and each is
+ * handed out as soon as it is, keeping just the one loaded. */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "json_internal.h"
+
+/* Window bytes per thread */
+#define JSON_MANY_WINDOW ((size_t)256 << 10)
+#define JSON_MANY_CHUNK_MIN ((size_t)16 << 10)
+/* Chunks per thread, so uneven chunks even out */
+#define JSON_MANY_CHUNK_SPLIT ((size_t)8)
+#define JSON_MANY_DOCS_MIN ((size_t)16)
+
+typedef struct json_many_doc
+{
+    json_t *json;
+    size_t start;
+    size_t end;
+} json_many_doc_t;
+
+typedef struct json_many_chunk
+{
+    size_t begin;
+    size_t end;
+    /* Change of depth over the chunk, then the depth at its start */
+    long depth;
+    json_many_doc_t *docs;
+    size_t size;
+    size_t capacity;
+} json_many_chunk_t;
+
+typedef struct json_many
+{
+    char *str;
+    size_t len;
+    unsigned int flags;
+    json_many_chunk_t *chunks;
+    size_t count;
+} json_many_t;
+
+
+/* Follow the nesting over [str_p, str_endp): strings are stepped over
+ * whole and brackets counted into *depth_io. With stop set, return as
+ * soon as the depth is back to zero. NULL when a string runs past the
+ * end, which a chunk never sees in valid input. */
+static char *json_many_skip(char *str_p, char *str_endp, \
+        long *depth_io, int stop)
+{
+    long depth = *depth_io;
+    char ch;
+
+    while (str_p != str_endp)
+    {
+        ch = *str_p++;
+        if (ch == '\"')
+        {
+            for (;;)
+            {
+                str_p += json_simd_scan_string(str_p, \
+                        (size_t)(str_endp - str_p));
+                if (str_p == str_endp) return NULL;
+                ch = *str_p++;
+                if (ch == '\"') break;
+                if (ch == '\\')
+                {
+                    if (str_p == str_endp) return NULL;
+                    str_p++;
+                }
+            }
+        }
+        else if ((ch == '[') || (ch == '{'))
+        {
+            depth++;
+        }
+        else if ((ch == ']') || (ch == '}'))
+        {
+            depth--;
+            if (stop && (depth == 0)) break;
+        }
+    }
+    *depth_io = depth;
+    return str_p;
+}
+
+static int json_many_depth_task(void *ctx, size_t idx)
+{
+    json_many_t *many = (json_many_t *)ctx;
+    json_many_chunk_t *chunk = &many->chunks[idx];
+
+    chunk->depth = 0;
+    if (json_many_skip(many->str + chunk->begin, many->str + chunk->end, \
+                &chunk->depth, 0) == NULL)
+    { return -1; }
+    return 0;
+}
+
+static int json_many_push(json_many_chunk_t *chunk, json_t *json, \
+        size_t start, size_t end)
+{
+    json_many_doc_t *new_docs = NULL;
+    size_t capacity;
+
+    if (chunk->size == chunk->capacity)
+    {
+        capacity = chunk->capacity * 2;
+        if (capacity < JSON_MANY_DOCS_MIN) capacity = JSON_MANY_DOCS_MIN;
+        if ((new_docs = (json_many_doc_t *)realloc(chunk->docs, \
+                        sizeof(json_many_doc_t) * capacity)) == NULL)
+        { return -1; }
+        chunk->docs = new_docs;
+        chunk->capacity = capacity;
+    }
+    chunk->docs[chunk->size].json = json;
+    chunk->docs[chunk->size].start = start;
+    chunk->docs[chunk->size].end = end;
+    chunk->size++;
+    return 0;
+}
+
+static int json_many_load_task(void *ctx, size_t idx)
+{
+    int ret = 0;
+    json_many_t *many = (json_many_t *)ctx;
+    json_many_chunk_t *chunk = &many->chunks[idx];
+    char *str_p = many->str + chunk->begin;
+    char *str_chunk_endp = many->str + chunk->end;
+    char *str_endp = many->str + many->len;
+    long depth = chunk->depth;
+    json_loader_t *loader = NULL;
+    json_t *new_json = NULL;
+    size_t used;
+
+    /* The end of a document some earlier chunk loads */
+    if (depth < 0) return -1;
+    if (depth > 0)
+    {
+        if ((str_p = json_many_skip(str_p, str_chunk_endp, &depth, 1)) == NULL)
+        { return -1; }
+        if (depth != 0) return 0;
+    }
+
+    if ((loader = json_loader_new(many->flags, 0)) == NULL)
+    { return -1; }
+    /* A document may run past the end of the chunk */
+    while (str_p < str_chunk_endp)
+    {
+        JSON_SKIP_WHITESPACE(str_p, str_chunk_endp);
+        if (str_p == str_chunk_endp) break;
+
+        if ((ret = json_loader_load_prefix(loader, &new_json, str_p, \
+                        (size_t)(str_endp - str_p), &used)) != 0)
+        { goto fail; }
+        if ((ret = json_many_push(chunk, new_json, \
+                        (size_t)(str_p - many->str), \
+                        (size_t)(str_p - many->str) + used)) != 0)
+        { json_destroy(new_json); goto fail; }
+        str_p += used;
+    }
+
+fail:
+    json_loader_destroy(loader);
+    return ret;
+}
+
+/* Cut [begin, end) into chunks that start right after a newline */
+static void json_many_split(json_many_t *many, size_t begin, size_t end, \
+        size_t nthreads)
+{
+    size_t chunk_size, next;
+    const char *newline_p;
+
+    chunk_size = (end - begin) / (nthreads * JSON_MANY_CHUNK_SPLIT);
+    if (chunk_size < JSON_MANY_CHUNK_MIN) chunk_size = JSON_MANY_CHUNK_MIN;
+
+    many->count = 0;
+    while (begin != end)
+    {
+        next = (end - begin > chunk_size) ? begin + chunk_size : end;
+        if (next != end)
+        {
+            newline_p = (const char *)memchr(many->str + next, '\n', end - next);
+            next = (newline_p == NULL) ? end : \
+                   (size_t)(newline_p - many->str) + 1;
+        }
+        many->chunks[many->count].begin = begin;
+        many->chunks[many->count].end = next;
+        many->chunks[many->count].size = 0;
+        many->count++;
+        begin = next;
+    }
+}
+
+static void json_many_clear(json_many_t *many)
+{
+    json_many_chunk_t *chunk;
+    size_t idx, doc;
+
+    for (idx = 0; idx != many->count; idx++)
+    {
+        chunk = &many->chunks[idx];
+        for (doc = 0; doc != chunk->size; doc++)
+        {
+            if (chunk->docs[doc].json != NULL)
+            { json_destroy(chunk->docs[doc].json); }
+        }
+        chunk->size = 0;
+    }
+}
+
+/* Offset of the first byte at or after pos that is not whitespace */
+static size_t json_many_skip_whitespace(json_many_t *many, size_t pos)
+{
+    char *str_p = many->str + pos;
+    char *str_endp = many->str + many->len;
+
+    JSON_SKIP_WHITESPACE(str_p, str_endp);
+    return (size_t)(str_p - many->str);
+}
+
+/* The documents front to back on the calling thread */
+static int json_many_stream(char *str, size_t len, unsigned int flags, \
+        json_doc_fn_t fn, void *ctx)
+{
+    int ret = 0;
+    char *str_p = str, *str_endp = str + len;
+    json_loader_t *loader;
+    json_t *new_json;
+    size_t used, doc_idx = 0;
+
+    if ((loader = json_loader_new(flags, 0)) == NULL)
+    { return -1; }
+    for (;;)
+    {
+        JSON_SKIP_WHITESPACE(str_p, str_endp);
+        if (str_p == str_endp) break;
+
+        if ((ret = json_loader_load_prefix(loader, &new_json, str_p, \
+                        (size_t)(str_endp - str_p), &used)) != 0)
+        { break; }
+        str_p += used;
+        if ((ret = fn(ctx, doc_idx++, new_json)) != 0)
+        { break; }
+    }
+    json_loader_destroy(loader);
+    return ret;
+}
+
+int json_load_many(char *str, size_t len, unsigned int flags, \
+        size_t nthreads, json_doc_fn_t fn, void *ctx)
+{
+    int ret = 0;
+    json_many_t many;
+    json_many_chunk_t *chunk;
+    size_t begin = 0, end, pos, idx, doc, doc_idx = 0, capacity, window;
+    const char *newline_p;
+
+    /* Each document is loaded on its own, front to back */
+    flags &= ~(unsigned int)JSON_LOAD_INDEXED;
+    nthreads = json_thread_count(nthreads);
+    if ((nthreads == 1) || (len <= JSON_MANY_CHUNK_MIN) || \
+            (memchr(str, '\n', len) == NULL))
+    { return json_many_stream(str, len, flags, fn, ctx); }
+
+    many.str = str;
+    many.len = len;
+    many.flags = flags;
+    many.count = 0;
+    window = nthreads * JSON_MANY_WINDOW;
+    capacity = nthreads * JSON_MANY_CHUNK_SPLIT + 1;
+    if ((many.chunks = (json_many_chunk_t *)calloc(capacity, \
+                    sizeof(json_many_chunk_t))) == NULL)
+    { return -1; }
+
+    pos = json_many_skip_whitespace(&many, 0);
+    while (pos != len)
+    {
+        /* The window ends on a newline too */
+        end = (len - begin > window) ? begin + window : len;
+        if (end != len)
+        {
+            newline_p = (const char *)memchr(str + end, '\n', len - end);
+            end = (newline_p == NULL) ? len : (size_t)(newline_p - str) + 1;
+        }
+        json_many_split(&many, begin, end, nthreads);
+
+        if ((ret = json_thread_run(nthreads, many.count, \
+                        json_many_depth_task, &many)) != 0)
+        { goto fail; }
+        for (idx = 1; idx < many.count; idx++)
+        { many.chunks[idx].depth += many.chunks[idx - 1].depth; }
+        for (idx = many.count - 1; idx > 0; idx--)
+        { many.chunks[idx].depth = many.chunks[idx - 1].depth; }
+        many.chunks[0].depth = 0;
+
+        if ((ret = json_thread_run(nthreads, many.count, \
+                        json_many_load_task, &many)) != 0)
+        { goto fail; }
+
+        /* The documents have to cover the window with nothing but
+         * whitespace around them */
+        for (idx = 0; idx != many.count; idx++)
+        {
+            chunk = &many.chunks[idx];
+            for (doc = 0; doc != chunk->size; doc++)
+            {
+                if (chunk->docs[doc].start != pos)
+                { ret = -1; goto fail; }
+                pos = json_many_skip_whitespace(&many, chunk->docs[doc].end);
+            }
+        }
+        if (pos < end)
+        { ret = -1; goto fail; }
+
+        for (idx = 0; idx != many.count; idx++)
+        {
+            chunk = &many.chunks[idx];
+            for (doc = 0; doc != chunk->size; doc++)
+            {
+                if ((ret = fn(ctx, doc_idx++, chunk->docs[doc].json)) != 0)
+                {
+                    chunk->docs[doc].json = NULL;
+                    goto fail;
+                }
+                chunk->docs[doc].json = NULL;
+            }
+        }
+        json_many_clear(&many);
+        begin = pos;
+    }
+
+fail:
+    json_many_clear(&many);
+    for (idx = 0; idx != capacity; idx++)
+    {
+        if (many.chunks[idx].docs != NULL) free(many.chunks[idx].docs);
+    }
+    free(many.chunks);
+    return ret;
+}
@@ -0,0 +1,408 @@
+/* JSON Library - parallel load */
+
+/* json_load_parallel loads a document whose root is one big array or
+ * object on several threads, slicing the root's body at its own
+ * commas and loading the slices side by side.
+ *
+ * The input is cut into chunks at arbitrary 64 byte blocks, so a chunk
+ * may start inside a string. A first parallel pass classifies every
+ * chunk like stage 1 of the two-stage parser: the parity of its quotes
+ * and, for either guess of whether it starts inside a string, how it
+ * changes the nesting depth and how low the depth gets. Whether a
+ * backslash at the very start is escaped only needs a look at the
+ * bytes just before the chunk. A running xor and sum over the chunks
+ * then settle where each chunk starts and which one closes the root.
+ * A second pass finds in each chunk the first comma at depth 1, and in
+ * the last one the bracket closing the root.
+ *
+ * Each slice between two such commas is loaded into its own builder
+ * and arena; the slices are then spliced into the root in order and
+ * their arenas merged into the document's, which moves pointers but
+ * no nodes.
+ *
+ * The passes assume valid input. Every slice is still parsed in full
+ * and the bytes between them are checked, so the parts can only all
+ * load when the document really is a root holding those members; on
+ * invalid input the load fails, like json_load does. */
+
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "json_internal.h"
+
+#define JSON_PARALLEL_BLOCK ((size_t)64)
+#define JSON_PARALLEL_CHUNK_MIN ((size_t)64 << 10)
+/* Chunks per thread, so uneven slices even out */
+#define JSON_PARALLEL_CHUNK_SPLIT ((size_t)8)
+#define JSON_PARALLEL_NONE ((size_t)-1)
+
+typedef struct json_parallel_chunk
+{
+    size_t begin;
+    size_t end;
+    /* Quote parity, then whether the chunk starts inside a string */
+    int in_string;
+    /* Change of depth over the chunk when it starts outside a string
+     * or inside one, then the depth it starts at; likewise the lowest
+     * depth a closing bracket leaves, LONG_MAX for none */
+    long depth;
+    long depth_in_string;
+    long low;
+    long low_in_string;
+    /* First comma at depth 1 and the root's closing bracket, if in
+     * this chunk */
+    size_t cut;
+    size_t close;
+} json_parallel_chunk_t;
+
+typedef struct json_parallel_slice
+{
+    size_t begin;
+    size_t end;
+} json_parallel_slice_t;
+
+typedef struct json_parallel
+{
+    char *str;
+    size_t len;
+    unsigned int flags;
+    char open;
+    json_parallel_chunk_t *chunks;
+    size_t count;
+    /* The chunk the root closes in */
+    size_t close_chunk;
+    json_parallel_slice_t *slices;
+    json_builder_t *parts;
+    size_t slice_count;
+} json_parallel_t;
+
+
+/* The block of the chunk at offset, padded with whitespace at the end
+ * of the input; *valid_out gets the bits that are input */
+static const char *json_parallel_block(json_parallel_t *parallel, \
+        json_parallel_chunk_t *chunk, size_t offset, char *tail, \
+        uint64_t *valid_out)
+{
+    size_t len = chunk->end - offset;
+
+    *valid_out = ~(uint64_t)0;
+    if (len >= JSON_PARALLEL_BLOCK) return parallel->str + offset;
+    memset(tail, ' ', JSON_PARALLEL_BLOCK);
+    memcpy(tail, parallel->str + offset, len);
+    *valid_out = ((uint64_t)1 << len) - 1;
+    return tail;
+}
+
+/* 1 when the chunk starts right after an odd run of backslashes */
+static uint64_t json_parallel_escape_carry(json_parallel_t *parallel, \
+        json_parallel_chunk_t *chunk)
+{
+    size_t pos = chunk->begin;
+
+    while ((pos != 0) && (parallel->str[pos - 1] == '\\')) pos--;
+    return (uint64_t)((chunk->begin - pos) & 1);
+}
+
+static int json_parallel_classify_task(void *ctx, size_t idx)
+{
+    json_parallel_t *parallel = (json_parallel_t *)ctx;
+    json_parallel_chunk_t *chunk = &parallel->chunks[idx];
+    char tail[JSON_PARALLEL_BLOCK];
+    const char *block;
+    json_simd_masks_t masks;
+    uint64_t escape_carry = json_parallel_escape_carry(parallel, chunk);
+    uint64_t string_carry = 0;
+    uint64_t valid, escaped, quote, in_string, bits;
+    size_t offset;
+    long depth[2] = { 0, 0 }, low[2] = { LONG_MAX, LONG_MAX };
+    int bit, guess;
+    char ch;
+
+    for (offset = chunk->begin; offset < chunk->end; \
+            offset += JSON_PARALLEL_BLOCK)
+    {
+        block = json_parallel_block(parallel, chunk, offset, tail, &valid);
+        json_simd_classify(block, &masks);
+        escaped = 0;
+        if ((masks.backslash | escape_carry) != 0)
+        { escaped = json_index_escaped(masks.backslash, &escape_carry); }
+        quote = masks.quote & ~escaped & valid;
+
+        /* In a string as the chunk would be if it started outside one;
+         * the other guess is the complement */
+        in_string = json_index_prefix_xor(quote) ^ string_carry;
+        string_carry = (uint64_t)0 - (in_string >> 63);
+
+        bits = masks.structural & valid;
+        while (bits != 0)
+        {
+            bit = __builtin_ctzll(bits);
+            bits &= bits - 1;
+            ch = block[bit];
+            guess = (int)((in_string >> bit) & 1);
+            if ((ch == '[') || (ch == '{'))
+            {
+                depth[guess]++;
+            }
+            else if ((ch == ']') || (ch == '}'))
+            {
+                if (--depth[guess] < low[guess]) low[guess] = depth[guess];
+            }
+        }
+    }
+
+    chunk->in_string = (int)(string_carry & 1);
+    chunk->depth = depth[0];
+    chunk->depth_in_string = depth[1];
+    chunk->low = low[0];
+    chunk->low_in_string = low[1];
+    return 0;
+}
+
+static int json_parallel_cut_task(void *ctx, size_t idx)
+{
+    json_parallel_t *parallel = (json_parallel_t *)ctx;
+    json_parallel_chunk_t *chunk = &parallel->chunks[idx];
+    char tail[JSON_PARALLEL_BLOCK];
+    const char *block;
+    json_simd_masks_t masks;
+    uint64_t escape_carry = json_parallel_escape_carry(parallel, chunk);
+    uint64_t string_carry = chunk->in_string ? ~(uint64_t)0 : 0;
+    uint64_t valid, escaped, quote, in_string, bits;
+    size_t offset;
+    long depth = chunk->depth;
+    int bit;
+    char ch;
+
+    chunk->cut = JSON_PARALLEL_NONE;
+    chunk->close = JSON_PARALLEL_NONE;
+
+    for (offset = chunk->begin; offset < chunk->end; \
+            offset += JSON_PARALLEL_BLOCK)
+    {
+        block = json_parallel_block(parallel, chunk, offset, tail, &valid);
+        json_simd_classify(block, &masks);
+        escaped = 0;
+        if ((masks.backslash | escape_carry) != 0)
+        { escaped = json_index_escaped(masks.backslash, &escape_carry); }
+        quote = masks.quote & ~escaped & valid;
+        in_string = json_index_prefix_xor(quote) ^ string_carry;
+        string_carry = (uint64_t)0 - (in_string >> 63);
+
+        bits = masks.structural & ~in_string & valid;
+        while (bits != 0)
+        {
+            bit = __builtin_ctzll(bits);
+            bits &= bits - 1;
+            ch = block[bit];
+            if ((ch == '[') || (ch == '{'))
+            {
+                depth++;
+            }
+            else if ((ch == ']') || (ch == '}'))
+            {
+                if (--depth == 0)
+                {
+                    chunk->close = offset + (size_t)bit;
+                    return 0;
+                }
+            }
+            else if ((ch == ',') && (depth == 1) && \
+                    (chunk->cut == JSON_PARALLEL_NONE))
+            {
+                chunk->cut = offset + (size_t)bit;
+                /* Unless the root closes in this chunk too, that is
+                 * all it has to give */
+                if (idx != parallel->close_chunk) return 0;
+            }
+        }
+    }
+    return 0;
+}
+
+static int json_parallel_load_task(void *ctx, size_t idx)
+{
+    int ret = 0;
+    json_parallel_t *parallel = (json_parallel_t *)ctx;
+    json_parallel_slice_t *slice = &parallel->slices[idx];
+    json_builder_t *part = &parallel->parts[idx];
+    json_stack_t stack;
+
+    /* The root is open already, one level down */
+    json_stack_init(&stack, JSON_DEPTH_DEFAULT - 1);
+    if (parallel->open == '[')
+    { ret = json_builder_sax.on_start_array(part); }
+    else
+    { ret = json_builder_sax.on_start_object(part); }
+    if (ret != 0)
+    { goto fail; }
+    if ((ret = json_sax_parse_members(parallel->str + slice->begin, \
+                    slice->end - slice->begin, &json_builder_sax, part, \
+                    &stack, parallel->open, \
+                    idx + 1 == parallel->slice_count)) != 0)
+    { goto fail; }
+
+fail:
+    json_stack_fini(&stack);
+    return ret;
+}
+
+/* Cut the input into chunks of whole blocks */
+static void json_parallel_split(json_parallel_t *parallel, size_t nthreads)
+{
+    size_t chunk_size, begin = 0;
+
+    chunk_size = parallel->len / (nthreads * JSON_PARALLEL_CHUNK_SPLIT);
+    if (chunk_size < JSON_PARALLEL_CHUNK_MIN)
+    { chunk_size = JSON_PARALLEL_CHUNK_MIN; }
+    chunk_size = (chunk_size + JSON_PARALLEL_BLOCK - 1) & \
+                 ~(JSON_PARALLEL_BLOCK - 1);
+
+    parallel->count = 0;
+    while (begin != parallel->len)
+    {
+        parallel->chunks[parallel->count].begin = begin;
+        begin = (parallel->len - begin > chunk_size) ? \
+                begin + chunk_size : parallel->len;
+        parallel->chunks[parallel->count].end = begin;
+        parallel->count++;
+    }
+}
+
+/* Slice the root's body, which opens at open, at the commas found */
+static int json_parallel_slice(json_parallel_t *parallel, size_t open)
+{
+    json_parallel_chunk_t *chunk;
+    size_t idx, begin = open + 1;
+
+    parallel->slice_count = 0;
+    for (idx = 0; idx <= parallel->close_chunk; idx++)
+    {
+        chunk = &parallel->chunks[idx];
+        if ((chunk->cut != JSON_PARALLEL_NONE) && \
+                ((chunk->close == JSON_PARALLEL_NONE) || \
+                 (chunk->cut < chunk->close)))
+        {
+            parallel->slices[parallel->slice_count].begin = begin;
+            parallel->slices[parallel->slice_count].end = chunk->cut;
+            parallel->slice_count++;
+            begin = chunk->cut + 1;
+        }
+        if (chunk->close != JSON_PARALLEL_NONE)
+        {
+            if (parallel->str[chunk->close] != \
+                    ((parallel->open == '[') ? ']' : '}'))
+            { return -1; }
+            parallel->slices[parallel->slice_count].begin = begin;
+            parallel->slices[parallel->slice_count].end = chunk->close;
+            parallel->slice_count++;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int json_load_parallel(json_t **json_out, char *str, size_t len, \
+        unsigned int flags, size_t nthreads)
+{
+    int ret = 0;
+    json_parallel_t parallel;
+    json_builder_t builder;
+    json_parallel_chunk_t *chunk;
+    char *str_p = str, *str_endp = str + len;
+    size_t idx, capacity, part_count = 0;
+    int in_string = 0, parity;
+    long depth = 0, delta, low;
+
+    nthreads = json_thread_count(nthreads);
+    JSON_SKIP_WHITESPACE(str_p, str_endp);
+    if ((nthreads == 1) || (len < 2 * JSON_PARALLEL_CHUNK_MIN) || \
+            (str_p == str_endp) || ((*str_p != '[') && (*str_p != '{')))
+    { return json_load_ex(json_out, str, len, flags); }
+
+    parallel.str = str;
+    parallel.len = len;
+    parallel.flags = flags & ~(unsigned int)JSON_LOAD_INDEXED;
+    parallel.open = *str_p;
+    capacity = nthreads * JSON_PARALLEL_CHUNK_SPLIT + 1;
+    parallel.chunks = (json_parallel_chunk_t *)malloc( \
+            sizeof(json_parallel_chunk_t) * capacity);
+    parallel.slices = (json_parallel_slice_t *)malloc( \
+            sizeof(json_parallel_slice_t) * (capacity + 1));
+    parallel.parts = (json_builder_t *)malloc( \
+            sizeof(json_builder_t) * (capacity + 1));
+    if ((ret = json_builder_init(&builder, parallel.flags)) != 0)
+    { goto fail; }
+    if ((parallel.chunks == NULL) || (parallel.slices == NULL) || \
+            (parallel.parts == NULL))
+    { ret = -1; goto fail; }
+    json_parallel_split(&parallel, nthreads);
+
+    if ((ret = json_thread_run(nthreads, parallel.count, \
+                    json_parallel_classify_task, &parallel)) != 0)
+    { goto fail; }
+    parallel.close_chunk = JSON_PARALLEL_NONE;
+    for (idx = 0; idx != parallel.count; idx++)
+    {
+        chunk = &parallel.chunks[idx];
+        delta = in_string ? chunk->depth_in_string : chunk->depth;
+        low = in_string ? chunk->low_in_string : chunk->low;
+        parity = chunk->in_string;
+        chunk->in_string = in_string;
+        chunk->depth = depth;
+        in_string ^= parity;
+        if ((low != LONG_MAX) && (depth + low <= 0))
+        {
+            parallel.close_chunk = idx;
+            break;
+        }
+        depth += delta;
+    }
+    /* The root never closes */
+    if (parallel.close_chunk == JSON_PARALLEL_NONE)
+    { ret = -1; goto fail; }
+    /* Whatever follows the root is ignored, as by json_load */
+    if ((ret = json_thread_run(nthreads, parallel.close_chunk + 1, \
+                    json_parallel_cut_task, &parallel)) != 0)
+    { goto fail; }
+    if ((ret = json_parallel_slice(&parallel, (size_t)(str_p - str))) != 0)
+    { goto fail; }
+
+    for (part_count = 0; part_count != parallel.slice_count; part_count++)
+    {
+        if ((ret = json_builder_init(&parallel.parts[part_count], \
+                        parallel.flags)) != 0)
+        { goto fail; }
+    }
+    if ((ret = json_thread_run(nthreads, parallel.slice_count, \
+                    json_parallel_load_task, &parallel)) != 0)
+    { goto fail; }
+
+    if (parallel.open == '[')
+    { ret = json_builder_sax.on_start_array(&builder); }
+    else
+    { ret = json_builder_sax.on_start_object(&builder); }
+    if (ret != 0)
+    { goto fail; }
+    if ((ret = json_builder_splice(&builder, parallel.parts, \
+                    parallel.slice_count)) != 0)
+    { goto fail; }
+    if ((ret = json_builder_sax.on_end_array(&builder)) != 0)
+    { goto fail; }
+    if ((ret = json_builder_finish(&builder, json_out)) != 0)
+    { goto fail; }
+    if (parallel.flags & JSON_LOAD_INSITU)
+    { (*json_out)->borrowed = str; }
+
+fail:
+    for (idx = 0; idx != part_count; idx++)
+    { json_builder_fini(&parallel.parts[idx]); }
+    json_builder_fini(&builder);
+    if (parallel.chunks != NULL) free(parallel.chunks);
+    if (parallel.slices != NULL) free(parallel.slices);
+    if (parallel.parts != NULL) free(parallel.parts);
+    return ret;
+}
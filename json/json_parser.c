@@ -0,0 +1,436 @@
+/* JSON Library - push parser */
+
+/* The document arrives in chunks of any size. Structure is tracked with
+ * an explicit stack, and a token cut by a chunk boundary (a string, an
+ * escape inside it, a number or a literal) is carried over in a small
+ * buffer until it is complete. Complete tokens go through the same
+ * scalar decoders and tree builder as json_load, so both produce the
+ * same json_t for the same bytes. */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "json_internal.h"
+
+#define JSON_PARSER_TOKEN_MIN ((size_t)64)
+
+typedef enum json_parser_state
+{
+    JSON_PARSER_STATE_VALUE,
+    JSON_PARSER_STATE_VALUE_OR_END,
+    JSON_PARSER_STATE_KEY_OR_END,
+    JSON_PARSER_STATE_COLON,
+    JSON_PARSER_STATE_COMMA_OR_END,
+    JSON_PARSER_STATE_DONE,
+    JSON_PARSER_STATE_FAILED,
+} json_parser_state_t;
+
+typedef enum json_parser_token
+{
+    JSON_PARSER_TOKEN_NONE,
+    JSON_PARSER_TOKEN_KEY,
+    JSON_PARSER_TOKEN_STRING,
+    JSON_PARSER_TOKEN_NUMBER,
+    JSON_PARSER_TOKEN_LITERAL,
+} json_parser_token_t;
+
+struct json_parser
+{
+    unsigned int flags;
+    json_builder_t builder;
+    json_parser_state_t state;
+    /* Open containers */
+    json_stack_t stack;
+    /* Token cut by the end of a chunk */
+    json_parser_token_t token;
+    int escape;
+    char *token_buf;
+    size_t token_len;
+    size_t token_capacity;
+};
+
+
+/* Helpers */
+
+static int json_parser_carry(json_parser_t *parser, char *str, size_t len)
+{
+    char *new_buf = NULL;
+    size_t capacity = parser->token_capacity;
+
+    if (parser->token_capacity - parser->token_len < len)
+    {
+        if (capacity < JSON_PARSER_TOKEN_MIN) capacity = JSON_PARSER_TOKEN_MIN;
+        while (capacity - parser->token_len < len) capacity *= 2;
+        if ((new_buf = (char *)realloc(parser->token_buf, capacity)) == NULL)
+        { return -1; }
+        parser->token_buf = new_buf;
+        parser->token_capacity = capacity;
+    }
+    memcpy(parser->token_buf + parser->token_len, str, len);
+    parser->token_len += len;
+    return 0;
+}
+
+static void json_parser_value_done(json_parser_t *parser)
+{
+    parser->state = (parser->stack.depth == 0) ? \
+        JSON_PARSER_STATE_DONE : JSON_PARSER_STATE_COMMA_OR_END;
+}
+
+/* Decode one complete token held in [str, str_endp) */
+static int json_parser_token_emit(json_parser_t *parser, \
+        char *str, char *str_endp)
+{
+    const json_sax_t *sax = &json_builder_sax;
+    void *ctx = &parser->builder;
+    char *str_p = str;
+    char *body;
+    size_t body_len;
+    json_number_t number;
+    json_node_type_t type;
+
+    switch (parser->token)
+    {
+        case JSON_PARSER_TOKEN_KEY:
+            if (json_string_scan(&str_p, str_endp, &body, &body_len) != 0)
+            { return -1; }
+            if (sax->on_key(ctx, body, body_len) != 0) return -1;
+            parser->state = JSON_PARSER_STATE_COLON;
+            break;
+        case JSON_PARSER_TOKEN_STRING:
+            if (json_string_scan(&str_p, str_endp, &body, &body_len) != 0)
+            { return -1; }
+            if (sax->on_string(ctx, body, body_len) != 0) return -1;
+            json_parser_value_done(parser);
+            break;
+        case JSON_PARSER_TOKEN_NUMBER:
+            if (json_number_scan(&str_p, str_endp, &number) != 0)
+            { return -1; }
+            if (number.type == JSON_NODE_TYPE_INTEGER)
+            { if (sax->on_integer(ctx, number.int_value) != 0) return -1; }
+            else
+            {
+                if (sax->on_double(ctx, number.double_value) != 0)
+                { return -1; }
+            }
+            json_parser_value_done(parser);
+            break;
+        case JSON_PARSER_TOKEN_LITERAL:
+            if (json_literal_scan(&str_p, str_endp, &type) != 0)
+            { return -1; }
+            if (type == JSON_NODE_TYPE_NULL)
+            { if (sax->on_null(ctx) != 0) return -1; }
+            else
+            {
+                if (sax->on_bool(ctx, type == JSON_NODE_TYPE_TRUE) != 0)
+                { return -1; }
+            }
+            json_parser_value_done(parser);
+            break;
+        case JSON_PARSER_TOKEN_NONE:
+            return -1;
+    }
+    /* The decoder has to account for every byte of the token, except
+     * after a root value, where json_load ignores the rest: "1-2" */
+    if ((str_p != str_endp) && (parser->state != JSON_PARSER_STATE_DONE))
+    { return -1; }
+
+    parser->token = JSON_PARSER_TOKEN_NONE;
+    parser->token_len = 0;
+    return 0;
+}
+
+/* Advance through a token starting or continuing at str_p; *closed_out
+ * tells whether its end was seen before str_endp */
+static char *json_parser_token_scan(json_parser_t *parser, \
+        char *str_p, char *str_endp, int *closed_out)
+{
+    *closed_out = 0;
+    switch (parser->token)
+    {
+        case JSON_PARSER_TOKEN_KEY:
+        case JSON_PARSER_TOKEN_STRING:
+            while (str_p != str_endp)
+            {
+                if (parser->escape) parser->escape = 0;
+                else
+                {
+                    str_p += json_simd_scan_string(str_p, \
+                            (size_t)(str_endp - str_p));
+                    if (str_p == str_endp) break;
+                    if (*str_p == '\\') parser->escape = 1;
+                    else if (*str_p == '\"')
+                    {
+                        *closed_out = 1;
+                        return str_p + 1;
+                    }
+                }
+                str_p++;
+            }
+            break;
+        case JSON_PARSER_TOKEN_NUMBER:
+            while ((str_p != str_endp) && (IS_NUMBER_PART(*str_p))) str_p++;
+            *closed_out = (str_p != str_endp);
+            break;
+        case JSON_PARSER_TOKEN_LITERAL:
+            while ((str_p != str_endp) && (IS_ALPHA_LOWCASE(*str_p))) str_p++;
+            *closed_out = (str_p != str_endp);
+            break;
+        case JSON_PARSER_TOKEN_NONE:
+            break;
+    }
+    return str_p;
+}
+
+static int json_parser_token_start(json_parser_t *parser, \
+        char **str_io, char *str_endp, json_parser_token_t token)
+{
+    char *str_start_p = *str_io;
+    char *str_p;
+    int closed;
+
+    parser->token = token;
+    parser->escape = 0;
+    parser->token_len = 0;
+
+    /* Past the opening quote, or the sign / first character */
+    str_p = json_parser_token_scan(parser, str_start_p + 1, str_endp, &closed);
+    if (!closed)
+    {
+        /* Cut by the chunk boundary, finish it on a later feed */
+        *str_io = str_endp;
+        return json_parser_carry(parser, str_start_p, \
+                (size_t)(str_endp - str_start_p));
+    }
+
+    *str_io = str_p;
+    return json_parser_token_emit(parser, str_start_p, str_p);
+}
+
+static int json_parser_token_continue(json_parser_t *parser, \
+        char **str_io, char *str_endp)
+{
+    char *str_start_p = *str_io;
+    int closed;
+    char *str_p = json_parser_token_scan(parser, str_start_p, str_endp, &closed);
+
+    if (json_parser_carry(parser, str_start_p, \
+                (size_t)(str_p - str_start_p)) != 0)
+    { return -1; }
+    *str_io = str_p;
+    if (!closed) return 0;
+
+    return json_parser_token_emit(parser, parser->token_buf, \
+            parser->token_buf + parser->token_len);
+}
+
+static int json_parser_value(json_parser_t *parser, \
+        char **str_io, char *str_endp)
+{
+    char ch = **str_io;
+
+    if (ch == '[')
+    {
+        if (json_stack_push(&parser->stack, '[') != 0) return -1;
+        if (json_builder_sax.on_start_array(&parser->builder) != 0) return -1;
+        parser->state = JSON_PARSER_STATE_VALUE_OR_END;
+        (*str_io)++;
+        return 0;
+    }
+    else if (ch == '{')
+    {
+        if (json_stack_push(&parser->stack, '{') != 0) return -1;
+        if (json_builder_sax.on_start_object(&parser->builder) != 0) return -1;
+        parser->state = JSON_PARSER_STATE_KEY_OR_END;
+        (*str_io)++;
+        return 0;
+    }
+    else if (ch == '\"')
+    {
+        return json_parser_token_start(parser, str_io, str_endp, \
+                JSON_PARSER_TOKEN_STRING);
+    }
+    else if ((IS_DIGIT(ch))||(ch == '-'))
+    {
+        return json_parser_token_start(parser, str_io, str_endp, \
+                JSON_PARSER_TOKEN_NUMBER);
+    }
+    else if (IS_ALPHA_LOWCASE(ch))
+    {
+        return json_parser_token_start(parser, str_io, str_endp, \
+                JSON_PARSER_TOKEN_LITERAL);
+    }
+    return -1;
+}
+
+static int json_parser_end(json_parser_t *parser, char ch)
+{
+    char open = (ch == ']') ? '[' : '{';
+
+    if ((parser->stack.depth == 0) || \
+            (parser->stack.items[parser->stack.depth - 1] != open))
+    { return -1; }
+    parser->stack.depth--;
+    if (ch == ']')
+    {
+        if (json_builder_sax.on_end_array(&parser->builder) != 0) return -1;
+    }
+    else
+    {
+        if (json_builder_sax.on_end_object(&parser->builder) != 0) return -1;
+    }
+    json_parser_value_done(parser);
+    return 0;
+}
+
+static int json_parser_step(json_parser_t *parser, \
+        char **str_io, char *str_endp)
+{
+    char ch = **str_io;
+
+    switch (parser->state)
+    {
+        case JSON_PARSER_STATE_VALUE:
+            return json_parser_value(parser, str_io, str_endp);
+        case JSON_PARSER_STATE_VALUE_OR_END:
+            if (ch == ']')
+            {
+                (*str_io)++;
+                return json_parser_end(parser, ch);
+            }
+            return json_parser_value(parser, str_io, str_endp);
+        case JSON_PARSER_STATE_KEY_OR_END:
+            if (ch == '}')
+            {
+                (*str_io)++;
+                return json_parser_end(parser, ch);
+            }
+            if (ch != '\"') return -1;
+            return json_parser_token_start(parser, str_io, str_endp, \
+                    JSON_PARSER_TOKEN_KEY);
+        case JSON_PARSER_STATE_COLON:
+            if (ch != ':') return -1;
+            (*str_io)++;
+            parser->state = JSON_PARSER_STATE_VALUE;
+            return 0;
+        case JSON_PARSER_STATE_COMMA_OR_END:
+            (*str_io)++;
+            if (ch == ',')
+            {
+                /* json_load accepts a closing bracket after a comma */
+                parser->state = (parser->stack.items[parser->stack.depth - 1] == '[') ? \
+                    JSON_PARSER_STATE_VALUE_OR_END : JSON_PARSER_STATE_KEY_OR_END;
+                return 0;
+            }
+            if ((ch == ']') || (ch == '}')) return json_parser_end(parser, ch);
+            return -1;
+        case JSON_PARSER_STATE_DONE:
+            /* Like json_load, ignore whatever follows the document */
+            *str_io = str_endp;
+            return 0;
+        case JSON_PARSER_STATE_FAILED:
+            return -1;
+    }
+    return -1;
+}
+
+
+/* Parser */
+
+static int json_parser_reset(json_parser_t *parser)
+{
+    parser->state = JSON_PARSER_STATE_VALUE;
+    parser->stack.depth = 0;
+    parser->token = JSON_PARSER_TOKEN_NONE;
+    parser->escape = 0;
+    parser->token_len = 0;
+    return json_builder_init(&parser->builder, parser->flags);
+}
+
+json_parser_t *json_parser_new(unsigned int flags)
+{
+    json_parser_t *new_parser = NULL;
+
+    if ((new_parser = (json_parser_t *)malloc(sizeof(json_parser_t))) == NULL)
+    { return NULL; }
+    /* Chunks do not outlive the feed, so strings are always copied */
+    new_parser->flags = flags & ~(unsigned int)JSON_LOAD_INSITU;
+    json_stack_init(&new_parser->stack, 0);
+    new_parser->token_buf = NULL;
+    new_parser->token_capacity = 0;
+    if (json_parser_reset(new_parser) != 0)
+    { free(new_parser); return NULL; }
+
+    return new_parser;
+}
+
+void json_parser_destroy(json_parser_t *parser)
+{
+    json_builder_fini(&parser->builder);
+    json_stack_fini(&parser->stack);
+    if (parser->token_buf != NULL) free(parser->token_buf);
+    free(parser);
+}
+
+int json_parser_feed(json_parser_t *parser, char *chunk, size_t len)
+{
+    char *str_p = chunk;
+    char *str_endp = chunk + len;
+
+    if (parser->state == JSON_PARSER_STATE_FAILED) return -1;
+
+    if ((parser->token != JSON_PARSER_TOKEN_NONE) && (str_p != str_endp))
+    {
+        if (json_parser_token_continue(parser, &str_p, str_endp) != 0)
+        { goto fail; }
+    }
+
+    while ((str_p != str_endp) && (parser->token == JSON_PARSER_TOKEN_NONE))
+    {
+        /* Whitespace between tokens carries no state across chunks */
+        JSON_SKIP_WHITESPACE(str_p, str_endp);
+        if (str_p == str_endp) break;
+        if (json_parser_step(parser, &str_p, str_endp) != 0)
+        { goto fail; }
+    }
+
+    return 0;
+fail:
+    parser->state = JSON_PARSER_STATE_FAILED;
+    return -1;
+}
+
+/* Completes the document fed so far; the parser is then ready for the
+ * next one, keeping its buffers */
+int json_parser_finish(json_parser_t *parser, json_t **json_out)
+{
+    int ret = 0;
+
+    if (parser->state == JSON_PARSER_STATE_FAILED)
+    { ret = -1; goto done; }
+
+    /* A trailing number or literal ends with the input */
+    if ((parser->token == JSON_PARSER_TOKEN_NUMBER) || \
+            (parser->token == JSON_PARSER_TOKEN_LITERAL))
+    {
+        if ((ret = json_parser_token_emit(parser, parser->token_buf, \
+                        parser->token_buf + parser->token_len)) != 0)
+        { goto done; }
+    }
+    if (parser->state != JSON_PARSER_STATE_DONE)
+    { ret = -1; goto done; }
+
+    ret = json_builder_finish(&parser->builder, json_out);
+
+done:
+    json_builder_fini(&parser->builder);
+    if (json_parser_reset(parser) != 0)
+    {
+        parser->state = JSON_PARSER_STATE_FAILED;
+        ret = -1;
+    }
+    return ret;
+}
@@ -0,0 +1,143 @@
+/* JSON Library - JSON Pointer */
+
+/* RFC 6901 pointers, such as "/a/b/3", compiled once and evaluated
+ * many times.
+ *
+ * Compiling splits the pointer at its slashes, decodes ~1 and ~0 in
+ * each token and works out what evaluation would otherwise redo on
+ * every call: the hash an object's key index probes with, and the
+ * array index the token spells, if any. Everything lives in the one
+ * block json_pointer_compile allocates. json_pointer_get only steps
+ * from node to node: it probes an object's key index when an earlier
+ * json_node_object_get built one and scans the members otherwise, but
+ * never builds one itself, so it neither parses, allocates nor writes
+ * to the document. */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "json_internal.h"
+
+#define JSON_POINTER_NO_INDEX ((size_t)-1)
+
+typedef struct json_pointer_token
+{
+    const char *key;
+    size_t len;
+    size_t hash;
+    /* JSON_POINTER_NO_INDEX when the token is no array index */
+    size_t index;
+} json_pointer_token_t;
+
+struct json_pointer
+{
+    size_t count;
+    json_pointer_token_t *tokens;
+};
+
+/* The array index a token spells: digits without a leading zero */
+static size_t json_pointer_index(const char *key, size_t len)
+{
+    size_t index = 0, idx;
+
+    if ((len == 0) || ((key[0] == '0') && (len != 1)))
+    { return JSON_POINTER_NO_INDEX; }
+    for (idx = 0; idx != len; idx++)
+    {
+        if (!IS_DIGIT(key[idx])) return JSON_POINTER_NO_INDEX;
+        if (index > (JSON_POINTER_NO_INDEX - 1 - (size_t)(key[idx] - '0')) / 10)
+        { return JSON_POINTER_NO_INDEX; }
+        index = index * 10 + (size_t)(key[idx] - '0');
+    }
+    return index;
+}
+
+json_pointer_t *json_pointer_compile(const char *str, size_t len)
+{
+    json_pointer_t *pointer;
+    json_pointer_token_t *token;
+    const char *str_p, *str_endp = str + len;
+    char *key_p;
+    size_t count = 0, idx;
+
+    /* The empty pointer is the whole document */
+    if ((len != 0) && (str[0] != '/')) return NULL;
+    for (idx = 0; idx != len; idx++)
+    {
+        if (str[idx] == '/') count++;
+    }
+
+    /* Header, tokens, then the decoded keys, never longer than str */
+    if ((pointer = (json_pointer_t *)malloc(sizeof(json_pointer_t) + \
+                    sizeof(json_pointer_token_t) * count + len)) == NULL)
+    { return NULL; }
+    pointer->count = count;
+    pointer->tokens = (json_pointer_token_t *)(pointer + 1);
+    key_p = (char *)(pointer->tokens + count);
+
+    token = pointer->tokens;
+    for (str_p = str; str_p != str_endp; token++)
+    {
+        /* Skip / */
+        str_p++;
+        token->key = key_p;
+        while ((str_p != str_endp) && (*str_p != '/'))
+        {
+            if (*str_p != '~')
+            {
+                *key_p++ = *str_p++;
+                continue;
+            }
+            if ((str_endp - str_p < 2) || ((str_p[1] != '0') && (str_p[1] != '1')))
+            {
+                free(pointer);
+                return NULL;
+            }
+            *key_p++ = (str_p[1] == '0') ? '~' : '/';
+            str_p += 2;
+        }
+        token->len = (size_t)(key_p - token->key);
+        token->hash = json_key_hash(token->key, token->len);
+        token->index = json_pointer_index(token->key, token->len);
+    }
+
+    return pointer;
+}
+
+void json_pointer_destroy(json_pointer_t *pointer)
+{
+    free(pointer);
+}
+
+json_node_t *json_pointer_get(json_t *json, const json_pointer_t *pointer)
+{
+    json_node_t *node = json->root;
+    const json_pointer_token_t *token = pointer->tokens;
+    const json_pointer_token_t *token_endp = token + pointer->count;
+
+    for (; (node != NULL) && (token != token_endp); token++)
+    {
+        switch (node->type)
+        {
+            case JSON_NODE_TYPE_OBJECT:
+                node = json_node_object_get_hashed(node, token->key, \
+                        token->len, token->hash);
+                break;
+            case JSON_NODE_TYPE_ARRAY:
+                if (token->index >= node->u.array_part->size) return NULL;
+                node = node->u.array_part->items[token->index];
+                break;
+            case JSON_NODE_TYPE_STRING:
+            case JSON_NODE_TYPE_INTEGER:
+            case JSON_NODE_TYPE_DOUBLE:
+            case JSON_NODE_TYPE_FALSE:
+            case JSON_NODE_TYPE_TRUE:
+            case JSON_NODE_TYPE_NULL:
+            case JSON_NODE_TYPE_UNKNOWN:
+                return NULL;
+        }
+    }
+    return node;
+}
@@ -0,0 +1,621 @@
+/* JSON Library string scanning kernels */
+
+/* String bodies are scanned for the bytes that end a plain run: the
+ * closing quote, a backslash starting an escape, or a control
+ * character. The vector kernels test 16 or 32 bytes per step; the
+ * widest one the CPU supports is picked on first use.
+ *
+ * Loading scans with a variant that also validates UTF-8 on the way:
+ * blocks of plain ASCII cost one extra movemask, and only blocks with
+ * multi-byte characters go through the check. The AVX2 check is the
+ * Keiser-Lemire one: three nibble lookups classify every byte against
+ * the one before it, and two saturating subtractions catch the third
+ * and fourth bytes of a sequence. Without AVX2 each multi-byte
+ * character is checked by the scalar rules.
+ *
+ * Whitespace between tokens is skipped the same way, a vector at a
+ * time, so indented documents do not pay per byte for their padding.
+ *
+ * The block classifier feeds the structural index: it turns 64 input
+ * bytes into one bit mask each for backslashes, quotes, whitespace and
+ * the structural characters { } [ ] : , */
+
+
+#include <stddef.h>
+#include <string.h>
+
+#include "json_internal.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define JSON_SIMD_X86
+#include <immintrin.h>
+#endif
+
+#define IS_STRING_SPECIAL(ch) \
+    (((ch) == '\"') || ((ch) == '\\') || ((unsigned char)(ch) < 0x20))
+/* '[' and '{', ']' and '}' differ only in bit 0x20 */
+#define IS_STRUCTURAL(ch) \
+    ((((ch) | 0x20) == '{') || (((ch) | 0x20) == '}') || \
+     ((ch) == ':') || ((ch) == ','))
+
+static size_t json_simd_scan_string_scalar(const char *str, size_t len)
+{
+    size_t idx;
+
+    for (idx = 0; idx != len; idx++)
+    {
+        if (IS_STRING_SPECIAL(str[idx])) break;
+    }
+    return idx;
+}
+
+/* Length of the well-formed UTF-8 sequence at str, 0 if there is none */
+static size_t json_simd_utf8_sequence(const unsigned char *str, size_t len)
+{
+    unsigned char lead = str[0];
+    unsigned char low = 0x80, high = 0xbf;
+    size_t need, idx;
+
+    if (lead < 0x80) return 1;
+    if (lead < 0xc2) return 0;
+    if (lead < 0xe0)
+    { need = 1; }
+    else if (lead < 0xf0)
+    {
+        need = 2;
+        /* No overlong forms, no UTF-16 surrogates */
+        if (lead == 0xe0) low = 0xa0;
+        else if (lead == 0xed) high = 0x9f;
+    }
+    else if (lead < 0xf5)
+    {
+        need = 3;
+        /* No overlong forms, nothing past U+10FFFF */
+        if (lead == 0xf0) low = 0x90;
+        else if (lead == 0xf4) high = 0x8f;
+    }
+    else
+    { return 0; }
+
+    if (len <= need) return 0;
+    if ((str[1] < low) || (str[1] > high)) return 0;
+    for (idx = 2; idx <= need; idx++)
+    {
+        if ((str[idx] & 0xc0) != 0x80) return 0;
+    }
+    return need + 1;
+}
+
+static size_t json_simd_scan_string_utf8_scalar(const char *str, size_t len)
+{
+    const unsigned char *ustr = (const unsigned char *)str;
+    size_t idx = 0, seq;
+
+    while (idx != len)
+    {
+        if (ustr[idx] < 0x80)
+        {
+            if (IS_STRING_SPECIAL(str[idx])) break;
+            idx++;
+        }
+        else
+        {
+            if ((seq = json_simd_utf8_sequence(ustr + idx, len - idx)) == 0)
+            { break; }
+            idx += seq;
+        }
+    }
+    return idx;
+}
+
+static size_t json_simd_skip_whitespace_scalar(const char *str, size_t len)
+{
+    size_t idx;
+
+    for (idx = 0; idx != len; idx++)
+    {
+        if (!IS_WHITESPACE(str[idx])) break;
+    }
+    return idx;
+}
+
+static void json_simd_classify_scalar(const char *block, \
+        json_simd_masks_t *masks)
+{
+    unsigned int idx;
+    uint64_t bit;
+
+    masks->quote = 0;
+    masks->backslash = 0;
+    masks->whitespace = 0;
+    masks->structural = 0;
+    for (idx = 0; idx != 64; idx++)
+    {
+        bit = (uint64_t)1 << idx;
+        if (block[idx] == '\"') masks->quote |= bit;
+        else if (block[idx] == '\\') masks->backslash |= bit;
+        else if (IS_WHITESPACE(block[idx])) masks->whitespace |= bit;
+        else if (IS_STRUCTURAL(block[idx])) masks->structural |= bit;
+    }
+}
+
+#ifdef JSON_SIMD_X86
+
+__attribute__((target("sse2")))
+static size_t json_simd_scan_string_sse2(const char *str, size_t len)
+{
+    const __m128i quote = _mm_set1_epi8('\"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1f);
+    __m128i chunk, hit;
+    unsigned int mask;
+    size_t idx = 0;
+
+    for (; len - idx >= 16; idx += 16)
+    {
+        chunk = _mm_loadu_si128((const __m128i *)(const void *)(str + idx));
+        hit = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), \
+                _mm_cmpeq_epi8(chunk, backslash));
+        /* Unsigned ch <= 0x1f exactly when max(ch, 0x1f) == 0x1f */
+        hit = _mm_or_si128(hit, \
+                _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control));
+        mask = (unsigned int)_mm_movemask_epi8(hit);
+        if (mask != 0) return idx + (size_t)__builtin_ctz(mask);
+    }
+    return idx + json_simd_scan_string_scalar(str + idx, len - idx);
+}
+
+__attribute__((target("avx2")))
+static size_t json_simd_scan_string_avx2(const char *str, size_t len)
+{
+    const __m256i quote = _mm256_set1_epi8('\"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i control = _mm256_set1_epi8(0x1f);
+    __m256i chunk, hit;
+    unsigned int mask;
+    size_t idx = 0;
+
+    for (; len - idx >= 32; idx += 32)
+    {
+        chunk = _mm256_loadu_si256((const __m256i *)(const void *)(str + idx));
+        hit = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), \
+                _mm256_cmpeq_epi8(chunk, backslash));
+        hit = _mm256_or_si256(hit, \
+                _mm256_cmpeq_epi8(_mm256_max_epu8(chunk, control), control));
+        mask = (unsigned int)_mm256_movemask_epi8(hit);
+        if (mask != 0) return idx + (size_t)__builtin_ctz(mask);
+    }
+    return idx + json_simd_scan_string_sse2(str + idx, len - idx);
+}
+
+__attribute__((target("sse2")))
+static size_t json_simd_scan_string_utf8_sse2(const char *str, size_t len)
+{
+    const __m128i quote = _mm_set1_epi8('\"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1f);
+    __m128i chunk, hit;
+    unsigned int mask;
+    size_t idx = 0, seq;
+
+    while (len - idx >= 16)
+    {
+        chunk = _mm_loadu_si128((const __m128i *)(const void *)(str + idx));
+        hit = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), \
+                _mm_cmpeq_epi8(chunk, backslash));
+        hit = _mm_or_si128(hit, \
+                _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control));
+        /* Special bytes and the top bit of every non-ASCII one */
+        mask = (unsigned int)_mm_movemask_epi8(hit) | \
+               (unsigned int)_mm_movemask_epi8(chunk);
+        if (mask == 0)
+        { idx += 16; continue; }
+
+        idx += (size_t)__builtin_ctz(mask);
+        if ((unsigned char)str[idx] < 0x80) return idx;
+        if ((seq = json_simd_utf8_sequence((const unsigned char *)str + idx, \
+                        len - idx)) == 0)
+        { return idx; }
+        idx += seq;
+    }
+    return idx + json_simd_scan_string_utf8_scalar(str + idx, len - idx);
+}
+
+#define JSON_UTF8_TABLE(...) _mm256_setr_epi8(__VA_ARGS__, __VA_ARGS__)
+
+/* Nonzero bytes where input, preceded by prev, is not UTF-8 */
+__attribute__((target("avx2")))
+static __m256i json_simd_utf8_check_avx2(__m256i input, __m256i prev)
+{
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    /* Each table maps a nibble to the set of errors it allows: bit 0
+     * a lead not followed by a continuation, bit 1 a continuation
+     * after ASCII, bits 2, 5 and 6 overlong forms (6 also values past
+     * U+10FFFF), bit 3 values past U+10FFFF, bit 4 surrogates and bit
+     * 7 two continuations in a row. A byte is wrong where all three
+     * agree. First by the high nibble of the previous byte */
+    const __m256i byte_1_high = JSON_UTF8_TABLE(
+            2, 2, 2, 2, 2, 2, 2, 2,
+            (char)128, (char)128, (char)128, (char)128,
+            33, 1, 21, 73);
+    /* By the low nibble of the previous byte */
+    const __m256i byte_1_low = JSON_UTF8_TABLE(
+            (char)231, (char)163, (char)131, (char)131,
+            (char)139, (char)203, (char)203, (char)203,
+            (char)203, (char)203, (char)203, (char)203,
+            (char)203, (char)219, (char)203, (char)203);
+    /* By the high nibble of the byte itself */
+    const __m256i byte_2_high = JSON_UTF8_TABLE(
+            1, 1, 1, 1, 1, 1, 1, 1,
+            (char)230, (char)174, (char)186, (char)186,
+            1, 1, 1, 1);
+    __m256i carried = _mm256_permute2x128_si256(prev, input, 0x21);
+    __m256i prev1 = _mm256_alignr_epi8(input, carried, 16 - 1);
+    __m256i prev2 = _mm256_alignr_epi8(input, carried, 16 - 2);
+    __m256i prev3 = _mm256_alignr_epi8(input, carried, 16 - 3);
+    __m256i special, must_continue;
+
+    special = _mm256_and_si256( \
+            _mm256_and_si256( \
+                _mm256_shuffle_epi8(byte_1_high, \
+                    _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)), \
+                _mm256_shuffle_epi8(byte_1_low, \
+                    _mm256_and_si256(prev1, nibble))), \
+            _mm256_shuffle_epi8(byte_2_high, \
+                _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+    /* Bytes two after a 3- or 4-byte lead or three after a 4-byte
+     * lead have to be continuations */
+    must_continue = _mm256_and_si256( \
+            _mm256_or_si256( \
+                _mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xe0 - 0x80))), \
+                _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xf0 - 0x80)))), \
+            _mm256_set1_epi8((char)0x80));
+    return _mm256_xor_si256(must_continue, special);
+}
+
+/* Bytes kept by the block holding the stop: 32 ones, then 32 zeros */
+static const unsigned char json_simd_keep[64] =
+{
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+};
+
+/* The vector check found an error in the block at idx or in a
+ * sequence cut by its start; find it with the scalar rules from the
+ * first character that starts in the three bytes before the block */
+static size_t json_simd_utf8_error(const char *str, size_t len, size_t idx)
+{
+    size_t from = (idx < 3) ? 0 : idx - 3;
+
+    while ((from != idx) && (((unsigned char)str[from] & 0xc0) == 0x80))
+    { from++; }
+    return from + json_simd_scan_string_utf8_scalar(str + from, len - from);
+}
+
+__attribute__((target("avx2")))
+static size_t json_simd_scan_string_utf8_avx2(const char *str, size_t len)
+{
+    const __m256i quote = _mm256_set1_epi8('\"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i control = _mm256_set1_epi8(0x1f);
+    /* A sequence cut by the end of a block: the last three bytes must
+     * not start one longer than what is left of the block */
+    const __m256i incomplete_max = _mm256_setr_epi8(
+            -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+            -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+            (char)(0xf0 - 1), (char)(0xe0 - 1), (char)(0xc0 - 1));
+    __m256i chunk, hit, prev = _mm256_setzero_si256();
+    __m256i incomplete = _mm256_setzero_si256();
+    unsigned char tail[32];
+    unsigned int mask, stop;
+    size_t idx = 0;
+
+    for (;;)
+    {
+        if (len - idx >= 32)
+        { chunk = _mm256_loadu_si256((const __m256i *)(const void *)(str + idx)); }
+        else
+        {
+            /* The last block, padded with NULs: they count as control
+             * characters, so the stop is found within it */
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, str + idx, len - idx);
+            chunk = _mm256_loadu_si256((const __m256i *)(const void *)tail);
+        }
+        hit = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), \
+                _mm256_cmpeq_epi8(chunk, backslash));
+        hit = _mm256_or_si256(hit, \
+                _mm256_cmpeq_epi8(_mm256_max_epu8(chunk, control), control));
+        mask = (unsigned int)_mm256_movemask_epi8(hit);
+
+        if (mask != 0)
+        {
+            /* Check only what comes before the stop; an ASCII stop
+             * after it cuts any sequence still open */
+            stop = (unsigned int)__builtin_ctz(mask);
+            chunk = _mm256_and_si256(chunk, _mm256_loadu_si256( \
+                        (const __m256i *)(const void *)(json_simd_keep + 32 - stop)));
+            if ((_mm256_movemask_epi8(chunk) != 0) || \
+                    !_mm256_testz_si256(incomplete, incomplete))
+            {
+                hit = json_simd_utf8_check_avx2(chunk, prev);
+                if (!_mm256_testz_si256(hit, hit))
+                { return json_simd_utf8_error(str, len, idx); }
+            }
+            return idx + stop;
+        }
+
+        if ((_mm256_movemask_epi8(chunk) != 0) || \
+                !_mm256_testz_si256(incomplete, incomplete))
+        {
+            hit = json_simd_utf8_check_avx2(chunk, prev);
+            if (!_mm256_testz_si256(hit, hit))
+            { return json_simd_utf8_error(str, len, idx); }
+            incomplete = _mm256_subs_epu8(chunk, incomplete_max);
+        }
+        prev = chunk;
+        idx += 32;
+    }
+}
+
+__attribute__((target("sse2")))
+static size_t json_simd_skip_whitespace_sse2(const char *str, size_t len)
+{
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i carriage = _mm_set1_epi8('\r');
+    __m128i chunk, hit;
+    unsigned int mask;
+    size_t idx = 0;
+
+    for (; len - idx >= 16; idx += 16)
+    {
+        chunk = _mm_loadu_si128((const __m128i *)(const void *)(str + idx));
+        hit = _mm_or_si128( \
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, space), \
+                    _mm_cmpeq_epi8(chunk, tab)), \
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, newline), \
+                    _mm_cmpeq_epi8(chunk, carriage)));
+        mask = (unsigned int)_mm_movemask_epi8(hit) ^ 0xffffu;
+        if (mask != 0) return idx + (size_t)__builtin_ctz(mask);
+    }
+    return idx + json_simd_skip_whitespace_scalar(str + idx, len - idx);
+}
+
+__attribute__((target("avx2")))
+static size_t json_simd_skip_whitespace_avx2(const char *str, size_t len)
+{
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i carriage = _mm256_set1_epi8('\r');
+    __m256i chunk, hit;
+    unsigned int mask;
+    size_t idx = 0;
+
+    for (; len - idx >= 32; idx += 32)
+    {
+        chunk = _mm256_loadu_si256((const __m256i *)(const void *)(str + idx));
+        hit = _mm256_or_si256( \
+                _mm256_or_si256(_mm256_cmpeq_epi8(chunk, space), \
+                    _mm256_cmpeq_epi8(chunk, tab)), \
+                _mm256_or_si256(_mm256_cmpeq_epi8(chunk, newline), \
+                    _mm256_cmpeq_epi8(chunk, carriage)));
+        mask = ~(unsigned int)_mm256_movemask_epi8(hit);
+        if (mask != 0) return idx + (size_t)__builtin_ctz(mask);
+    }
+    return idx + json_simd_skip_whitespace_sse2(str + idx, len - idx);
+}
+
+__attribute__((target("sse2")))
+static void json_simd_classify_sse2(const char *block, json_simd_masks_t *masks)
+{
+    const __m128i quote = _mm_set1_epi8('\"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i lower = _mm_set1_epi8(0x20);
+    const __m128i open = _mm_set1_epi8('{');
+    const __m128i close = _mm_set1_epi8('}');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i carriage = _mm_set1_epi8('\r');
+    __m128i chunk, folded, hit;
+    uint64_t quote_bits = 0, backslash_bits = 0, structural_bits = 0;
+    uint64_t whitespace_bits = 0;
+    unsigned int shift;
+
+    for (shift = 0; shift != 64; shift += 16)
+    {
+        chunk = _mm_loadu_si128((const __m128i *)(const void *)(block + shift));
+        folded = _mm_or_si128(chunk, lower);
+        hit = _mm_or_si128( \
+                _mm_or_si128(_mm_cmpeq_epi8(folded, open), \
+                    _mm_cmpeq_epi8(folded, close)), \
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, colon), \
+                    _mm_cmpeq_epi8(chunk, comma)));
+        structural_bits |= (uint64_t)(unsigned int)_mm_movemask_epi8(hit) << shift;
+        quote_bits |= (uint64_t)(unsigned int)_mm_movemask_epi8( \
+                _mm_cmpeq_epi8(chunk, quote)) << shift;
+        backslash_bits |= (uint64_t)(unsigned int)_mm_movemask_epi8( \
+                _mm_cmpeq_epi8(chunk, backslash)) << shift;
+        hit = _mm_or_si128( \
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, space), \
+                    _mm_cmpeq_epi8(chunk, tab)), \
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, newline), \
+                    _mm_cmpeq_epi8(chunk, carriage)));
+        whitespace_bits |= (uint64_t)(unsigned int)_mm_movemask_epi8(hit) << shift;
+    }
+    masks->quote = quote_bits;
+    masks->backslash = backslash_bits;
+    masks->whitespace = whitespace_bits;
+    masks->structural = structural_bits;
+}
+
+__attribute__((target("avx2")))
+static void json_simd_classify_avx2(const char *block, json_simd_masks_t *masks)
+{
+    const __m256i quote = _mm256_set1_epi8('\"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i lower = _mm256_set1_epi8(0x20);
+    const __m256i open = _mm256_set1_epi8('{');
+    const __m256i close = _mm256_set1_epi8('}');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i carriage = _mm256_set1_epi8('\r');
+    __m256i chunk, folded, hit;
+    uint64_t quote_bits = 0, backslash_bits = 0, structural_bits = 0;
+    uint64_t whitespace_bits = 0;
+    unsigned int shift;
+
+    for (shift = 0; shift != 64; shift += 32)
+    {
+        chunk = _mm256_loadu_si256((const __m256i *)(const void *)(block + shift));
+        folded = _mm256_or_si256(chunk, lower);
+        hit = _mm256_or_si256( \
+                _mm256_or_si256(_mm256_cmpeq_epi8(folded, open), \
+                    _mm256_cmpeq_epi8(folded, close)), \
+                _mm256_or_si256(_mm256_cmpeq_epi8(chunk, colon), \
+                    _mm256_cmpeq_epi8(chunk, comma)));
+        structural_bits |= (uint64_t)(unsigned int)_mm256_movemask_epi8(hit) << shift;
+        quote_bits |= (uint64_t)(unsigned int)_mm256_movemask_epi8( \
+                _mm256_cmpeq_epi8(chunk, quote)) << shift;
+        backslash_bits |= (uint64_t)(unsigned int)_mm256_movemask_epi8( \
+                _mm256_cmpeq_epi8(chunk, backslash)) << shift;
+        hit = _mm256_or_si256( \
+                _mm256_or_si256(_mm256_cmpeq_epi8(chunk, space), \
+                    _mm256_cmpeq_epi8(chunk, tab)), \
+                _mm256_or_si256(_mm256_cmpeq_epi8(chunk, newline), \
+                    _mm256_cmpeq_epi8(chunk, carriage)));
+        whitespace_bits |= (uint64_t)(unsigned int)_mm256_movemask_epi8(hit) << shift;
+    }
+    masks->quote = quote_bits;
+    masks->backslash = backslash_bits;
+    masks->whitespace = whitespace_bits;
+    masks->structural = structural_bits;
+}
+
+#endif
+
+typedef size_t (*json_simd_scan_fn_t)(const char *str, size_t len);
+
+static size_t json_simd_scan_string_resolve(const char *str, size_t len);
+
+static json_simd_scan_fn_t json_simd_scan_string_fn = \
+        json_simd_scan_string_resolve;
+
+/* The first call of each kernel picks the variant the CPU runs and
+ * patches it in. Threads may resolve at once, storing the same
+ * pointer; the pointers are read and written atomically, relaxed being
+ * enough since nothing else is published through them. */
+static size_t json_simd_scan_string_resolve(const char *str, size_t len)
+{
+    json_simd_scan_fn_t fn = json_simd_scan_string_scalar;
+
+#ifdef JSON_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    { fn = json_simd_scan_string_avx2; }
+    else if (__builtin_cpu_supports("sse2"))
+    { fn = json_simd_scan_string_sse2; }
+#endif
+
+    __atomic_store_n(&json_simd_scan_string_fn, fn, __ATOMIC_RELAXED);
+    return fn(str, len);
+}
+
+size_t json_simd_scan_string(const char *str, size_t len)
+{
+    return __atomic_load_n(&json_simd_scan_string_fn, __ATOMIC_RELAXED)(str, len);
+}
+
+static size_t json_simd_scan_string_utf8_resolve(const char *str, size_t len);
+
+static json_simd_scan_fn_t json_simd_scan_string_utf8_fn = \
+        json_simd_scan_string_utf8_resolve;
+
+static size_t json_simd_scan_string_utf8_resolve(const char *str, size_t len)
+{
+    json_simd_scan_fn_t fn = json_simd_scan_string_utf8_scalar;
+
+#ifdef JSON_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    { fn = json_simd_scan_string_utf8_avx2; }
+    else if (__builtin_cpu_supports("sse2"))
+    { fn = json_simd_scan_string_utf8_sse2; }
+#endif
+
+    __atomic_store_n(&json_simd_scan_string_utf8_fn, fn, __ATOMIC_RELAXED);
+    return fn(str, len);
+}
+
+size_t json_simd_scan_string_utf8(const char *str, size_t len)
+{
+    return __atomic_load_n(&json_simd_scan_string_utf8_fn, __ATOMIC_RELAXED)(str, len);
+}
+
+static size_t json_simd_skip_whitespace_resolve(const char *str, size_t len);
+
+static json_simd_scan_fn_t json_simd_skip_whitespace_fn = \
+        json_simd_skip_whitespace_resolve;
+
+static size_t json_simd_skip_whitespace_resolve(const char *str, size_t len)
+{
+    json_simd_scan_fn_t fn = json_simd_skip_whitespace_scalar;
+
+#ifdef JSON_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    { fn = json_simd_skip_whitespace_avx2; }
+    else if (__builtin_cpu_supports("sse2"))
+    { fn = json_simd_skip_whitespace_sse2; }
+#endif
+
+    __atomic_store_n(&json_simd_skip_whitespace_fn, fn, __ATOMIC_RELAXED);
+    return fn(str, len);
+}
+
+size_t json_simd_skip_whitespace(const char *str, size_t len)
+{
+    return __atomic_load_n(&json_simd_skip_whitespace_fn, __ATOMIC_RELAXED)(str, len);
+}
+
+typedef void (*json_simd_classify_fn_t)(const char *block, \
+        json_simd_masks_t *masks);
+
+static void json_simd_classify_resolve(const char *block, \
+        json_simd_masks_t *masks);
+
+static json_simd_classify_fn_t json_simd_classify_fn = \
+        json_simd_classify_resolve;
+
+static void json_simd_classify_resolve(const char *block, \
+        json_simd_masks_t *masks)
+{
+    json_simd_classify_fn_t fn = json_simd_classify_scalar;
+
+#ifdef JSON_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    { fn = json_simd_classify_avx2; }
+    else if (__builtin_cpu_supports("sse2"))
+    { fn = json_simd_classify_sse2; }
+#endif
+
+    __atomic_store_n(&json_simd_classify_fn, fn, __ATOMIC_RELAXED);
+    fn(block, masks);
+}
+
+void json_simd_classify(const char *block, json_simd_masks_t *masks)
+{
+    __atomic_load_n(&json_simd_classify_fn, __ATOMIC_RELAXED)(block, masks);
+}
+
@@ -0,0 +1,630 @@
+/* JSON Library - tape */
+
+/* A tape is a document flattened into one buffer with no pointers in
+ * it, so it can be written to a file and mapped, by any number of
+ * processes at once, and read where it lies: there is no load step.
+ *
+ * The buffer is a header, an array of 16 byte entries, then a pool of
+ * string bytes, each string NUL-terminated. An entry is a tag word,
+ * its node type in the low byte and its size above, and a value word:
+ *
+ *   integer, double   the 64 bits of the number
+ *   string            length in the tag, pool offset in the value
+ *   array             item count in the tag, the entry its items
+ *                     start at in the value
+ *   object            member count in the tag, the entry its members
+ *                     start at in the value, a key then a value each
+ *
+ * A container's members are thus side by side, which makes an array
+ * index a single step. An object with more than
+ * JSON_TAPE_INDEX_THRESHOLD members is followed by a hash table of its
+ * keys, the same open addressing the tree's objects use, so looking a
+ * key up does not scan them. Entry 0 is the root.
+ *
+ * Words are in the byte order and size of the machine that wrote the
+ * tape, which the header records; opening it anywhere else fails. Only
+ * the header is checked at open, to leave pages the reader never
+ * touches unread. Each read checks the entries and bytes it uses
+ * instead, so a damaged tape makes reads fail, never go out of the
+ * buffer. */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "json_internal.h"
+
+#define JSON_TAPE_MAGIC "JSNT"
+#define JSON_TAPE_MAGIC_LEN ((size_t)4)
+#define JSON_TAPE_VERSION 1
+#define JSON_TAPE_ORDER 0x0102
+#define JSON_TAPE_INDEX_THRESHOLD ((size_t)8)
+#define JSON_TAPE_STACK_MIN ((size_t)16)
+
+typedef struct json_tape_header
+{
+    char magic[4];
+    uint16_t order;
+    uint8_t version;
+    uint8_t word;
+    uint64_t count;
+    uint64_t pool_len;
+} json_tape_header_t;
+
+typedef struct json_tape_entry
+{
+    uint64_t tag;
+    uint64_t value;
+} json_tape_entry_t;
+
+struct json_tape
+{
+    const json_tape_entry_t *entries;
+    size_t count;
+    const char *pool;
+    size_t pool_len;
+    /* Set when the tape maps a file of its own */
+    void *mapping;
+    size_t mapping_len;
+};
+
+#define JSON_TAPE_TYPE(entry) ((json_node_type_t)((entry)->tag & 0xff))
+#define JSON_TAPE_SIZE(entry) ((size_t)((entry)->tag >> 8))
+
+/* Slots of the key table of an object of size members, 0 for none */
+static size_t json_tape_index_capacity(size_t size)
+{
+    size_t capacity;
+
+    if (size <= JSON_TAPE_INDEX_THRESHOLD) return 0;
+    capacity = JSON_TAPE_INDEX_THRESHOLD * 4;
+    while (capacity < size * 2) capacity *= 2;
+    return capacity;
+}
+
+/* Entries a container's members take, with the key table after them;
+ * two table slots fit in an entry */
+static size_t json_tape_block_length(json_node_type_t type, size_t size)
+{
+    if (type == JSON_NODE_TYPE_ARRAY) return size;
+    return size * 2 + (json_tape_index_capacity(size) + 1) / 2;
+}
+
+
+/* Dump
+ *
+ * A first walk counts the entries and pool bytes, a second fills a
+ * buffer of that size. Each container is handed the next free run of
+ * entries for its members, before any of theirs. */
+
+typedef struct json_tape_writer
+{
+    json_tape_entry_t *entries;
+    size_t next;
+    char *pool;
+    size_t pool_len;
+} json_tape_writer_t;
+
+static int json_tape_length(json_node_t *node, size_t *count_io, \
+        size_t *pool_len_io)
+{
+    json_node_object_node_t *member;
+    size_t idx;
+
+    switch (node->type)
+    {
+        case JSON_NODE_TYPE_NULL:
+        case JSON_NODE_TYPE_FALSE:
+        case JSON_NODE_TYPE_TRUE:
+        case JSON_NODE_TYPE_INTEGER:
+        case JSON_NODE_TYPE_DOUBLE:
+            return 0;
+        case JSON_NODE_TYPE_STRING:
+            *pool_len_io += node->u.string_part.len + 1;
+            return 0;
+        case JSON_NODE_TYPE_ARRAY:
+            *count_io += json_tape_block_length(node->type, \
+                    node->u.array_part->size);
+            for (idx = 0; idx != node->u.array_part->size; idx++)
+            {
+                if (json_tape_length(node->u.array_part->items[idx], \
+                            count_io, pool_len_io) != 0)
+                { return -1; }
+            }
+            return 0;
+        case JSON_NODE_TYPE_OBJECT:
+            *count_io += json_tape_block_length(node->type, \
+                    node->u.object_part->size);
+            for (member = node->u.object_part->begin; member != NULL; \
+                    member = member->next)
+            {
+                if ((member->name->type != JSON_NODE_TYPE_STRING) || \
+                        (json_tape_length(member->name, count_io, \
+                                          pool_len_io) != 0) || \
+                        (json_tape_length(member->value, count_io, \
+                                          pool_len_io) != 0))
+                { return -1; }
+            }
+            return 0;
+        case JSON_NODE_TYPE_UNKNOWN:
+            break;
+    }
+    return -1;
+}
+
+/* The key table of the object whose members start at block */
+static void json_tape_put_index(json_tape_writer_t *writer, size_t block, \
+        size_t size)
+{
+    size_t capacity = json_tape_index_capacity(size);
+    uint64_t *slots = (uint64_t *)(writer->entries + block + size * 2);
+    const json_tape_entry_t *key, *other;
+    size_t idx, pos;
+
+    memset(slots, 0, sizeof(json_tape_entry_t) * ((capacity + 1) / 2));
+    for (idx = 0; idx != size; idx++)
+    {
+        key = writer->entries + block + idx * 2;
+        pos = json_key_hash(writer->pool + key->value, JSON_TAPE_SIZE(key)) & \
+              (capacity - 1);
+        while (slots[pos] != 0)
+        {
+            /* The first of duplicate keys is the one found */
+            other = writer->entries + block + (slots[pos] - 1) * 2;
+            if ((JSON_TAPE_SIZE(other) == JSON_TAPE_SIZE(key)) && \
+                    (memcmp(writer->pool + other->value, \
+                            writer->pool + key->value, JSON_TAPE_SIZE(key)) == 0))
+            { break; }
+            pos = (pos + 1) & (capacity - 1);
+        }
+        if (slots[pos] == 0) slots[pos] = idx + 1;
+    }
+}
+
+static void json_tape_put(json_tape_writer_t *writer, json_node_t *node, \
+        size_t at)
+{
+    json_tape_entry_t *entry = writer->entries + at;
+    json_node_object_node_t *member;
+    size_t size = 0, block, idx;
+
+    switch (node->type)
+    {
+        case JSON_NODE_TYPE_NULL:
+        case JSON_NODE_TYPE_FALSE:
+        case JSON_NODE_TYPE_TRUE:
+            entry->value = 0;
+            break;
+        case JSON_NODE_TYPE_INTEGER:
+            entry->value = (uint64_t)node->u.number_part.int_part;
+            break;
+        case JSON_NODE_TYPE_DOUBLE:
+            memcpy(&entry->value, &node->u.number_part.double_part, \
+                    sizeof(entry->value));
+            break;
+        case JSON_NODE_TYPE_STRING:
+            size = node->u.string_part.len;
+            entry->value = writer->pool_len;
+            memcpy(writer->pool + writer->pool_len, node->u.string_part.str, size);
+            writer->pool[writer->pool_len + size] = '\0';
+            writer->pool_len += size + 1;
+            break;
+        case JSON_NODE_TYPE_ARRAY:
+            size = node->u.array_part->size;
+            block = writer->next;
+            writer->next += json_tape_block_length(node->type, size);
+            entry->value = block;
+            for (idx = 0; idx != size; idx++)
+            { json_tape_put(writer, node->u.array_part->items[idx], block + idx); }
+            break;
+        case JSON_NODE_TYPE_OBJECT:
+            size = node->u.object_part->size;
+            block = writer->next;
+            writer->next += json_tape_block_length(node->type, size);
+            entry->value = block;
+            idx = block;
+            for (member = node->u.object_part->begin; member != NULL; \
+                    member = member->next)
+            {
+                json_tape_put(writer, member->name, idx++);
+                json_tape_put(writer, member->value, idx++);
+            }
+            if (json_tape_index_capacity(size) != 0)
+            { json_tape_put_index(writer, block, size); }
+            break;
+        case JSON_NODE_TYPE_UNKNOWN:
+            break;
+    }
+    entry->tag = (uint64_t)node->type | ((uint64_t)size << 8);
+}
+
+int json_tape_dump(json_t *json, char **buf_out, size_t *len_out)
+{
+    json_tape_header_t *header;
+    json_tape_writer_t writer;
+    size_t count = 1, pool_len = 0, len;
+    char *buf;
+
+    if (json_tape_length(json->root, &count, &pool_len) != 0) return -1;
+    len = sizeof(json_tape_header_t) + sizeof(json_tape_entry_t) * count + \
+          pool_len;
+    if ((buf = (char *)malloc(len)) == NULL) return -1;
+
+    header = (json_tape_header_t *)buf;
+    memcpy(header->magic, JSON_TAPE_MAGIC, JSON_TAPE_MAGIC_LEN);
+    header->order = JSON_TAPE_ORDER;
+    header->version = JSON_TAPE_VERSION;
+    header->word = (uint8_t)sizeof(size_t);
+    header->count = count;
+    header->pool_len = pool_len;
+
+    writer.entries = (json_tape_entry_t *)(header + 1);
+    writer.next = 1;
+    writer.pool = (char *)(writer.entries + count);
+    writer.pool_len = 0;
+    json_tape_put(&writer, json->root, 0);
+
+    *buf_out = buf;
+    *len_out = len;
+    return 0;
+}
+
+
+/* Reading */
+
+json_tape_t *json_tape_new(const char *buf, size_t len)
+{
+    const json_tape_header_t *header = (const json_tape_header_t *)buf;
+    json_tape_t *tape;
+    size_t count;
+
+    if ((len < sizeof(json_tape_header_t)) || \
+            (((uintptr_t)buf % sizeof(uint64_t)) != 0) || \
+            (memcmp(header->magic, JSON_TAPE_MAGIC, JSON_TAPE_MAGIC_LEN) != 0) || \
+            (header->order != JSON_TAPE_ORDER) || \
+            (header->version != JSON_TAPE_VERSION) || \
+            (header->word != sizeof(size_t)))
+    { return NULL; }
+    len -= sizeof(json_tape_header_t);
+    if ((header->count == 0) || \
+            (header->count > len / sizeof(json_tape_entry_t)))
+    { return NULL; }
+    count = (size_t)header->count;
+    if (header->pool_len != len - sizeof(json_tape_entry_t) * count)
+    { return NULL; }
+
+    if ((tape = (json_tape_t *)malloc(sizeof(json_tape_t))) == NULL)
+    { return NULL; }
+    tape->entries = (const json_tape_entry_t *)(header + 1);
+    tape->count = count;
+    tape->pool = (const char *)(tape->entries + count);
+    tape->pool_len = (size_t)header->pool_len;
+    tape->mapping = NULL;
+    tape->mapping_len = 0;
+    return tape;
+}
+
+json_tape_t *json_tape_new_file(const char *path)
+{
+    json_tape_t *tape;
+    void *mapping;
+    size_t len;
+
+    if (json_file_map(path, &mapping, &len) != 0) return NULL;
+    if ((tape = json_tape_new((const char *)mapping, len)) == NULL)
+    {
+        json_file_unmap(mapping, len);
+        return NULL;
+    }
+    tape->mapping = mapping;
+    tape->mapping_len = len;
+    return tape;
+}
+
+void json_tape_destroy(json_tape_t *tape)
+{
+    if (tape->mapping != NULL) json_file_unmap(tape->mapping, tape->mapping_len);
+    free(tape);
+}
+
+static const json_tape_entry_t *json_tape_entry(const json_tape_t *tape, \
+        size_t value)
+{
+    return (value < tape->count) ? tape->entries + value : NULL;
+}
+
+/* The members of the container at value, NULL when it is none or they
+ * run past the entries */
+static const json_tape_entry_t *json_tape_block(const json_tape_t *tape, \
+        size_t value, json_node_type_t type, size_t *size_out)
+{
+    const json_tape_entry_t *entry = json_tape_entry(tape, value);
+    size_t size;
+
+    if ((entry == NULL) || (JSON_TAPE_TYPE(entry) != type)) return NULL;
+    size = JSON_TAPE_SIZE(entry);
+    if ((size > tape->count) || (entry->value > tape->count) || \
+            (json_tape_block_length(type, size) > \
+             tape->count - (size_t)entry->value))
+    { return NULL; }
+    *size_out = size;
+    return tape->entries + entry->value;
+}
+
+json_node_type_t json_tape_type(const json_tape_t *tape, size_t value)
+{
+    const json_tape_entry_t *entry = json_tape_entry(tape, value);
+    json_node_type_t type;
+
+    if (entry == NULL) return JSON_NODE_TYPE_UNKNOWN;
+    type = JSON_TAPE_TYPE(entry);
+    switch (type)
+    {
+        case JSON_NODE_TYPE_OBJECT:
+        case JSON_NODE_TYPE_ARRAY:
+        case JSON_NODE_TYPE_STRING:
+        case JSON_NODE_TYPE_INTEGER:
+        case JSON_NODE_TYPE_DOUBLE:
+        case JSON_NODE_TYPE_FALSE:
+        case JSON_NODE_TYPE_TRUE:
+        case JSON_NODE_TYPE_NULL:
+            return type;
+        case JSON_NODE_TYPE_UNKNOWN:
+            break;
+    }
+    return JSON_NODE_TYPE_UNKNOWN;
+}
+
+size_t json_tape_size(const json_tape_t *tape, size_t value)
+{
+    json_node_type_t type = json_tape_type(tape, value);
+    size_t size;
+
+    if (((type != JSON_NODE_TYPE_ARRAY) && (type != JSON_NODE_TYPE_OBJECT)) || \
+            (json_tape_block(tape, value, type, &size) == NULL))
+    { return 0; }
+    return size;
+}
+
+size_t json_tape_array_get(const json_tape_t *tape, size_t value, size_t idx)
+{
+    const json_tape_entry_t *block;
+    size_t size;
+
+    block = json_tape_block(tape, value, JSON_NODE_TYPE_ARRAY, &size);
+    if ((block == NULL) || (idx >= size)) return JSON_TAPE_NONE;
+    return (size_t)(block - tape->entries) + idx;
+}
+
+int json_tape_get_string(const json_tape_t *tape, size_t value, \
+        const char **str_out, size_t *len_out)
+{
+    const json_tape_entry_t *entry = json_tape_entry(tape, value);
+    size_t len;
+
+    if ((entry == NULL) || (JSON_TAPE_TYPE(entry) != JSON_NODE_TYPE_STRING))
+    { return -1; }
+    len = JSON_TAPE_SIZE(entry);
+    if ((entry->value >= tape->pool_len) || \
+            (len >= tape->pool_len - (size_t)entry->value))
+    { return -1; }
+    *str_out = tape->pool + entry->value;
+    *len_out = len;
+    return 0;
+}
+
+size_t json_tape_object_member(const json_tape_t *tape, size_t value, \
+        size_t idx, const char **key_out, size_t *len_out)
+{
+    const json_tape_entry_t *block;
+    size_t size, at;
+
+    block = json_tape_block(tape, value, JSON_NODE_TYPE_OBJECT, &size);
+    if ((block == NULL) || (idx >= size)) return JSON_TAPE_NONE;
+    at = (size_t)(block - tape->entries) + idx * 2;
+    if (json_tape_get_string(tape, at, key_out, len_out) != 0)
+    { return JSON_TAPE_NONE; }
+    return at + 1;
+}
+
+size_t json_tape_object_get(const json_tape_t *tape, size_t value, \
+        const char *key, size_t len)
+{
+    const json_tape_entry_t *block;
+    const uint64_t *slots;
+    const char *name;
+    size_t size, capacity, name_len, pos, idx, value_at;
+
+    block = json_tape_block(tape, value, JSON_NODE_TYPE_OBJECT, &size);
+    if (block == NULL) return JSON_TAPE_NONE;
+
+    if ((capacity = json_tape_index_capacity(size)) != 0)
+    {
+        slots = (const uint64_t *)(block + size * 2);
+        pos = json_key_hash(key, len) & (capacity - 1);
+        for (idx = 0; (idx != capacity) && (slots[pos] != 0); idx++)
+        {
+            value_at = json_tape_object_member(tape, value, \
+                    (size_t)slots[pos] - 1, &name, &name_len);
+            if ((value_at != JSON_TAPE_NONE) && (name_len == len) && \
+                    (memcmp(name, key, len) == 0))
+            { return value_at; }
+            pos = (pos + 1) & (capacity - 1);
+        }
+        return JSON_TAPE_NONE;
+    }
+
+    for (idx = 0; idx != size; idx++)
+    {
+        value_at = json_tape_object_member(tape, value, idx, &name, &name_len);
+        if ((value_at != JSON_TAPE_NONE) && (name_len == len) && \
+                (memcmp(name, key, len) == 0))
+        { return value_at; }
+    }
+    return JSON_TAPE_NONE;
+}
+
+int json_tape_get_integer(const json_tape_t *tape, size_t value, \
+        int64_t *value_out)
+{
+    const json_tape_entry_t *entry = json_tape_entry(tape, value);
+
+    if ((entry == NULL) || (JSON_TAPE_TYPE(entry) != JSON_NODE_TYPE_INTEGER))
+    { return -1; }
+    memcpy(value_out, &entry->value, sizeof(*value_out));
+    return 0;
+}
+
+int json_tape_get_double(const json_tape_t *tape, size_t value, \
+        double *value_out)
+{
+    const json_tape_entry_t *entry = json_tape_entry(tape, value);
+
+    if ((entry == NULL) || (JSON_TAPE_TYPE(entry) != JSON_NODE_TYPE_DOUBLE))
+    { return -1; }
+    memcpy(value_out, &entry->value, sizeof(*value_out));
+    return 0;
+}
+
+
+/* Load
+ *
+ * The tree is built without recursion: a stack holds, for each open
+ * container, its entry and the member to add next. */
+
+typedef struct json_tape_frame
+{
+    size_t value;
+    size_t next;
+    size_t size;
+    json_node_type_t type;
+} json_tape_frame_t;
+
+typedef struct json_tape_loader
+{
+    const json_tape_t *tape;
+    json_builder_t builder;
+    json_tape_frame_t *frames;
+    size_t depth;
+    size_t capacity;
+} json_tape_loader_t;
+
+static int json_tape_load_value(json_tape_loader_t *loader, size_t value)
+{
+    const json_tape_t *tape = loader->tape;
+    json_builder_t *builder = &loader->builder;
+    json_tape_frame_t *new_frames;
+    json_node_type_t type = json_tape_type(tape, value);
+    const char *str;
+    size_t len, capacity;
+    int64_t int_value;
+    double double_value;
+
+    switch (type)
+    {
+        case JSON_NODE_TYPE_NULL:
+            return json_builder_sax.on_null(builder);
+        case JSON_NODE_TYPE_FALSE:
+        case JSON_NODE_TYPE_TRUE:
+            return json_builder_sax.on_bool(builder, \
+                    type == JSON_NODE_TYPE_TRUE);
+        case JSON_NODE_TYPE_INTEGER:
+            if (json_tape_get_integer(tape, value, &int_value) != 0) return -1;
+            return json_builder_sax.on_integer(builder, int_value);
+        case JSON_NODE_TYPE_DOUBLE:
+            if (json_tape_get_double(tape, value, &double_value) != 0) return -1;
+            return json_builder_sax.on_double(builder, double_value);
+        case JSON_NODE_TYPE_STRING:
+            if (json_tape_get_string(tape, value, &str, &len) != 0) return -1;
+            return json_builder_string(builder, (char *)str, len, 0);
+        case JSON_NODE_TYPE_ARRAY:
+            if ((json_tape_block(tape, value, type, &len) == NULL) || \
+                    (json_builder_sax.on_start_array(builder) != 0))
+            { return -1; }
+            if ((len != 0) && (json_node_array_reserve( \
+                            builder->stack[builder->depth - 1], len) != 0))
+            { return -1; }
+            break;
+        case JSON_NODE_TYPE_OBJECT:
+            if ((json_tape_block(tape, value, type, &len) == NULL) || \
+                    (json_builder_sax.on_start_object(builder) != 0))
+            { return -1; }
+            break;
+        case JSON_NODE_TYPE_UNKNOWN:
+            return -1;
+    }
+
+    if (loader->depth == JSON_DEPTH_DEFAULT) return -1;
+    if (loader->depth == loader->capacity)
+    {
+        capacity = loader->capacity * 2;
+        if (capacity < JSON_TAPE_STACK_MIN) capacity = JSON_TAPE_STACK_MIN;
+        if ((new_frames = (json_tape_frame_t *)realloc(loader->frames, \
+                        sizeof(json_tape_frame_t) * capacity)) == NULL)
+        { return -1; }
+        loader->frames = new_frames;
+        loader->capacity = capacity;
+    }
+    loader->frames[loader->depth].value = value;
+    loader->frames[loader->depth].next = 0;
+    loader->frames[loader->depth].size = len;
+    loader->frames[loader->depth].type = type;
+    loader->depth++;
+    return 0;
+}
+
+int json_tape_load(json_tape_t *tape, json_t **json_out, unsigned int flags)
+{
+    int ret = 0;
+    json_tape_loader_t loader;
+    json_builder_t *builder = &loader.builder;
+    json_tape_frame_t *frame;
+    const char *key;
+    size_t key_len, value;
+
+    loader.tape = tape;
+    loader.frames = NULL;
+    loader.depth = 0;
+    loader.capacity = 0;
+    if ((ret = json_builder_init(builder, flags)) != 0)
+    { return ret; }
+
+    if ((ret = json_tape_load_value(&loader, 0)) != 0)
+    { goto fail; }
+    while (loader.depth != 0)
+    {
+        frame = &loader.frames[loader.depth - 1];
+        if (frame->next == frame->size)
+        {
+            if ((ret = json_builder_sax.on_end_array(builder)) != 0)
+            { goto fail; }
+            loader.depth--;
+            continue;
+        }
+        if (frame->type == JSON_NODE_TYPE_ARRAY)
+        {
+            value = json_tape_array_get(tape, frame->value, frame->next++);
+        }
+        else
+        {
+            value = json_tape_object_member(tape, frame->value, frame->next++, \
+                    &key, &key_len);
+            if ((value == JSON_TAPE_NONE) || \
+                    (json_builder_string(builder, (char *)key, key_len, 1) != 0))
+            { ret = -1; goto fail; }
+        }
+        if ((ret = json_tape_load_value(&loader, value)) != 0)
+        { goto fail; }
+    }
+
+    if ((ret = json_builder_finish(builder, json_out)) != 0)
+    { goto fail; }
+    if (flags & JSON_LOAD_INSITU)
+    { (*json_out)->borrowed = tape->pool; }
+
+fail:
+    if (loader.frames != NULL) free(loader.frames);
+    json_builder_fini(builder);
+    return ret;
+}
@@ -0,0 +1,89 @@
+/* JSON Library - worker threads */
+
+/* The parallel paths split their work into independent tasks numbered
+ * from 0 and let a few threads claim them off a shared counter, so a
+ * slow task holds up one thread rather than a whole static share.
+ * Threads are started per call; the tasks are meant to be big enough
+ * that this does not show. */
+
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "json_internal.h"
+
+typedef struct json_thread_work
+{
+    json_task_fn_t task;
+    void *ctx;
+    size_t count;
+    size_t next;
+    int failed;
+} json_thread_work_t;
+
+static void *json_thread_main(void *arg)
+{
+    json_thread_work_t *work = (json_thread_work_t *)arg;
+    size_t idx;
+
+    for (;;)
+    {
+        idx = __atomic_fetch_add(&work->next, 1, __ATOMIC_RELAXED);
+        if (idx >= work->count) break;
+        /* Once one task fails the rest are only drained */
+        if (__atomic_load_n(&work->failed, __ATOMIC_RELAXED)) continue;
+        if (work->task(work->ctx, idx) != 0)
+        { __atomic_store_n(&work->failed, 1, __ATOMIC_RELAXED); }
+    }
+    return NULL;
+}
+
+size_t json_thread_count(size_t nthreads)
+{
+    long online;
+
+    if (nthreads != 0) return nthreads;
+    online = sysconf(_SC_NPROCESSORS_ONLN);
+    return (online > 0) ? (size_t)online : 1;
+}
+
+int json_thread_run(size_t nthreads, size_t count, \
+        json_task_fn_t task, void *ctx)
+{
+    json_thread_work_t work;
+    pthread_t *threads = NULL;
+    size_t started = 0, idx;
+
+    nthreads = json_thread_count(nthreads);
+    if (nthreads > count) nthreads = count;
+
+    work.task = task;
+    work.ctx = ctx;
+    work.count = count;
+    work.next = 0;
+    work.failed = 0;
+
+    /* The calling thread is one of the workers; if threads cannot be
+     * started it simply does more of the work itself */
+    if (nthreads > 1)
+    {
+        threads = (pthread_t *)malloc(sizeof(pthread_t) * (nthreads - 1));
+        if (threads != NULL)
+        {
+            for (idx = 0; idx != nthreads - 1; idx++)
+            {
+                if (pthread_create(&threads[idx], NULL, \
+                            json_thread_main, &work) != 0)
+                { break; }
+                started++;
+            }
+        }
+    }
+    json_thread_main(&work);
+    for (idx = 0; idx != started; idx++)
+    { pthread_join(threads[idx], NULL); }
+    if (threads != NULL) free(threads);
+
+    return work.failed ? -1 : 0;
+}
@@ -5,7 +5,7 @@
 #include "json.h"
 
 
-static int test_int(int value, char *str_json)
+static int test_int(int64_t value, char *str_json)
 {
     int ret = 0;
     char *result_str = NULL;
@@ -31,6 +31,28 @@ fail:
     return ret;
 }
 
+static int test_double(double value, char *str_json)
+{
+    int ret = 0;
+    char *result_str = NULL;
+    size_t result_len;
+    json_t *new_json = NULL;
+
+    new_json = json_new();
+    json_set_root(new_json, json_node_new_double(value));
+
+    json_dump(new_json, &result_str, &result_len);
+    if (strlen(str_json) != result_len) 
+    { ret = -1; goto fail; }
+    if (strncmp(str_json, result_str, result_len) != 0)
+    { ret = -1; goto fail; }
+
+fail:
+    if (new_json != NULL) json_destroy(new_json);
+    if (result_str != NULL) free(result_str);
+    return ret;
+}
+
 static int test_load_dump(char *str_json)
 {
     int ret = 0;
@@ -56,6 +78,109 @@ fail:
     return ret;
 }
 
+static int test_load_dump_ex(char *str_json, unsigned int flags)
+{
+    int ret = 0;
+    char *result_str = NULL;
+    size_t result_len;
+    json_t *new_json = NULL;
+
+    fwrite(str_json, strlen(str_json), 1, stdout);
+    printf(":");
+    if ((ret = json_load_ex(&new_json, str_json, strlen(str_json), \
+                    flags)) != 0)
+    { goto fail; }
+    if ((ret = json_dump(new_json, &result_str, &result_len)) != 0)
+    { goto fail; }
+
+    if (strlen(str_json) != result_len) 
+    { ret = -1; goto fail; }
+    if (strncmp(str_json, result_str, result_len) != 0)
+    { ret = -1; goto fail; }
+
+fail:
+    if (new_json != NULL) json_destroy(new_json);
+    if (result_str != NULL) free(result_str);
+    return ret;
+}
+
+/* Every string of an in-situ load must point into the input */
+static int test_load_insitu(char *str_json, unsigned int flags)
+{
+    int ret = 0;
+    size_t len = strlen(str_json);
+    json_node_t *node, *name;
+    json_t *new_json = NULL;
+
+    if ((ret = json_load_ex(&new_json, str_json, len, \
+                    flags | JSON_LOAD_INSITU)) != 0)
+    { goto fail; }
+    if (new_json->borrowed != str_json)
+    { ret = -1; goto fail; }
+
+    /* {"key":"value",...} */
+    if (new_json->root->type != JSON_NODE_TYPE_OBJECT)
+    { ret = -1; goto fail; }
+    name = new_json->root->u.object_part->begin->name;
+    node = new_json->root->u.object_part->begin->value;
+    if ((name->u.string_part.str != str_json + 2) || \
+            (name->u.string_part.len != 3))
+    { ret = -1; goto fail; }
+    if ((node->u.string_part.str != str_json + 8) || \
+            (node->u.string_part.len != 5))
+    { ret = -1; goto fail; }
+
+fail:
+    if (new_json != NULL) json_destroy(new_json);
+    if (ret == 0) ret = test_load_dump_ex(str_json, flags | JSON_LOAD_INSITU);
+    return ret;
+}
+
+static int test_load_append(void)
+{
+    int ret = 0;
+    char *result_str = NULL;
+    size_t result_len;
+    char *str_in = "[1,{\"zero\":0}]";
+    char *str_json = "[1,{\"zero\":0,\"one\":1},2]";
+    json_t *new_json = NULL;
+    json_node_t *new_json_elem = NULL;
+    json_node_t *new_json_elem_name = NULL;
+    json_node_t *object_node;
+
+    if ((ret = json_load(&new_json, str_in, strlen(str_in))) != 0)
+    { goto fail; }
+
+    /* Hand-built nodes linked into an arena-backed document */
+    new_json_elem = json_node_new_integer(2);
+    if ((ret = json_node_as_array_append(new_json->root, \
+                    new_json_elem)) != 0)
+    { goto fail; }
+    new_json_elem = NULL;
+    object_node = json_node_array_get(new_json->root, 1);
+    new_json_elem_name = json_node_new_string("one", 3);
+    new_json_elem = json_node_new_integer(1);
+    if ((ret = json_node_as_object_append(object_node, \
+                    new_json_elem_name, new_json_elem)) != 0)
+    { goto fail; }
+    new_json_elem_name = NULL;
+    new_json_elem = NULL;
+
+    if ((ret = json_dump(new_json, &result_str, &result_len)) != 0)
+    { goto fail; }
+    if (strlen(str_json) != result_len) 
+    { ret = -1; goto fail; }
+    if (strncmp(str_json, result_str, result_len) != 0)
+    { ret = -1; goto fail; }
+
+fail:
+    if (new_json != NULL) json_destroy(new_json);
+    if (new_json_elem != NULL) json_node_destroy(new_json_elem);
+    if (new_json_elem_name != NULL) json_node_destroy(new_json_elem_name);
+    if (result_str != NULL) free(result_str);
+    return ret;
+}
+
 static int test_str(char *str_in, char *str_json)
 {
     int ret = 0;
@@ -200,6 +325,52 @@ fail:
     return ret;
 }
 
+static int test_array_index(void)
+{
+    int ret = 0;
+    char *str_in = "[0,1,2,3,4,5,6,7,8,9]";
+    int idx;
+    json_t *new_json = NULL;
+    json_node_t *new_json_node = NULL;
+    json_node_t *new_json_elem = NULL;
+
+    if ((ret = json_load(&new_json, str_in, strlen(str_in))) != 0)
+    { goto fail; }
+    if (json_node_array_size(new_json->root) != 10)
+    { ret = -1; goto fail; }
+    for (idx = 0; idx != 10; idx++)
+    {
+        if (json_node_array_get(new_json->root, (size_t)idx)-> \
+                u.number_part.int_part != idx)
+        { ret = -1; goto fail; }
+    }
+    if (json_node_array_get(new_json->root, 10) != NULL)
+    { ret = -1; goto fail; }
+
+    new_json_node = json_node_new_array();
+    if ((ret = json_node_array_reserve(new_json_node, 1000)) != 0)
+    { goto fail; }
+    for (idx = 0; idx != 1000; idx++)
+    {
+        new_json_elem = json_node_new_integer(idx);
+        if ((ret = json_node_as_array_append(new_json_node, \
+                        new_json_elem)) != 0)
+        { goto fail; }
+        new_json_elem = NULL;
+    }
+    if (json_node_array_size(new_json_node) != 1000)
+    { ret = -1; goto fail; }
+    if (json_node_array_get(new_json_node, 999)-> \
+            u.number_part.int_part != 999)
+    { ret = -1; goto fail; }
+
+fail:
+    if (new_json != NULL) json_destroy(new_json);
+    if (new_json_node != NULL) json_node_destroy(new_json_node);
+    if (new_json_elem != NULL) json_node_destroy(new_json_elem);
+    return ret;
+}
+
 static int test_object(void)
 {
     int ret = 0;
@@ -249,18 +420,1966 @@ fail:
     return ret;
 }
 
-int main(int argc, char** argv)
+static int test_object_get(void)
 {
-    printf("%d\n", test_int(123, "123"));
-    printf("%d\n", test_int(-123, "-123"));
-    printf("%d\n", test_int(0, "0"));
-    printf("%d\n", test_str("abc", "\"abc\""));
-    printf("%d\n", test_str("\"", "\"\"\""));
-    printf("%d\n", test_null());
-    printf("%d\n", test_false());
-    printf("%d\n", test_true());
-    printf("%d\n", test_array());
-    printf("%d\n", test_object());
+    int ret = 0;
+    char key[16];
+    int idx;
+    json_node_t *new_json_node = NULL;
+    json_node_t *new_json_elem_name = NULL;
+    json_node_t *new_json_elem_value = NULL;
+    json_node_t *found;
+
+    /* Large enough to get a key index, small enough to start scanning */
+    new_json_node = json_node_new_object();
+    for (idx = 0; idx != 100; idx++)
+    {
+        sprintf(key, "key%d", idx);
+        new_json_elem_name = json_node_new_string(key, strlen(key));
+        new_json_elem_value = json_node_new_integer(idx);
+        if ((ret = json_node_as_object_append(new_json_node, \
+                new_json_elem_name, \
+                new_json_elem_value)) != 0)
+        { goto fail; }
+        new_json_elem_name = NULL;
+        new_json_elem_value = NULL;
+
+        if ((idx == 5) || (idx == 50) || (idx == 99))
+        {
+            /* Lookups before and after the index exists */
+            found = json_node_object_get(new_json_node, "key3", 4);
+            if ((found == NULL) || (found->u.number_part.int_part != 3))
+            { ret = -1; goto fail; }
+            found = json_node_object_get(new_json_node, key, strlen(key));
+            if ((found == NULL) || (found->u.number_part.int_part != idx))
+            { ret = -1; goto fail; }
+        }
+    }
+
+    /* Duplicates resolve to the first member */
+    new_json_elem_name = json_node_new_string("key7", 4);
+    new_json_elem_value = json_node_new_integer(-1);
+    if ((ret = json_node_as_object_append(new_json_node, \
+            new_json_elem_name, \
+            new_json_elem_value)) != 0)
+    { goto fail; }
+    new_json_elem_name = NULL;
+    new_json_elem_value = NULL;
+    found = json_node_object_get(new_json_node, "key7", 4);
+    if ((found == NULL) || (found->u.number_part.int_part != 7))
+    { ret = -1; goto fail; }
+
+    if (json_node_object_get(new_json_node, "key100", 6) != NULL)
+    { ret = -1; goto fail; }
+    if (json_node_object_get(new_json_node, "key", 3) != NULL)
+    { ret = -1; goto fail; }
+
+fail:
+    if (new_json_node != NULL) json_node_destroy(new_json_node);
+    if (new_json_elem_name != NULL) json_node_destroy(new_json_elem_name);
+    if (new_json_elem_value != NULL) json_node_destroy(new_json_elem_value);
+    return ret;
+}
+
+static int test_dump_modes(char *str_json)
+{
+    int ret = 0;
+    char *result_str = NULL;
+    size_t result_len;
+    char buf[64];
+    json_t *new_json = NULL;
+
+    if ((ret = json_load(&new_json, str_json, strlen(str_json))) != 0)
+    { goto fail; }
+
+    /* Two-pass exact size */
+    if ((ret = json_dump_ex(new_json, &result_str, &result_len, \
+                    JSON_DUMP_EXACT, 0)) != 0)
+    { goto fail; }
+    if ((strlen(str_json) != result_len) || \
+            (strcmp(str_json, result_str) != 0))
+    { ret = -1; goto fail; }
+    free(result_str);
+    result_str = NULL;
+
+    /* Single pass from a too small hint */
+    if ((ret = json_dump_ex(new_json, &result_str, &result_len, \
+                    JSON_DUMP_DEFAULT, 1)) != 0)
+    { goto fail; }
+    if ((strlen(str_json) != result_len) || \
+            (strcmp(str_json, result_str) != 0))
+    { ret = -1; goto fail; }
+
+    /* Caller buffer, exactly big enough and one byte short */
+    if ((ret = json_dump_buffer(new_json, buf, strlen(str_json) + 1, \
+                    &result_len)) != 0)
+    { goto fail; }
+    if ((strlen(str_json) != result_len) || (strcmp(str_json, buf) != 0))
+    { ret = -1; goto fail; }
+    if (json_dump_buffer(new_json, buf, strlen(str_json), &result_len) == 0)
+    { ret = -1; goto fail; }
+
+fail:
+    if (new_json != NULL) json_destroy(new_json);
+    if (result_str != NULL) free(result_str);
+    return ret;
+}
+
+/* An escape at every offset of a string longer than one vector step,
+ * round-tripped through load and both dump paths */
+static int test_long_string(void)
+{
+    int ret = 0;
+    char str_json[128];
+    char *result_str = NULL;
+    size_t result_len, len, pos, idx;
+    json_t *new_json = NULL;
+
+    for (pos = 1; pos != 96; pos++)
+    {
+        len = 0;
+        str_json[len++] = '\"';
+        for (idx = 1; idx != 100; idx++)
+        {
+            if (idx == pos) { str_json[len++] = '\\'; str_json[len++] = 'n'; }
+            else str_json[len++] = (char)('a' + (char)(idx % 26));
+        }
+        str_json[len++] = '\"';
+        str_json[len] = '\0';
+
+        if ((ret = json_load(&new_json, str_json, len)) != 0)
+        { goto fail; }
+        if ((ret = json_dump_ex(new_json, &result_str, &result_len, \
+                        JSON_DUMP_EXACT, 0)) != 0)
+        { goto fail; }
+        if ((result_len != len) || (strcmp(str_json, result_str) != 0))
+        { ret = -1; goto fail; }
+        free(result_str);
+        result_str = NULL;
+        if ((ret = json_dump(new_json, &result_str, &result_len)) != 0)
+        { goto fail; }
+        if ((result_len != len) || (strcmp(str_json, result_str) != 0))
+        { ret = -1; goto fail; }
+        free(result_str);
+        result_str = NULL;
+        json_destroy(new_json);
+        new_json = NULL;
+
+        /* Unterminated: the scan must stop at the end, not past it */
+        if (json_load(&new_json, str_json, len - 1) == 0)
+        { ret = -1; goto fail; }
+    }
+
+fail:
+    if (new_json != NULL) json_destroy(new_json);
+    if (result_str != NULL) free(result_str);
+    return ret;
+}
+
+typedef struct test_sink
+{
+    char *buf;
+    size_t len;
+    size_t calls;
+} test_sink_t;
+
+static int test_sink_write(void *ctx, const char *data, size_t len)
+{
+    test_sink_t *sink = (test_sink_t *)ctx;
+    char *new_buf = (char *)realloc(sink->buf, sink->len + len);
+
+    if (new_buf == NULL) return -1;
+    memcpy(new_buf + sink->len, data, len);
+    sink->buf = new_buf;
+    sink->len += len;
+    sink->calls++;
+    return 0;
+}
+
+static int test_dump_stream(void)
+{
+    int ret = 0;
+    char *result_str = NULL;
+    size_t result_len;
+    char *long_str = NULL;
+    size_t long_len = 200000;
+    int idx;
+    test_sink_t sink = { NULL, 0, 0 };
+    FILE *fp = NULL;
+    char *file_str = NULL;
+    json_t *new_json = NULL;
+    json_node_t *new_json_node = NULL;
+    json_node_t *new_json_elem = NULL;
+
+    /* Bigger than the staging buffer, with one string longer than it */
+    if ((long_str = (char *)malloc(long_len)) == NULL)
+    { ret = -1; goto fail; }
+    memset(long_str, 'a', long_len);
+    new_json = json_new();
+    new_json_node = json_node_new_array();
+    for (idx = 0; idx != 20000; idx++)
+    {
+        new_json_elem = json_node_new_integer(idx);
+        if ((ret = json_node_as_array_append(new_json_node, \
+                        new_json_elem)) != 0)
+        { goto fail; }
+        new_json_elem = NULL;
+    }
+    new_json_elem = json_node_new_string(long_str, long_len);
+    if ((ret = json_node_as_array_append(new_json_node, \
+                    new_json_elem)) != 0)
+    { goto fail; }
+    new_json_elem = NULL;
+    json_set_root(new_json, new_json_node);
+    new_json_node = NULL;
+
+    if ((ret = json_dump(new_json, &result_str, &result_len)) != 0)
+    { goto fail; }
+
+    if ((ret = json_dump_cb(new_json, test_sink_write, &sink)) != 0)
+    { goto fail; }
+    if ((sink.len != result_len) || (sink.calls < 2) || \
+            (memcmp(sink.buf, result_str, result_len) != 0))
+    { ret = -1; goto fail; }
+
+    if ((fp = tmpfile()) == NULL)
+    { ret = -1; goto fail; }
+    if ((ret = json_dump_file(new_json, fp)) != 0)
+    { goto fail; }
+    if ((size_t)ftell(fp) != result_len)
+    { ret = -1; goto fail; }
+    rewind(fp);
+    if ((file_str = (char *)malloc(result_len)) == NULL)
+    { ret = -1; goto fail; }
+    if ((fread(file_str, 1, result_len, fp) != result_len) || \
+            (memcmp(file_str, result_str, result_len) != 0))
+    { ret = -1; goto fail; }
+
+fail:
+    if (new_json != NULL) json_destroy(new_json);
+    if (new_json_node != NULL) json_node_destroy(new_json_node);
+    if (new_json_elem != NULL) json_node_destroy(new_json_elem);
+    if (result_str != NULL) free(result_str);
+    if (long_str != NULL) free(long_str);
+    if (sink.buf != NULL) free(sink.buf);
+    if (file_str != NULL) free(file_str);
+    if (fp != NULL) fclose(fp);
+    return ret;
+}
+
+typedef struct test_sax_count
+{
+    int objects, arrays, keys, strings, integers, bools, nulls;
+    int depth;
+} test_sax_count_t;
+
+static int test_sax_on_start_object(void *ctx)
+{
+    ((test_sax_count_t *)ctx)->objects++;
+    ((test_sax_count_t *)ctx)->depth++;
+    return 0;
+}
+
+static int test_sax_on_start_array(void *ctx)
+{
+    ((test_sax_count_t *)ctx)->arrays++;
+    ((test_sax_count_t *)ctx)->depth++;
+    return 0;
+}
+
+static int test_sax_on_end(void *ctx)
+{
+    ((test_sax_count_t *)ctx)->depth--;
+    return 0;
+}
+
+static int test_sax_on_key(void *ctx, char *str, size_t len)
+{
+    (void)str;
+    (void)len;
+    ((test_sax_count_t *)ctx)->keys++;
+    return 0;
+}
+
+static int test_sax_on_string(void *ctx, char *str, size_t len)
+{
+    (void)str;
+    (void)len;
+    ((test_sax_count_t *)ctx)->strings++;
+    return 0;
+}
+
+static int test_sax_on_integer(void *ctx, int64_t value)
+{
+    (void)value;
+    ((test_sax_count_t *)ctx)->integers++;
+    return 0;
+}
+
+static int test_sax_on_bool(void *ctx, int value)
+{
+    (void)value;
+    ((test_sax_count_t *)ctx)->bools++;
+    return 0;
+}
+
+static int test_sax_on_null(void *ctx)
+{
+    ((test_sax_count_t *)ctx)->nulls++;
+    return 0;
+}
+
+static int test_sax_on_stop(void *ctx, int value)
+{
+    (void)ctx;
+    return value;
+}
+
+static int test_sax(void)
+{
+    char *str_json = "{\"a\":[1,2,{\"b\":\"c\"}],\"d\":true,\"e\":null,\"f\":[[],{}]}";
+    test_sax_count_t count;
+    json_sax_t sax;
+
+    memset(&sax, 0, sizeof(sax));
+    sax.on_start_object = test_sax_on_start_object;
+    sax.on_end_object = test_sax_on_end;
+    sax.on_start_array = test_sax_on_start_array;
+    sax.on_end_array = test_sax_on_end;
+    sax.on_key = test_sax_on_key;
+    sax.on_string = test_sax_on_string;
+    sax.on_integer = test_sax_on_integer;
+    sax.on_bool = test_sax_on_bool;
+    sax.on_null = test_sax_on_null;
+
+    memset(&count, 0, sizeof(count));
+    if (json_sax_parse(str_json, strlen(str_json), &sax, &count) != 0)
+    { return -1; }
+    if ((count.objects != 3) || (count.arrays != 3) || (count.keys != 5) || \
+            (count.strings != 1) || (count.integers != 2) || \
+            (count.bools != 1) || (count.nulls != 1) || (count.depth != 0))
+    { return -1; }
+
+    /* Malformed input and a callback asking to stop both fail */
+    if (json_sax_parse("[1,2", 4, &sax, &count) == 0) return -1;
+    if (json_sax_parse("{1:2}", 5, &sax, &count) == 0) return -1;
+    if (json_sax_parse("[nul]", 5, &sax, &count) == 0) return -1;
+    sax.on_bool = test_sax_on_stop;
+    if (json_sax_parse("[false]", 7, &sax, &count) != 0) return -1;
+    if (json_sax_parse("[true]", 6, &sax, &count) == 0) return -1;
+
+    return 0;
+}
+
+/* Every chunk size must give what json_load gives */
+static int test_parser(char *str_json)
+{
+    int ret = 0;
+    char *expect_str = NULL, *result_str = NULL;
+    size_t expect_len, result_len, len = strlen(str_json);
+    size_t chunk, pos, step;
+    json_t *expect_json = NULL, *new_json = NULL;
+    json_parser_t *parser = NULL;
+
+    fwrite(str_json, len, 1, stdout);
+    printf(":");
+    if ((ret = json_load(&expect_json, str_json, len)) != 0)
+    { goto fail; }
+    if ((ret = json_dump(expect_json, &expect_str, &expect_len)) != 0)
+    { goto fail; }
+    if ((parser = json_parser_new(JSON_LOAD_DEFAULT)) == NULL)
+    { ret = -1; goto fail; }
+
+    for (chunk = 1; chunk <= len; chunk++)
+    {
+        for (pos = 0; pos < len; pos += step)
+        {
+            step = (len - pos < chunk) ? len - pos : chunk;
+            if ((ret = json_parser_feed(parser, str_json + pos, step)) != 0)
+            { goto fail; }
+        }
+        if ((ret = json_parser_finish(parser, &new_json)) != 0)
+        { goto fail; }
+        if ((ret = json_dump(new_json, &result_str, &result_len)) != 0)
+        { goto fail; }
+        if ((expect_len != result_len) || \
+                (memcmp(expect_str, result_str, result_len) != 0))
+        { ret = -1; goto fail; }
+        json_destroy(new_json);
+        new_json = NULL;
+        free(result_str);
+        result_str = NULL;
+    }
+
+fail:
+    if (expect_json != NULL) json_destroy(expect_json);
+    if (new_json != NULL) json_destroy(new_json);
+    if (parser != NULL) json_parser_destroy(parser);
+    if (expect_str != NULL) free(expect_str);
+    if (result_str != NULL) free(result_str);
+    return ret;
+}
+
+static int test_parser_fail(char *str_json)
+{
+    int ret = 0;
+    json_t *new_json = NULL;
+    json_parser_t *parser = NULL;
+
+    if ((parser = json_parser_new(JSON_LOAD_HEAP)) == NULL)
+    { return -1; }
+    if ((json_parser_feed(parser, str_json, strlen(str_json)) == 0) && \
+            (json_parser_finish(parser, &new_json) == 0))
+    { ret = -1; }
+
+    if (new_json != NULL) json_destroy(new_json);
+    json_parser_destroy(parser);
+    return ret;
+}
+
+/* The indexed engine has to accept what json_load accepts and build
+ * the same tree from it */
+static int test_indexed(char *str_json)
+{
+    int ret = 0;
+    char *expect_str = NULL, *result_str = NULL;
+    size_t expect_len, result_len, len = strlen(str_json);
+    int expect_ret;
+    json_t *expect_json = NULL, *new_json = NULL;
+
+    expect_ret = json_load(&expect_json, str_json, len);
+    ret = json_load_ex(&new_json, str_json, len, JSON_LOAD_INDEXED);
+    if ((ret == 0) != (expect_ret == 0))
+    { ret = -1; goto fail; }
+    if (ret != 0)
+    { ret = 0; goto fail; }
+
+    if ((ret = json_dump(expect_json, &expect_str, &expect_len)) != 0)
+    { goto fail; }
+    if ((ret = json_dump(new_json, &result_str, &result_len)) != 0)
+    { goto fail; }
+    if ((expect_len != result_len) || \
+            (memcmp(expect_str, result_str, result_len) != 0))
+    { ret = -1; goto fail; }
+
+fail:
+    if (expect_json != NULL) json_destroy(expect_json);
+    if (new_json != NULL) json_destroy(new_json);
+    if (expect_str != NULL) free(expect_str);
+    if (result_str != NULL) free(result_str);
+    return ret;
+}
+
+static int test_load_fail(char *str_json)
+{
+    json_t *new_json = NULL;
+
+    if (json_load(&new_json, str_json, strlen(str_json)) == 0)
+    {
+        json_destroy(new_json);
+        return -1;
+    }
+    return test_parser_fail(str_json);
+}
+
+typedef struct test_sax_body
+{
+    char *str;
+    size_t len;
+} test_sax_body_t;
+
+static int test_sax_on_body(void *ctx, char *str, size_t len)
+{
+    ((test_sax_body_t *)ctx)->str = str;
+    ((test_sax_body_t *)ctx)->len = len;
+    return 0;
+}
+
+/* The loaded root string has to hold the decoded bytes, through every
+ * engine, and decoding the raw SAX body has to give the same */
+static int test_unescape(char *str_json, char *expect, size_t expect_len)
+{
+    int ret = 0;
+    unsigned int flags[] = { JSON_LOAD_DEFAULT, JSON_LOAD_HEAP, \
+        JSON_LOAD_INSITU, JSON_LOAD_INDEXED | JSON_LOAD_INSITU };
+    char *buf = NULL;
+    size_t idx, len = strlen(str_json);
+    test_sax_body_t body;
+    json_sax_t sax;
+    json_t *new_json = NULL;
+
+    for (idx = 0; idx < sizeof(flags) / sizeof(flags[0]); idx++)
+    {
+        if ((ret = json_load_ex(&new_json, str_json, len, flags[idx])) != 0)
+        { goto fail; }
+        if ((new_json->root->type != JSON_NODE_TYPE_STRING) || \
+                (new_json->root->u.string_part.len != expect_len) || \
+                (memcmp(new_json->root->u.string_part.str, expect, \
+                        expect_len) != 0))
+        { ret = -1; goto fail; }
+        json_destroy(new_json);
+        new_json = NULL;
+    }
+
+    memset(&sax, 0, sizeof(sax));
+    sax.on_string = test_sax_on_body;
+    if ((ret = json_sax_parse(str_json, len, &sax, &body)) != 0)
+    { goto fail; }
+    if ((buf = (char *)malloc(body.len + 1)) == NULL)
+    { ret = -1; goto fail; }
+    if ((json_string_unescape(body.str, body.len, buf) != expect_len) || \
+            (memcmp(buf, expect, expect_len) != 0))
+    { ret = -1; goto fail; }
+
+fail:
+    if (new_json != NULL) json_destroy(new_json);
+    if (buf != NULL) free(buf);
+    return ret;
+}
+
+/* The loaded root has to be the integer value, through every engine */
+static int test_number_int(char *str_json, int64_t value)
+{
+    int ret = 0;
+    json_t *new_json = NULL;
+
+    if ((ret = json_load(&new_json, str_json, strlen(str_json))) != 0)
+    { goto fail; }
+    if ((new_json->root->type != JSON_NODE_TYPE_INTEGER) || \
+            (new_json->root->u.number_part.int_part != value))
+    { ret = -1; goto fail; }
+    if ((ret = test_indexed(str_json)) != 0)
+    { goto fail; }
+    ret = test_parser(str_json);
+
+fail:
+    if (new_json != NULL) json_destroy(new_json);
+    return ret;
+}
+
+/* The loaded root has to be the double value, bit for bit */
+static int test_number_double(char *str_json, double value)
+{
+    int ret = 0;
+    unsigned int flags[] = { JSON_LOAD_DEFAULT, JSON_LOAD_INDEXED };
+    size_t idx;
+    json_t *new_json = NULL;
+
+    for (idx = 0; idx < sizeof(flags) / sizeof(flags[0]); idx++)
+    {
+        if ((ret = json_load_ex(&new_json, str_json, strlen(str_json), \
+                        flags[idx])) != 0)
+        { goto fail; }
+        if ((new_json->root->type != JSON_NODE_TYPE_DOUBLE) || \
+                (memcmp(&new_json->root->u.number_part.double_part, \
+                        &value, sizeof(value)) != 0))
+        { ret = -1; goto fail; }
+        json_destroy(new_json);
+        new_json = NULL;
+    }
+
+fail:
+    if (new_json != NULL) json_destroy(new_json);
+    return ret;
+}
+
+/* Pretty-printed input has to load to the same tree as its minified
+ * form, through every engine */
+static int test_whitespace(char *str_json, char *str_min)
+{
+    int ret = 0;
+    char *result_str = NULL;
+    size_t result_len;
+    json_t *new_json = NULL;
+
+    if ((ret = json_load(&new_json, str_json, strlen(str_json))) != 0)
+    { goto fail; }
+    if ((ret = json_dump(new_json, &result_str, &result_len)) != 0)
+    { goto fail; }
+    if ((strlen(str_min) != result_len) || (strcmp(str_min, result_str) != 0))
+    { ret = -1; goto fail; }
+
+    if ((ret = test_indexed(str_json)) != 0)
+    { goto fail; }
+    if ((ret = test_parser(str_json)) != 0)
+    { goto fail; }
+
+fail:
+    if (new_json != NULL) json_destroy(new_json);
+    if (result_str != NULL) free(result_str);
+    return ret;
+}
+
+/* Backslash runs and quotes ending on every offset of a 64 byte block */
+static int test_indexed_blocks(void)
+{
+    int ret = 0;
+    char str_json[256];
+    size_t pad, len, idx;
+
+    for (pad = 0; pad != 140; pad++)
+    {
+        len = 0;
+        str_json[len++] = '[';
+        str_json[len++] = '\"';
+        for (idx = 0; idx != pad; idx++) str_json[len++] = 'a';
+        memcpy(str_json + len, "\\\\\",{\"\\\\\\t\":[1,true]}]", 22);
+        len += 22;
+        str_json[len] = '\0';
+        if ((ret = test_indexed(str_json)) != 0) break;
+        /* Cut short: the parity carried across blocks must still fail */
+        str_json[len - 3] = '\0';
+        if ((ret = test_indexed(str_json)) != 0) break;
+    }
+    return ret;
+}
+
+/* depth arrays around a 1: "[[...[1]...]]" */
+static char *test_nested(size_t depth, size_t *len_out)
+{
+    char *str_json = NULL;
+
+    if ((str_json = (char *)malloc(depth * 2 + 2)) == NULL) return NULL;
+    memset(str_json, '[', depth);
+    str_json[depth] = '1';
+    memset(str_json + depth + 1, ']', depth);
+    str_json[depth * 2 + 1] = '\0';
+    *len_out = depth * 2 + 1;
+    return str_json;
+}
+
+/* Every engine stops at the nesting limit, and a loader with a higher
+ * one goes far past what recursion would survive */
+static int test_depth(void)
+{
+    int ret = 0;
+    unsigned int flags[] = { JSON_LOAD_DEFAULT, JSON_LOAD_INDEXED };
+    char *str_json = NULL;
+    size_t len, idx;
+    json_t *new_json = NULL;
+    json_loader_t *loader = NULL;
+
+    for (idx = 0; idx < sizeof(flags) / sizeof(flags[0]); idx++)
+    {
+        if ((str_json = test_nested(JSON_DEPTH_DEFAULT, &len)) == NULL)
+        { ret = -1; goto fail; }
+        if ((ret = json_load_ex(&new_json, str_json, len, flags[idx])) != 0)
+        { goto fail; }
+        json_destroy(new_json);
+        new_json = NULL;
+        free(str_json);
+
+        if ((str_json = test_nested(JSON_DEPTH_DEFAULT + 1, &len)) == NULL)
+        { ret = -1; goto fail; }
+        if ((ret = test_load_fail(str_json)) != 0)
+        { goto fail; }
+        if (json_load_ex(&new_json, str_json, len, flags[idx]) == 0)
+        { ret = -1; goto fail; }
+        free(str_json);
+        str_json = NULL;
+
+        /* The loader keeps its stacks across loads, failed ones too */
+        if ((loader = json_loader_new(flags[idx], 3)) == NULL)
+        { ret = -1; goto fail; }
+        if (json_loader_load(loader, &new_json, "[[[[1]]]]", 9) == 0)
+        { ret = -1; goto fail; }
+        if ((ret = json_loader_load(loader, &new_json, "[{\"a\":[1]}]", 11)) != 0)
+        { goto fail; }
+        json_destroy(new_json);
+        new_json = NULL;
+        if (json_loader_load(loader, &new_json, "{\"a\":[{\"b\":[]}]}", 16) == 0)
+        { ret = -1; goto fail; }
+        json_loader_destroy(loader);
+
+        if ((loader = json_loader_new(flags[idx], 1000000)) == NULL)
+        { ret = -1; goto fail; }
+        if ((str_json = test_nested(200000, &len)) == NULL)
+        { ret = -1; goto fail; }
+        if ((ret = json_loader_load(loader, &new_json, str_json, len)) != 0)
+        { goto fail; }
+        json_destroy(new_json);
+        new_json = NULL;
+        /* Unbalanced */
+        if (json_loader_load(loader, &new_json, str_json, len - 1) == 0)
+        { ret = -1; goto fail; }
+        free(str_json);
+        str_json = NULL;
+        json_loader_destroy(loader);
+        loader = NULL;
+    }
+
+fail:
+    if (new_json != NULL) json_destroy(new_json);
+    if (loader != NULL) json_loader_destroy(loader);
+    if (str_json != NULL) free(str_json);
+    return ret;
+}
+
+typedef struct test_many
+{
+    char *buf;
+    size_t len;
+    size_t capacity;
+    size_t count;
+    size_t stop;
+} test_many_t;
+
+/* Appends each document's dump and a newline */
+static int test_many_on_doc(void *ctx, size_t idx, json_t *json)
+{
+    test_many_t *many = (test_many_t *)ctx;
+    char *str = NULL, *new_buf = NULL;
+    size_t len, capacity;
+    int ret = 0;
+
+    if ((idx != many->count++) || (idx == many->stop))
+    { ret = -1; goto fail; }
+    if ((ret = json_dump(json, &str, &len)) != 0)
+    { goto fail; }
+    if (many->len + len + 1 > many->capacity)
+    {
+        capacity = (many->len + len + 1) * 2;
+        if ((new_buf = (char *)realloc(many->buf, capacity)) == NULL)
+        { ret = -1; goto fail; }
+        many->buf = new_buf;
+        many->capacity = capacity;
+    }
+    memcpy(many->buf + many->len, str, len);
+    many->len += len;
+    many->buf[many->len++] = '\n';
+
+fail:
+    json_destroy(json);
+    if (str != NULL) free(str);
+    return ret;
+}
+
+/* str_json loads to count documents that dump as str_expect, one per
+ * line, on every thread count */
+static int test_load_many(char *str_json, size_t count, char *str_expect)
+{
+    int ret = 0;
+    size_t nthreads[] = { 1, 2, 7 };
+    size_t idx;
+    test_many_t many;
+
+    many.buf = NULL;
+    many.capacity = 0;
+    for (idx = 0; idx < sizeof(nthreads) / sizeof(nthreads[0]); idx++)
+    {
+        many.len = 0;
+        many.count = 0;
+        many.stop = (size_t)-1;
+        if ((ret = json_load_many(str_json, strlen(str_json), \
+                        JSON_LOAD_DEFAULT, nthreads[idx], \
+                        test_many_on_doc, &many)) != 0)
+        { goto fail; }
+        if ((many.count != count) || (many.len != strlen(str_expect)) || \
+                ((many.len != 0) && \
+                 (memcmp(many.buf, str_expect, many.len) != 0)))
+        { ret = -1; goto fail; }
+    }
+
+fail:
+    if (many.buf != NULL) free(many.buf);
+    return ret;
+}
+
+static int test_load_many_fail(char *str_json)
+{
+    test_many_t many;
+    int ret;
+
+    many.buf = NULL;
+    many.capacity = 0;
+    many.len = 0;
+    many.count = 0;
+    many.stop = (size_t)-1;
+    ret = json_load_many(str_json, strlen(str_json), JSON_LOAD_DEFAULT, 4, \
+            test_many_on_doc, &many);
+    if (many.buf != NULL) free(many.buf);
+    return (ret != 0) ? 0 : -1;
+}
+
+/* Enough documents for many chunks, some spread over several lines and
+ * some with brackets and newline escapes in their strings, have to
+ * load as one json_load each would */
+static int test_load_many_chunks(void)
+{
+    int ret = 0;
+    size_t cap = (size_t)1 << 20, len = 0, expect_len = 0, idx;
+    char *str_json = NULL, *str_expect = NULL;
+    test_many_t many;
+
+    many.buf = NULL;
+    many.capacity = 0;
+    if (((str_json = (char *)malloc(cap)) == NULL) || \
+            ((str_expect = (char *)malloc(cap)) == NULL))
+    { ret = -1; goto fail; }
+    for (idx = 0; len < cap - 256; idx++)
+    {
+        switch (idx % 4)
+        {
+            case 0:
+                len += (size_t)sprintf(str_json + len, \
+                        "{\"id\":%lu,\"s\":\"]\\n}[\\\"{\"}\n", (unsigned long)idx);
+                expect_len += (size_t)sprintf(str_expect + expect_len, \
+                        "{\"id\":%lu,\"s\":\"]\\n}[\\\"{\"}\n", (unsigned long)idx);
+                break;
+            case 1:
+                len += (size_t)sprintf(str_json + len, \
+                        "[\n  %lu,\n  {\"a\": [\n    true\n  ]}\n]\n", (unsigned long)idx);
+                expect_len += (size_t)sprintf(str_expect + expect_len, \
+                        "[%lu,{\"a\":[true]}]\n", (unsigned long)idx);
+                break;
+            case 2:
+                len += (size_t)sprintf(str_json + len, "%lu ", (unsigned long)idx);
+                expect_len += (size_t)sprintf(str_expect + expect_len, \
+                        "%lu\n", (unsigned long)idx);
+                break;
+            default:
+                len += (size_t)sprintf(str_json + len, "\"x\" [] {}\r\n");
+                expect_len += (size_t)sprintf(str_expect + expect_len, \
+                        "\"x\"\n[]\n{}\n");
+                break;
+        }
+    }
+    str_json[len] = '\0';
+    str_expect[expect_len] = '\0';
+    if ((ret = test_load_many(str_json, idx + (idx / 4) * 2, str_expect)) != 0)
+    { goto fail; }
+
+    /* A callback asking to stop and a broken document far in */
+    many.len = 0;
+    many.count = 0;
+    many.stop = 1000;
+    if (json_load_many(str_json, len, JSON_LOAD_DEFAULT, 4, \
+                test_many_on_doc, &many) == 0)
+    { ret = -1; goto fail; }
+    str_json[len - 300] = ']';
+    if ((ret = test_load_many_fail(str_json)) != 0)
+    { goto fail; }
+
+fail:
+    if (str_json != NULL) free(str_json);
+    if (str_expect != NULL) free(str_expect);
+    if (many.buf != NULL) free(many.buf);
+    return ret;
+}
+
+/* A root holding about size bytes of members, with escapes, quotes,
+ * brackets and commas inside strings so chunk edges land everywhere,
+ * one member nested deep levels down, then tail after the root */
+static char *test_parallel_doc(char open, size_t size, size_t shift, \
+        size_t deep, const char *tail, size_t *len_out)
+{
+    static const char *members[] =
+    {
+        "\"s\\\"],{[\\\\\"",
+        "{\"a\":[1,{\"b\":\"x,y]\"}],\"c\":-1.5e3,\"d\":{}}",
+        "\"\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\"\"",
+        "[true,false,null,[],\"\\u00e9\\ud83d\\ude00\"]",
+        "12345678901234",
+        "\"\xc3\xa9t\xc3\xa9 [{,}]\\n\\t\\\\\"",
+    };
+    size_t count = sizeof(members) / sizeof(members[0]);
+    size_t len = 0, idx, level;
+    char *str = (char *)malloc(size + shift + deep * 2 + strlen(tail) + 256);
+
+    if (str == NULL) return NULL;
+    memset(str, ' ', shift);
+    len = shift;
+    str[len++] = open;
+    for (idx = 0; len < size; idx++)
+    {
+        if (idx != 0) str[len++] = ',';
+        if (idx % 7 == 3) str[len++] = '\n';
+        if (open == '{')
+        { len += (size_t)sprintf(str + len, "\"k%lu\":", (unsigned long)idx); }
+        if (idx == 100)
+        {
+            for (level = 0; level != deep; level++) str[len++] = '[';
+            for (level = 0; level != deep; level++) str[len++] = ']';
+        }
+        else
+        {
+            len += (size_t)sprintf(str + len, "%s", members[idx % count]);
+        }
+    }
+    str[len++] = (open == '[') ? ']' : '}';
+    len += (size_t)sprintf(str + len, "%s", tail);
+
+    *len_out = len;
+    return str;
+}
+
+/* json_load_parallel has to agree with json_load_ex, to the byte when
+ * both load */
+static int test_load_parallel(char *str_json, size_t len)
+{
+    int ret = 0;
+    unsigned int flags[] = { JSON_LOAD_DEFAULT, JSON_LOAD_HEAP, \
+        JSON_LOAD_INSITU };
+    size_t nthreads[] = { 2, 7 };
+    size_t idx, thread, serial_len = 0, parallel_len = 0;
+    int serial_ret, parallel_ret;
+    json_t *serial = NULL, *parallel = NULL;
+    char *serial_str = NULL, *parallel_str = NULL;
+
+    for (idx = 0; idx < sizeof(flags) / sizeof(flags[0]); idx++)
+    {
+        serial_ret = json_load_ex(&serial, str_json, len, flags[idx]);
+        if (serial_ret != 0) serial = NULL;
+        if ((serial != NULL) && \
+                ((ret = json_dump(serial, &serial_str, &serial_len)) != 0))
+        { goto fail; }
+        for (thread = 0; thread < sizeof(nthreads) / sizeof(nthreads[0]); \
+                thread++)
+        {
+            parallel_ret = json_load_parallel(&parallel, str_json, len, \
+                    flags[idx], nthreads[thread]);
+            if ((parallel_ret == 0) != (serial_ret == 0))
+            {
+                if (parallel_ret != 0) parallel = NULL;
+                ret = -1;
+                goto fail;
+            }
+            if (parallel_ret != 0)
+            {
+                parallel = NULL;
+                continue;
+            }
+            if ((ret = json_dump(parallel, &parallel_str, &parallel_len)) != 0)
+            { goto fail; }
+            if ((parallel_len != serial_len) || \
+                    (memcmp(parallel_str, serial_str, serial_len) != 0))
+            { ret = -1; goto fail; }
+            free(parallel_str);
+            parallel_str = NULL;
+            json_destroy(parallel);
+            parallel = NULL;
+        }
+        if (serial != NULL)
+        {
+            free(serial_str);
+            serial_str = NULL;
+            json_destroy(serial);
+            serial = NULL;
+        }
+    }
+
+fail:
+    if (serial != NULL) json_destroy(serial);
+    if (parallel != NULL) json_destroy(parallel);
+    if (serial_str != NULL) free(serial_str);
+    if (parallel_str != NULL) free(parallel_str);
+    return ret;
+}
+
+static int test_load_parallel_docs(void)
+{
+    int ret = 0;
+    size_t shifts[] = { 0, 1, 7, 13, 31, 63 };
+    size_t size = (size_t)300 << 10;
+    size_t len, idx, pos;
+    char *str_json = NULL;
+    char saved;
+
+    for (idx = 0; idx < sizeof(shifts) / sizeof(shifts[0]); idx++)
+    {
+        if ((str_json = test_parallel_doc((idx % 2) ? '{' : '[', size, \
+                        shifts[idx], 10, "", &len)) == NULL)
+        { ret = -1; goto fail; }
+        if ((ret = test_load_parallel(str_json, len)) != 0)
+        { goto fail; }
+        free(str_json);
+        str_json = NULL;
+    }
+
+    /* Trailing commas, what follows the root, and the nesting limit */
+    if ((str_json = test_parallel_doc('[', size, 0, \
+                    JSON_DEPTH_DEFAULT - 1, ",] x [", &len)) == NULL)
+    { ret = -1; goto fail; }
+    if ((ret = test_load_parallel(str_json, len)) != 0)
+    { goto fail; }
+    str_json[len - 6] = ' ';
+    if ((ret = test_load_parallel(str_json, len)) != 0)
+    { goto fail; }
+    free(str_json);
+    if ((str_json = test_parallel_doc('{', size, 0, \
+                    JSON_DEPTH_DEFAULT, "", &len)) == NULL)
+    { ret = -1; goto fail; }
+    if ((ret = test_load_parallel(str_json, len)) != 0)
+    { goto fail; }
+    free(str_json);
+
+    /* Broken documents fail either way; a byte changed inside a string
+     * may also leave them valid */
+    if ((str_json = test_parallel_doc('[', size, 5, 10, "", &len)) == NULL)
+    { ret = -1; goto fail; }
+    str_json[len - 1] = '}';
+    if ((ret = test_load_parallel(str_json, len)) != 0)
+    { goto fail; }
+    str_json[len - 1] = ']';
+    if ((ret = test_load_parallel(str_json, len - 1)) != 0)
+    { goto fail; }
+    for (idx = 1; idx != 16; idx++)
+    {
+        pos = len * idx / 16;
+        saved = str_json[pos];
+        str_json[pos] = "\"]\\,{"[idx % 5];
+        if ((ret = test_load_parallel(str_json, len)) != 0)
+        { goto fail; }
+        str_json[pos] = saved;
+    }
+
+fail:
+    if (str_json != NULL) free(str_json);
+    return ret;
+}
+
+/* json_dump_parallel has to give json_dump's output to the byte */
+static int test_dump_parallel(char *str_json, size_t len)
+{
+    int ret = 0;
+    size_t nthreads[] = { 1, 2, 7 };
+    size_t idx, serial_len = 0, parallel_len = 0;
+    json_t *json = NULL;
+    char *serial_str = NULL, *parallel_str = NULL;
+
+    if ((ret = json_load_ex(&json, str_json, len, JSON_LOAD_DEFAULT)) != 0)
+    { json = NULL; goto fail; }
+    if ((ret = json_dump(json, &serial_str, &serial_len)) != 0)
+    { goto fail; }
+    for (idx = 0; idx < sizeof(nthreads) / sizeof(nthreads[0]); idx++)
+    {
+        if ((ret = json_dump_parallel(json, &parallel_str, &parallel_len, \
+                        nthreads[idx])) != 0)
+        { goto fail; }
+        if ((parallel_len != serial_len) || \
+                (memcmp(parallel_str, serial_str, serial_len + 1) != 0))
+        { ret = -1; goto fail; }
+        free(parallel_str);
+        parallel_str = NULL;
+    }
+
+fail:
+    if (json != NULL) json_destroy(json);
+    if (serial_str != NULL) free(serial_str);
+    if (parallel_str != NULL) free(parallel_str);
+    return ret;
+}
+
+/* Big roots, and big containers held a few levels down by small ones */
+static int test_dump_parallel_docs(void)
+{
+    int ret = 0;
+    size_t size = (size_t)300 << 10;
+    size_t len, body_len, idx;
+    char *body = NULL, *str_json = NULL;
+
+    for (idx = 0; idx != 2; idx++)
+    {
+        if ((body = test_parallel_doc(idx ? '{' : '[', size, 0, 10, "", \
+                        &body_len)) == NULL)
+        { ret = -1; goto fail; }
+        if ((ret = test_dump_parallel(body, body_len)) != 0)
+        { goto fail; }
+
+        if ((str_json = (char *)malloc(body_len * 3 + 64)) == NULL)
+        { ret = -1; goto fail; }
+        len = (size_t)sprintf(str_json, "{\"meta\":{\"n\":[1,{}]},\"data\":");
+        memcpy(str_json + len, body, body_len);
+        len += body_len;
+        len += (size_t)sprintf(str_json + len, ",\"x\":[[[");
+        memcpy(str_json + len, body, body_len);
+        len += body_len;
+        len += (size_t)sprintf(str_json + len, ",[]]]],\"e\":\"\\u0000\"}");
+        if ((ret = test_dump_parallel(str_json, len)) != 0)
+        { goto fail; }
+
+        free(str_json);
+        str_json = NULL;
+        free(body);
+        body = NULL;
+    }
+
+fail:
+    if (body != NULL) free(body);
+    if (str_json != NULL) free(str_json);
+    return ret;
+}
+
+/* The value at the cursor as a tree, read through the cursor alone */
+static json_node_t *test_cursor_build(json_cursor_t *cursor)
+{
+    json_node_t *node = NULL, *name, *value;
+    const char *str;
+    size_t len;
+    int64_t int_value;
+    double double_value;
+    int bool_value, ret;
+
+    switch (json_cursor_type(cursor))
+    {
+        case JSON_NODE_TYPE_OBJECT:
+        case JSON_NODE_TYPE_ARRAY:
+            if (json_cursor_type(cursor) == JSON_NODE_TYPE_OBJECT)
+            { node = json_node_new_object(); }
+            else
+            { node = json_node_new_array(); }
+            if (node == NULL) return NULL;
+            for (ret = json_cursor_enter(cursor); ret == 0; \
+                    ret = json_cursor_next(cursor))
+            {
+                name = NULL;
+                if ((node->type == JSON_NODE_TYPE_OBJECT) && \
+                        ((json_cursor_key(cursor, &str, &len) != 0) || \
+                         ((name = json_node_new_string((char *)str, len)) == NULL)))
+                { break; }
+                if ((value = test_cursor_build(cursor)) == NULL)
+                {
+                    if (name != NULL) json_node_destroy(name);
+                    break;
+                }
+                if (name != NULL) json_node_as_object_append(node, name, value);
+                else json_node_as_array_append(node, value);
+            }
+            if (ret != 1)
+            {
+                json_node_destroy(node);
+                return NULL;
+            }
+            return node;
+        case JSON_NODE_TYPE_STRING:
+            if (json_cursor_get_string(cursor, &str, &len) != 0) return NULL;
+            return json_node_new_string((char *)str, len);
+        case JSON_NODE_TYPE_INTEGER:
+            if (json_cursor_get_integer(cursor, &int_value) != 0) return NULL;
+            return json_node_new_integer(int_value);
+        case JSON_NODE_TYPE_DOUBLE:
+            if (json_cursor_get_integer(cursor, &int_value) == 0) return NULL;
+            if (json_cursor_get_double(cursor, &double_value) != 0) return NULL;
+            return json_node_new_double(double_value);
+        case JSON_NODE_TYPE_TRUE:
+        case JSON_NODE_TYPE_FALSE:
+            if (json_cursor_get_bool(cursor, &bool_value) != 0) return NULL;
+            return bool_value ? json_node_new_true() : json_node_new_false();
+        case JSON_NODE_TYPE_NULL:
+            if (json_cursor_get_null(cursor) != 0) return NULL;
+            return json_node_new_null();
+        case JSON_NODE_TYPE_UNKNOWN:
+            break;
+    }
+    return NULL;
+}
+
+/* A tree read through a cursor has to dump like the loaded one, and a
+ * cursor skipping the root has to step past it as well */
+static int test_cursor(char *str_json)
+{
+    int ret = 0;
+    json_t *json = NULL, *built = NULL;
+    json_cursor_t *cursor = NULL;
+    char *str = NULL, *built_str = NULL;
+    size_t len, built_len;
+
+    if ((ret = json_load(&json, str_json, strlen(str_json))) != 0)
+    { json = NULL; goto fail; }
+    if ((ret = json_dump(json, &str, &len)) != 0)
+    { goto fail; }
+
+    if ((cursor = json_cursor_new(str_json, strlen(str_json), \
+                    JSON_LOAD_DEFAULT)) == NULL)
+    { ret = -1; goto fail; }
+    if ((built = json_new()) == NULL)
+    { ret = -1; goto fail; }
+    json_set_root(built, test_cursor_build(cursor));
+    if ((built->root == NULL) || (json_cursor_type(cursor) != JSON_NODE_TYPE_UNKNOWN))
+    { ret = -1; goto fail; }
+    if ((ret = json_dump(built, &built_str, &built_len)) != 0)
+    { goto fail; }
+    if ((built_len != len) || (memcmp(built_str, str, len) != 0))
+    { ret = -1; goto fail; }
+    json_cursor_destroy(cursor);
+
+    if ((cursor = json_cursor_new(str_json, strlen(str_json), \
+                    JSON_LOAD_DEFAULT)) == NULL)
+    { ret = -1; goto fail; }
+    if (json_cursor_next(cursor) != 1)
+    { ret = -1; goto fail; }
+
+fail:
+    if (cursor != NULL) json_cursor_destroy(cursor);
+    if (json != NULL) json_destroy(json);
+    if (built != NULL) json_destroy(built);
+    if (str != NULL) free(str);
+    if (built_str != NULL) free(built_str);
+    return ret;
+}
+
+/* Fields picked out of a document, skipping the rest; a padding
+ * string moves the skipped members across block edges */
+static int test_cursor_find(size_t pad)
+{
+    int ret = 0;
+    char str_json[1024];
+    json_cursor_t *cursor = NULL;
+    json_t *json = NULL;
+    const char *str;
+    size_t len;
+    int64_t int_value;
+    double double_value;
+    char *dump_str = NULL;
+    size_t dump_len;
+
+    len = (size_t)sprintf(str_json, "{\"pad\":\"%*s\",\"skip\":[\"]}\\\"[\", " \
+            "{\"x\":[[],{}]}, \"\\\\\"], \"\\u0061\" : 12, \"b\":{\"c\":" \
+            "[1,2.5,\"\\u00e9\"]},\"f\":{\"g\":[1,{\"h\":\"]\"}],\"i\":2}," \
+            "\"d\":-0.5e1 ,\"e\":[true,null]}", \
+            (int)pad, "");
+    if ((cursor = json_cursor_new(str_json, len, JSON_LOAD_DEFAULT)) == NULL)
+    { ret = -1; goto fail; }
+    if (json_cursor_enter(cursor) != 0) { ret = -1; goto fail; }
+    if (json_cursor_find(cursor, "a", 1) != 0) { ret = -1; goto fail; }
+    if ((json_cursor_key(cursor, &str, &len) != 0) || (len != 1) || \
+            (*str != 'a'))
+    { ret = -1; goto fail; }
+    if ((json_cursor_get_integer(cursor, &int_value) != 0) || \
+            (int_value != 12))
+    { ret = -1; goto fail; }
+
+    /* Into b.c, reading the third item only */
+    if (json_cursor_find(cursor, "b", 1) != 0) { ret = -1; goto fail; }
+    if (json_cursor_enter(cursor) != 0) { ret = -1; goto fail; }
+    if (json_cursor_find(cursor, "c", 1) != 0) { ret = -1; goto fail; }
+    if (json_cursor_enter(cursor) != 0) { ret = -1; goto fail; }
+    if ((json_cursor_next(cursor) != 0) || (json_cursor_next(cursor) != 0))
+    { ret = -1; goto fail; }
+    if ((json_cursor_get_string(cursor, &str, &len) != 0) || (len != 2) || \
+            (memcmp(str, "\xc3\xa9", 2) != 0))
+    { ret = -1; goto fail; }
+    if (json_cursor_next(cursor) != 1) { ret = -1; goto fail; }
+    if (json_cursor_next(cursor) != 1) { ret = -1; goto fail; }
+
+    /* Out of f from inside g */
+    if (json_cursor_find(cursor, "f", 1) != 0) { ret = -1; goto fail; }
+    if ((json_cursor_enter(cursor) != 0) || \
+            (json_cursor_find(cursor, "g", 1) != 0))
+    { ret = -1; goto fail; }
+    if (json_cursor_leave(cursor) != 0) { ret = -1; goto fail; }
+    if (json_cursor_find(cursor, "d", 1) != 0) { ret = -1; goto fail; }
+    if (json_cursor_type(cursor) != JSON_NODE_TYPE_DOUBLE)
+    { ret = -1; goto fail; }
+    if ((json_cursor_get_integer(cursor, &int_value) == 0) || \
+            (json_cursor_get_double(cursor, &double_value) != 0) || \
+            (double_value < -5.0) || (double_value > -5.0))
+    { ret = -1; goto fail; }
+    if (json_cursor_find(cursor, "e", 1) != 0) { ret = -1; goto fail; }
+    if ((ret = json_cursor_load(cursor, &json)) != 0)
+    { json = NULL; goto fail; }
+    if ((ret = json_dump(json, &dump_str, &dump_len)) != 0)
+    { goto fail; }
+    if ((dump_len != 11) || (memcmp(dump_str, "[true,null]", 11) != 0))
+    { ret = -1; goto fail; }
+
+    /* Keys come in order: a has gone by */
+    if (json_cursor_find(cursor, "a", 1) != 1) { ret = -1; goto fail; }
+    if (json_cursor_next(cursor) != 1) { ret = -1; goto fail; }
+
+fail:
+    if (cursor != NULL) json_cursor_destroy(cursor);
+    if (json != NULL) json_destroy(json);
+    if (dump_str != NULL) free(dump_str);
+    return ret;
+}
+
+/* Broken input read or skipped through a cursor fails */
+static int test_cursor_fail(char *str_json)
+{
+    int ret = 0;
+    json_cursor_t *cursor;
+    json_node_t *node;
+
+    if ((cursor = json_cursor_new(str_json, strlen(str_json), \
+                    JSON_LOAD_DEFAULT)) == NULL)
+    { return -1; }
+    if ((node = test_cursor_build(cursor)) != NULL)
+    {
+        json_node_destroy(node);
+        ret = -1;
+    }
+    json_cursor_destroy(cursor);
+    return ret;
+}
+
+/* The value a pointer reaches in str_json, dumped, against expected;
+ * NULL for none */
+static int test_pointer(char *str_json, const char *str_pointer, \
+        const char *expected)
+{
+    int ret = 0;
+    json_t *json = NULL, *result = NULL;
+    json_pointer_t *pointer = NULL;
+    json_node_t *node;
+    char *result_str = NULL;
+    size_t result_len;
+
+    if ((ret = json_load(&json, str_json, strlen(str_json))) != 0)
+    { json = NULL; goto fail; }
+    if ((pointer = json_pointer_compile(str_pointer, \
+                    strlen(str_pointer))) == NULL)
+    { ret = -1; goto fail; }
+    node = json_pointer_get(json, pointer);
+    if (node != json_pointer_get(json, pointer))
+    { ret = -1; goto fail; }
+    if ((node == NULL) || (expected == NULL))
+    {
+        ret = ((node == NULL) && (expected == NULL)) ? 0 : -1;
+        goto fail;
+    }
+
+    if ((result = json_new()) == NULL)
+    { ret = -1; goto fail; }
+    result->root = node;
+    ret = json_dump(result, &result_str, &result_len);
+    result->root = NULL;
+    if (ret != 0)
+    { goto fail; }
+    if ((result_len != strlen(expected)) || \
+            (memcmp(result_str, expected, result_len) != 0))
+    { ret = -1; goto fail; }
+
+fail:
+    if (pointer != NULL) json_pointer_destroy(pointer);
+    if (json != NULL) json_destroy(json);
+    if (result != NULL) json_destroy(result);
+    if (result_str != NULL) free(result_str);
+    return ret;
+}
+
+/* Pointers into an object big enough for a key index: they scan
+ * while it has none, leaving it without, and probe the one a
+ * json_node_object_get builds */
+static int test_pointer_index(void)
+{
+    int ret = 0;
+    json_t *json = NULL;
+    json_pointer_t *pointer = NULL;
+    json_node_t *node;
+    char *str = NULL;
+    size_t len = 0, idx;
+
+    if ((str = (char *)malloc(16 * 40 + 2)) == NULL) return -1;
+    str[len++] = '{';
+    for (idx = 0; idx != 40; idx++)
+    {
+        len += (size_t)sprintf(str + len, "%s\"k%lu\":%lu", \
+                (idx != 0) ? "," : "", (unsigned long)idx, (unsigned long)idx);
+    }
+    str[len++] = '}';
+    if ((ret = json_load(&json, str, len)) != 0)
+    { json = NULL; goto fail; }
+    if ((pointer = json_pointer_compile("/k39", 4)) == NULL)
+    { ret = -1; goto fail; }
+
+    node = json_pointer_get(json, pointer);
+    if ((node == NULL) || (node->u.number_part.int_part != 39) || \
+            (json->root->u.object_part->index != NULL))
+    { ret = -1; goto fail; }
+    if ((json_node_object_get(json->root, "k0", 2) == NULL) || \
+            (json->root->u.object_part->index == NULL) || \
+            (json_pointer_get(json, pointer) != node))
+    { ret = -1; goto fail; }
+
+fail:
+    if (pointer != NULL) json_pointer_destroy(pointer);
+    if (json != NULL) json_destroy(json);
+    free(str);
+    return ret;
+}
+
+static int test_pointer_fail(const char *str_pointer)
+{
+    json_pointer_t *pointer;
+
+    if ((pointer = json_pointer_compile(str_pointer, \
+                    strlen(str_pointer))) == NULL)
+    { return 0; }
+    json_pointer_destroy(pointer);
+    return -1;
+}
+
+/* The examples of RFC 6901, plus pointers that reach nothing */
+static int test_pointer_rfc(void)
+{
+    static char doc[] = "{\"foo\":[\"bar\",\"baz\"],\"\":0,\"a/b\":1," \
+        "\"c%d\":2,\"e^f\":3,\"g|h\":4,\"i\\\\j\":5,\"k\\\"l\":6,\" \":7,\"m~n\":8}";
+    static const char *cases[][2] =
+    {
+        { "", doc },
+        { "/foo", "[\"bar\",\"baz\"]" },
+        { "/foo/0", "\"bar\"" },
+        { "/", "0" },
+        { "/a~1b", "1" },
+        { "/c%d", "2" },
+        { "/e^f", "3" },
+        { "/g|h", "4" },
+        { "/i\\j", "5" },
+        { "/k\"l", "6" },
+        { "/ ", "7" },
+        { "/m~0n", "8" },
+        { "/foo/2", NULL },
+        { "/foo/-", NULL },
+        { "/foo/01", NULL },
+        { "/x", NULL },
+        { "/foo/0/y", NULL },
+        { "/m~1n", NULL },
+    };
+    size_t idx;
+
+    for (idx = 0; idx < sizeof(cases) / sizeof(cases[0]); idx++)
+    {
+        if (test_pointer(doc, cases[idx][0], cases[idx][1]) != 0)
+        { return -1; }
+    }
+    return 0;
+}
+
+/* str_json through the binary form and back, loaded with flags: the
+ * text and binary dumps of the reload match the originals, and every
+ * cut short binary fails to load */
+static int test_binary(char *str_json, unsigned int flags)
+{
+    int ret = 0;
+    json_t *json = NULL, *new_json = NULL;
+    char *str = NULL, *new_str = NULL, *buf = NULL, *new_buf = NULL;
+    size_t len, new_len, buf_len, new_buf_len, idx;
+
+    if ((ret = json_load(&json, str_json, strlen(str_json))) != 0)
+    { json = NULL; goto fail; }
+    if ((ret = json_dump(json, &str, &len)) != 0)
+    { str = NULL; goto fail; }
+    if ((ret = json_dump_binary(json, &buf, &buf_len)) != 0)
+    { buf = NULL; goto fail; }
+
+    for (idx = 0; idx != buf_len; idx++)
+    {
+        if (json_load_binary(&new_json, buf, idx, flags) == 0)
+        {
+            json_destroy(new_json);
+            new_json = NULL;
+            ret = -1;
+            goto fail;
+        }
+    }
+    if ((ret = json_load_binary(&new_json, buf, buf_len, flags)) != 0)
+    { new_json = NULL; goto fail; }
+    if ((ret = json_dump(new_json, &new_str, &new_len)) != 0)
+    { new_str = NULL; goto fail; }
+    if ((ret = json_dump_binary(new_json, &new_buf, &new_buf_len)) != 0)
+    { new_buf = NULL; goto fail; }
+    if ((new_len != len) || (memcmp(new_str, str, len) != 0) || \
+            (new_buf_len != buf_len) || (memcmp(new_buf, buf, buf_len) != 0))
+    { ret = -1; goto fail; }
+
+fail:
+    if (json != NULL) json_destroy(json);
+    if (new_json != NULL) json_destroy(new_json);
+    if (str != NULL) free(str);
+    if (new_str != NULL) free(new_str);
+    if (buf != NULL) free(buf);
+    if (new_buf != NULL) free(new_buf);
+    return ret;
+}
+
+static int test_binary_fail(const char *buf, size_t len)
+{
+    json_t *json;
+    char copy[64];
+
+    memcpy(copy, buf, len);
+    if (json_load_binary(&json, copy, len, JSON_LOAD_DEFAULT) != 0)
+    { return 0; }
+    json_destroy(json);
+    return -1;
+}
+
+/* str_json written to a file, padded with trailing spaces to size
+ * bytes, then loaded from it with flags; the file is gone before the
+ * document is dumped, so an in-situ one reads the mapping it kept */
+static int test_load_file(char *str_json, size_t size, unsigned int flags)
+{
+    static const char path[] = "test_load_file.json";
+    int ret = 0;
+    json_t *json = NULL, *new_json = NULL;
+    char *str = NULL, *new_str = NULL;
+    size_t len, new_len, idx;
+    FILE *fp;
+
+    if ((ret = json_load(&json, str_json, strlen(str_json))) != 0)
+    { json = NULL; goto fail; }
+    if ((ret = json_dump(json, &str, &len)) != 0)
+    { str = NULL; goto fail; }
+
+    if ((fp = fopen(path, "wb")) == NULL)
+    { ret = -1; goto fail; }
+    fputs(str_json, fp);
+    for (idx = strlen(str_json); idx < size; idx++) fputc(' ', fp);
+    if (fclose(fp) != 0)
+    { ret = -1; goto fail; }
+    ret = json_load_file(&new_json, path, flags);
+    remove(path);
+    if (ret != 0)
+    { new_json = NULL; goto fail; }
+
+    if ((ret = json_dump(new_json, &new_str, &new_len)) != 0)
+    { new_str = NULL; goto fail; }
+    if ((new_len != len) || (memcmp(new_str, str, len) != 0))
+    { ret = -1; goto fail; }
+
+fail:
+    if (json != NULL) json_destroy(json);
+    if (new_json != NULL) json_destroy(new_json);
+    if (str != NULL) free(str);
+    if (new_str != NULL) free(new_str);
+    return ret;
+}
+
+/* str_json in a file fails to load, as does a missing file for NULL */
+static int test_load_file_fail(const char *str_json)
+{
+    static const char path[] = "test_load_file.json";
+    json_t *json;
+    FILE *fp;
+    int ret;
+
+    if (str_json != NULL)
+    {
+        if ((fp = fopen(path, "wb")) == NULL) return -1;
+        fputs(str_json, fp);
+        if (fclose(fp) != 0) return -1;
+    }
+    ret = json_load_file(&json, path, JSON_LOAD_DEFAULT);
+    remove(path);
+    if (ret != 0) return 0;
+    json_destroy(json);
+    return -1;
+}
+
+/* The tape value at value against node: same type and contents, every
+ * member found by index and by key */
+static int test_tape_equal(json_tape_t *tape, size_t value, json_node_t *node)
+{
+    json_node_object_node_t *member;
+    const char *str, *key;
+    size_t len, key_len, idx;
+    int64_t int_value;
+    double double_value;
+
+    if (json_tape_type(tape, value) != node->type) return -1;
+    switch (node->type)
+    {
+        case JSON_NODE_TYPE_STRING:
+            return ((json_tape_get_string(tape, value, &str, &len) == 0) && \
+                    (len == node->u.string_part.len) && (str[len] == '\0') && \
+                    (memcmp(str, node->u.string_part.str, len) == 0)) ? 0 : -1;
+        case JSON_NODE_TYPE_INTEGER:
+            return ((json_tape_get_integer(tape, value, &int_value) == 0) && \
+                    (int_value == node->u.number_part.int_part)) ? 0 : -1;
+        case JSON_NODE_TYPE_DOUBLE:
+            return ((json_tape_get_double(tape, value, &double_value) == 0) && \
+                    (memcmp(&double_value, &node->u.number_part.double_part, \
+                            sizeof(double)) == 0)) ? 0 : -1;
+        case JSON_NODE_TYPE_ARRAY:
+            if (json_tape_size(tape, value) != node->u.array_part->size)
+            { return -1; }
+            for (idx = 0; idx != node->u.array_part->size; idx++)
+            {
+                if (test_tape_equal(tape, json_tape_array_get(tape, value, idx), \
+                            node->u.array_part->items[idx]) != 0)
+                { return -1; }
+            }
+            return (json_tape_array_get(tape, value, idx) == JSON_TAPE_NONE) ? \
+                0 : -1;
+        case JSON_NODE_TYPE_OBJECT:
+            if (json_tape_size(tape, value) != node->u.object_part->size)
+            { return -1; }
+            idx = 0;
+            for (member = node->u.object_part->begin; member != NULL; \
+                    member = member->next, idx++)
+            {
+                if ((test_tape_equal(tape, json_tape_object_member(tape, \
+                                    value, idx, &key, &key_len), \
+                                member->value) != 0) || \
+                        (key_len != member->name->u.string_part.len) || \
+                        (memcmp(key, member->name->u.string_part.str, key_len) != 0) || \
+                        (test_tape_equal(tape, json_tape_object_get(tape, value, \
+                                    key, key_len), json_node_object_get(node, \
+                                        key, key_len)) != 0))
+                { return -1; }
+            }
+            return (json_tape_object_get(tape, value, "?", 1) == JSON_TAPE_NONE) ? \
+                0 : -1;
+        case JSON_NODE_TYPE_FALSE:
+        case JSON_NODE_TYPE_TRUE:
+        case JSON_NODE_TYPE_NULL:
+            return 0;
+        case JSON_NODE_TYPE_UNKNOWN:
+            break;
+    }
+    return -1;
+}
+
+/* str_json to a tape: read in memory and from a file it matches the
+ * tree, and loads back with flags to the same text; the tape with any
+ * one byte changed reads and loads without going astray */
+static int test_tape(char *str_json, unsigned int flags)
+{
+    static const char path[] = "test_tape.tape";
+    int ret = 0;
+    json_t *json = NULL, *new_json = NULL;
+    json_tape_t *tape = NULL;
+    char *str = NULL, *new_str = NULL, *buf = NULL;
+    size_t len, new_len, buf_len, idx;
+    FILE *fp;
+
+    if ((ret = json_load(&json, str_json, strlen(str_json))) != 0)
+    { json = NULL; goto fail; }
+    if ((ret = json_dump(json, &str, &len)) != 0)
+    { str = NULL; goto fail; }
+    if ((ret = json_tape_dump(json, &buf, &buf_len)) != 0)
+    { buf = NULL; goto fail; }
+
+    if ((tape = json_tape_new(buf, buf_len)) == NULL)
+    { ret = -1; goto fail; }
+    if ((ret = test_tape_equal(tape, JSON_TAPE_ROOT, json->root)) != 0)
+    { goto fail; }
+    if ((ret = json_tape_load(tape, &new_json, flags)) != 0)
+    { new_json = NULL; goto fail; }
+    if ((ret = json_dump(new_json, &new_str, &new_len)) != 0)
+    { new_str = NULL; goto fail; }
+    if ((new_len != len) || (memcmp(new_str, str, len) != 0))
+    { ret = -1; goto fail; }
+    json_destroy(new_json);
+    new_json = NULL;
+    json_tape_destroy(tape);
+    tape = NULL;
+
+    if ((fp = fopen(path, "wb")) == NULL)
+    { ret = -1; goto fail; }
+    ret = (fwrite(buf, 1, buf_len, fp) == buf_len) ? 0 : -1;
+    if ((fclose(fp) != 0) || (ret != 0))
+    { ret = -1; goto fail; }
+    tape = json_tape_new_file(path);
+    remove(path);
+    if ((tape == NULL) || (test_tape_equal(tape, JSON_TAPE_ROOT, json->root) != 0))
+    { ret = -1; goto fail; }
+    json_tape_destroy(tape);
+    tape = NULL;
+
+    for (idx = 0; idx != buf_len; idx++)
+    {
+        buf[idx] = (char)(buf[idx] ^ 0x5a);
+        if ((tape = json_tape_new(buf, buf_len)) != NULL)
+        {
+            if (json_tape_load(tape, &new_json, flags) == 0)
+            { json_destroy(new_json); }
+            new_json = NULL;
+            json_tape_destroy(tape);
+            tape = NULL;
+        }
+        buf[idx] = (char)(buf[idx] ^ 0x5a);
+    }
+    if ((json_tape_new(buf, buf_len - 1) != NULL) || \
+            (json_tape_new(buf, sizeof(uint64_t)) != NULL))
+    { ret = -1; goto fail; }
+
+fail:
+    if (tape != NULL) json_tape_destroy(tape);
+    if (json != NULL) json_destroy(json);
+    if (new_json != NULL) json_destroy(new_json);
+    if (str != NULL) free(str);
+    if (new_str != NULL) free(new_str);
+    if (buf != NULL) free(buf);
+    return ret;
+}
+
+/* Records loaded with flags: their keys share name nodes, or not, as
+ * shared says; a key that is escaped in the text and one object of
+ * more distinct keys than are interned still read back */
+static int test_intern(unsigned int flags, int shared)
+{
+    static char str_json[] = "[{\"id\":1,\"name\":\"a\"},{\"id\":2,\"name\":\"b\"}," \
+        "{\"id\":3,\"n\\u0061me\":\"c\"}]";
+    int ret = 0;
+    json_t *json = NULL;
+    json_node_t *first, *second, *third, *node;
+    char *str = NULL, key[16];
+    size_t len, idx;
+
+    if ((ret = json_load_ex(&json, str_json, strlen(str_json), flags)) != 0)
+    { json = NULL; goto fail; }
+    first = json_node_array_get(json->root, 0);
+    second = json_node_array_get(json->root, 1);
+    third = json_node_array_get(json->root, 2);
+    if (((first->u.object_part->begin->name == \
+                    second->u.object_part->begin->name) != shared) || \
+            ((first->u.object_part->end->name == \
+              second->u.object_part->end->name) != shared) || \
+            (json_node_object_get(third, "name", 4) == NULL) || \
+            (json_node_object_get(first, first->u.object_part->end->name-> \
+                                  u.string_part.str, 4) != first->u.object_part->end->value))
+    { ret = -1; goto fail; }
+    json_destroy(json);
+    json = NULL;
+
+    /* {"k0":0,"k1":1,...} */
+    if ((str = (char *)malloc(20 * 2000 + 2)) == NULL)
+    { ret = -1; goto fail; }
+    len = 0;
+    str[len++] = '{';
+    for (idx = 0; idx != 2000; idx++)
+    {
+        len += (size_t)sprintf(str + len, "%s\"k%lu\":%lu", \
+                (idx != 0) ? "," : "", (unsigned long)idx, (unsigned long)idx);
+    }
+    str[len++] = '}';
+    if ((ret = json_load_ex(&json, str, len, flags)) != 0)
+    { json = NULL; goto fail; }
+    for (idx = 0; idx != 2000; idx++)
+    {
+        sprintf(key, "k%lu", (unsigned long)idx);
+        node = json_node_object_get(json->root, key, strlen(key));
+        if ((node == NULL) || (node->u.number_part.int_part != (int64_t)idx))
+        { ret = -1; goto fail; }
+    }
+
+fail:
+    if (json != NULL) json_destroy(json);
+    if (str != NULL) free(str);
+    return ret;
+}
+
+int main(int argc, char** argv)
+{
+    printf("%d\n", test_int(123, "123"));
+    printf("%d\n", test_int(-123, "-123"));
+    printf("%d\n", test_int(0, "0"));
+    printf("%d\n", test_int(INT64_MAX, "9223372036854775807"));
+    printf("%d\n", test_int(INT64_MIN, "-9223372036854775808"));
+    printf("%d\n", test_double(1.0, "1.0"));
+    printf("%d\n", test_double(-0.0, "-0.0"));
+    printf("%d\n", test_double(0.1, "0.1"));
+    printf("%d\n", test_double(1e21, "1e+21"));
+    printf("%d\n", test_double(123e18, "123000000000000000000.0"));
+    printf("%d\n", test_double(0.000001, "0.000001"));
+    printf("%d\n", test_double(1.5e-7, "1.5e-7"));
+    printf("%d\n", test_double(5e-324, "5e-324"));
+    printf("%d\n", test_double(1.7976931348623157e308, "1.7976931348623157e+308"));
+    printf("%d\n", test_double(1.0 / 3.0, "0.3333333333333333"));
+    printf("%d\n", test_str("abc", "\"abc\""));
+    printf("%d\n", test_str("\"", "\"\\\"\""));
+    printf("%d\n", test_str("a\\b/c\b\f\n\r\t\x01\x1f\x7f", \
+                "\"a\\\\b/c\\b\\f\\n\\r\\t\\u0001\\u001f\x7f\""));
+    printf("%d\n", test_str("\xe4\xb8\xad\"0123456789abcdef0123456789abcdef\\", \
+                "\"\xe4\xb8\xad\\\"0123456789abcdef0123456789abcdef\\\\\""));
+    printf("%d\n", test_null());
+    printf("%d\n", test_false());
+    printf("%d\n", test_true());
+    printf("%d\n", test_array());
+    printf("%d\n", test_object());
+    printf("%d\n", test_array_index());
+    printf("%d\n", test_object_get());
+    printf("%d\n", test_long_string());
+    printf("%d\n", test_dump_stream());
+    printf("%d\n", test_sax());
+    printf("%d\n", test_parser("{\"zero\":0,\"one\":[1,-23,\"a\\\\b\\tc\",null]}"));
+    printf("%d\n", test_parser("[true,false,{},[],{\"a\":{\"b\":[[]]}}]"));
+    printf("%d\n", test_parser("\"abc\""));
+    printf("%d\n", test_parser("-1234567"));
+    printf("%d\n", test_parser("[1,]"));
+    printf("%d\n", test_parser_fail("[1,2"));
+    printf("%d\n", test_parser_fail("{\"a\" 1}"));
+    printf("%d\n", test_parser_fail("[1}"));
+    printf("%d\n", test_parser_fail("\"abc"));
+    printf("%d\n", test_parser_fail("nul"));
+
+    printf("%d\n", test_indexed("{\"zero\":0,\"one\":[1,-23,\"a\\\\b\\tc\",null]}"));
+    printf("%d\n", test_indexed("[true,false,{},[],{\"a\":{\"b\":[[]]}}]"));
+    printf("%d\n", test_indexed("\"abc\""));
+    printf("%d\n", test_indexed("-1234567"));
+    printf("%d\n", test_indexed("[1,]"));
+    printf("%d\n", test_indexed("[1]]"));
+    printf("%d\n", test_indexed("[1,2"));
+    printf("%d\n", test_indexed("{\"a\" 1}"));
+    printf("%d\n", test_indexed("[1}"));
+    printf("%d\n", test_indexed("[1x]"));
+    printf("%d\n", test_indexed("[\"a\"1]"));
+    printf("%d\n", test_indexed("\"abc"));
+    printf("%d\n", test_indexed(""));
+    printf("%d\n", test_indexed_blocks());
+    printf("%d\n", test_depth());
+    printf("%d\n", test_load_many("{\"a\":1}\n[1,2]\n\"s\"\n3\n", 4, \
+                "{\"a\":1}\n[1,2]\n\"s\"\n3\n"));
+    printf("%d\n", test_load_many(" [1] [2]\n{\n\"a\":\n[3]\n}\nnull true", 5, \
+                "[1]\n[2]\n{\"a\":[3]}\nnull\ntrue\n"));
+    printf("%d\n", test_load_many(" \n\t", 0, ""));
+    printf("%d\n", test_load_many_fail("[1]\n[2"));
+    printf("%d\n", test_load_many_fail("[1]\n]"));
+    printf("%d\n", test_load_many_fail("[1] x"));
+    printf("%d\n", test_load_many_fail("{\"a\n\":1}"));
+    printf("%d\n", test_load_many_chunks());
+    printf("%d\n", test_load_parallel("[1,{\"a\":[2]},\"s\"]", 17));
+    printf("%d\n", test_load_parallel(" \"s\"", 4));
+    printf("%d\n", test_load_parallel_docs());
+    printf("%d\n", test_dump_parallel("[1,{\"a\":[2]},\"s\"]", 17));
+    printf("%d\n", test_dump_parallel_docs());
+    printf("%d\n", test_cursor("{\"a\":[1,-2.5e-3,\"x\\ty\",true,false,null,{}],\"\\u00e9\":[[]]}"));
+    printf("%d\n", test_cursor(" [ 9223372036854775808 , \"\\ud83d\\ude00\" ] "));
+    printf("%d\n", test_cursor("\"s\""));
+    printf("%d\n", test_cursor_find(0));
+    printf("%d\n", test_cursor_find(50));
+    printf("%d\n", test_cursor_find(61));
+    printf("%d\n", test_cursor_find(200));
+    printf("%d\n", test_cursor_fail("[1,]"));
+    printf("%d\n", test_cursor_fail("{\"a\" 1}"));
+    printf("%d\n", test_cursor_fail("[1 2]"));
+    printf("%d\n", test_cursor_fail("[\"\\x\"]"));
+    printf("%d\n", test_cursor_fail("{\"a\":[1}"));
+    printf("%d\n", test_cursor_fail("[tru]"));
+    printf("%d\n", test_pointer_rfc());
+    printf("%d\n", test_pointer("{\"a\":[1,{\"b\":[true]}]}", "/a/1/b/0", "true"));
+    printf("%d\n", test_pointer("[[0,[1,2,3,4,5,6,7,8,9,10,11]]]", "/0/1/10", "11"));
+    printf("%d\n", test_pointer_index());
+    printf("%d\n", test_pointer_fail("a"));
+    printf("%d\n", test_pointer_fail("/~"));
+    printf("%d\n", test_pointer_fail("/a~2"));
+    printf("%d\n", test_binary("null", JSON_LOAD_DEFAULT));
+    printf("%d\n", test_binary("\"\"", JSON_LOAD_DEFAULT));
+    printf("%d\n", test_binary("[[],{},[[]],{\"\":{}}]", JSON_LOAD_DEFAULT));
+    printf("%d\n", test_binary("[0,-1,9223372036854775807,-9223372036854775808," \
+                "0.1,-0.0,5e-324,1.7976931348623157e308,1e21,true,false,null]", \
+                JSON_LOAD_DEFAULT));
+    printf("%d\n", test_binary("{\"a\\u0000b\":\"\\\"\\\\\\n\\u001f\\u00e9\"," \
+                "\"\xe4\xb8\xad\":[\"0123456789abcdef0123456789abcdef0123456789" \
+                "abcdef0123456789abcdef0123456789abcdef0123456789abcdef\"]}", \
+                JSON_LOAD_DEFAULT));
+    printf("%d\n", test_binary("{\"a\":[1,{\"b\":[true,\"x\"]}],\"c\":{\"d\":2.5}," \
+                "\"a\":null}", JSON_LOAD_DEFAULT));
+    printf("%d\n", test_binary("{\"a\":[1,{\"b\":[true,\"x\"]}],\"c\":{\"d\":2.5}}", \
+                JSON_LOAD_HEAP));
+    printf("%d\n", test_binary("{\"a\":[1,{\"b\":[true,\"x\"]}],\"c\":{\"d\":2.5}}", \
+                JSON_LOAD_INSITU));
+    printf("%d\n", test_binary("{\"a\":[1,{\"b\":[true,\"x\"]}],\"c\":{\"d\":2.5}}", \
+                JSON_LOAD_HEAP | JSON_LOAD_INSITU));
+    printf("%d\n", test_binary_fail("JSNA\x01\x00", 6));
+    printf("%d\n", test_binary_fail("JSNB\x02\x00", 6));
+    printf("%d\n", test_binary_fail("JSNB\x01\x08", 6));
+    printf("%d\n", test_binary_fail("JSNB\x01\x00\x00", 7));
+    printf("%d\n", test_binary_fail("JSNB\x01\x06\x03\x00\x00", 9));
+    printf("%d\n", test_binary_fail("JSNB\x01\x06\xff\xff\xff\xff\xff\xff\xff\xff\xff\x7f", 16));
+    printf("%d\n", test_binary_fail("JSNB\x01\x05\x80\x80\x80\x80\x80\x80\x80\x80\x80\x80\x01", 17));
+    printf("%d\n", test_binary_fail("JSNB\x01\x07\x01\x05\x61", 9));
+    printf("%d\n", test_load_file("{\"a\":[1,\"x\\ty\",{\"b\":null}]}", 0, JSON_LOAD_DEFAULT));
+    printf("%d\n", test_load_file("{\"a\":[1,\"x\\ty\",{\"b\":null}]}", 0, JSON_LOAD_INSITU));
+    printf("%d\n", test_load_file("{\"a\":[1,\"x\\ty\",{\"b\":null}]}", 0, \
+                JSON_LOAD_HEAP | JSON_LOAD_INSITU));
+    printf("%d\n", test_load_file("[\"page\",\"end\"]", 4096, JSON_LOAD_INDEXED));
+    printf("%d\n", test_load_file("[\"page\",\"end\"]", 8192, JSON_LOAD_INSITU));
+    printf("%d\n", test_tape("0", JSON_LOAD_DEFAULT));
+    printf("%d\n", test_tape("[[],{},[[]],{\"\":{}},\"\"]", JSON_LOAD_DEFAULT));
+    printf("%d\n", test_tape("[0,-1,9223372036854775807,-9223372036854775808," \
+                "0.1,-0.0,5e-324,1e21,true,false,null,\"a\\u0000b\"]", \
+                JSON_LOAD_DEFAULT));
+    printf("%d\n", test_tape("{\"a\":[1,{\"b\":[true,\"x\"]}],\"c\":{\"d\":2.5}," \
+                "\"a\":null}", JSON_LOAD_HEAP));
+    printf("%d\n", test_tape("{\"k0\":0,\"k1\":1,\"k2\":2,\"k3\":3,\"k4\":4," \
+                "\"k5\":5,\"k6\":6,\"k7\":7,\"k8\":8,\"k9\":[9],\"k1\":-1," \
+                "\"\":{\"x\":0,\"y\":1,\"z\":2,\"w\":3,\"v\":4,\"u\":5,\"t\":6," \
+                "\"s\":7,\"r\":8,\"q\":9,\"p\":10}}", JSON_LOAD_INSITU));
+    printf("%d\n", test_intern(JSON_LOAD_DEFAULT, 1));
+    printf("%d\n", test_intern(JSON_LOAD_INSITU, 1));
+    printf("%d\n", test_intern(JSON_LOAD_INDEXED, 1));
+    printf("%d\n", test_intern(JSON_LOAD_HEAP, 0));
+    printf("%d\n", test_intern(JSON_LOAD_HEAP | JSON_LOAD_INSITU, 0));
+    printf("%d\n", test_load_file_fail("[1,2"));
+    printf("%d\n", test_load_file_fail(""));
+    printf("%d\n", test_load_file_fail(NULL));
+    printf("%d\n", test_whitespace(" [ 1 , 2 ,\n\t3 ] ", "[1,2,3]"));
+    printf("%d\n", test_whitespace("{\n  \"zero\" : 0,\r\n  \"one\" : " \
+                "[ true , null , \"a b\" ] ,\n  \"two\":{ }\n}\n", \
+                "{\"zero\":0,\"one\":[true,null,\"a b\"],\"two\":{}}"));
+    printf("%d\n", test_whitespace("[\n" \
+                "                                        1,\n" \
+                "                                        {\n" \
+                "                                                \"a\": -1\n" \
+                "                                        }\n" \
+                "]", "[1,{\"a\":-1}]"));
+    printf("%d\n", test_load_fail("[1 2]"));
+    printf("%d\n", test_load_fail("[tr ue]"));
+    printf("%d\n", test_load_fail("{\"a\" \"b\"}"));
+    printf("%d\n", test_load_fail(" \n\t "));
+    printf("%d\n", test_indexed("[1 2]"));
+    printf("%d\n", test_indexed("[tr ue]"));
+    printf("%d\n", test_indexed(" \n\t "));
+    printf("%d\n", test_number_int("9223372036854775807", INT64_MAX));
+    printf("%d\n", test_number_int("-9223372036854775808", INT64_MIN));
+    printf("%d\n", test_number_int("-0", 0));
+    printf("%d\n", test_number_double("9223372036854775808", 9223372036854775808.0));
+    printf("%d\n", test_number_double("0.1", 0.1));
+    printf("%d\n", test_number_double("-12.5e-3", -0.0125));
+    printf("%d\n", test_number_double("1E2", 100.0));
+    printf("%d\n", test_number_double("1e+2", 100.0));
+    printf("%d\n", test_number_double("-0.0", -0.0));
+    printf("%d\n", test_number_double("1.7976931348623157e308", 1.7976931348623157e308));
+    printf("%d\n", test_number_double("4.9406564584124654e-324", 4.9406564584124654e-324));
+    printf("%d\n", test_number_double("2.2250738585072011e-308", 2.2250738585072011e-308));
+    printf("%d\n", test_number_double("9007199254740993.0", 9007199254740992.0));
+    printf("%d\n", test_number_double("9007199254740993.0000000000000000001", \
+                9007199254740994.0));
+    printf("%d\n", test_number_double("1e-400", 0.0));
+    printf("%d\n", test_parser("[1.5,-2e10,3E-2,0.25]"));
+    printf("%d\n", test_load_fail("[-]"));
+    printf("%d\n", test_load_fail("[1.]"));
+    printf("%d\n", test_load_fail("[.5]"));
+    printf("%d\n", test_load_fail("[+1]"));
+    printf("%d\n", test_load_fail("[01]"));
+    printf("%d\n", test_load_fail("[1e]"));
+    printf("%d\n", test_load_fail("[1e+]"));
+    printf("%d\n", test_load_fail("[1e400]"));
+    printf("%d\n", test_indexed("[1.5,-2e10,1e400]"));
+    printf("%d\n", test_unescape("\"a\\u00e9b\"", "a\xc3\xa9" "b", 4));
+    printf("%d\n", test_unescape("\"\\u4E2D\"", "\xe4\xb8\xad", 3));
+    printf("%d\n", test_unescape("\"\\ud83d\\ude00\"", "\xf0\x9f\x98\x80", 4));
+    printf("%d\n", test_unescape("\"\\\"\\\\\\/\\b\\f\\n\\r\\t\"", \
+                "\"\\/\b\f\n\r\t", 8));
+    printf("%d\n", test_unescape("\"x\\u0000y\"", "x\0y", 3));
+    printf("%d\n", test_unescape("\"\xc3\xa9\xe4\xb8\xad\xf0\x9f\x98\x80\"", \
+                "\xc3\xa9\xe4\xb8\xad\xf0\x9f\x98\x80", 9));
+    printf("%d\n", test_parser("[\"\\u00e9\",\"\\ud83d\\ude00\",\"\xe4\xb8\xad\"]"));
+    printf("%d\n", test_load_fail("\"\\ud83d\""));
+    printf("%d\n", test_load_fail("\"\\ud83dx\""));
+    printf("%d\n", test_load_fail("\"\\ud83d\\u0041\""));
+    printf("%d\n", test_load_fail("\"\\ude00\""));
+    printf("%d\n", test_load_fail("\"\\u12g4\""));
+    printf("%d\n", test_load_fail("\"\\u12\""));
+    printf("%d\n", test_load_fail("\"\\x\""));
+    printf("%d\n", test_load_fail("\"a\x01" "b\""));
+    printf("%d\n", test_load_fail("\"a\tb\""));
+    printf("%d\n", test_load_fail("\"\xc0\x80\""));
+    printf("%d\n", test_load_fail("\"\xed\xa0\x80\""));
+    printf("%d\n", test_load_fail("\"\xf4\x90\x80\x80\""));
+    printf("%d\n", test_load_fail("\"\xf5\x80\x80\x80\""));
+    printf("%d\n", test_load_fail("\"\xe4\xb8\""));
+    printf("%d\n", test_load_fail("\"\x80\""));
+    printf("%d\n", test_load_fail("[\"0123456789abcdef0123456789abcdef" \
+                "0123456789\xe4\xb8\xad\xff\"]"));
+    printf("%d\n", test_indexed("[\"\\ud83d\"]"));
+    printf("%d\n", test_indexed("[\"a\x01" "b\"]"));
+    printf("%d\n", test_indexed("[\"\xed\xa0\x80\"]"));
+    printf("%d\n", test_indexed("[\"0123456789abcdef0123456789abcdef" \
+                "0123456789\xe4\xb8\xad\xff\"]"));
 
     printf("%d\n", test_load_dump("123"));
     printf("%d\n", test_load_dump("-123"));
@@ -274,11 +2393,23 @@ int main(int argc, char** argv)
     printf("%d\n", test_load_dump("[1,2,3]"));
     printf("%d\n", test_load_dump("{}"));
     printf("%d\n", test_load_dump("{\"zero\":0}"));
+    printf("%d\n", test_load_dump("\"\xc3\xa9\xf0\x9f\x98\x80\\n\xe4\xb8\xad\""));
+    printf("%d\n", test_load_dump("[0.5,-12.25,1e-7,2.5e+300]"));
+    printf("%d\n", test_load_dump("{\"pi\":3.141592653589793,\"e\":2.718281828459045}"));
     printf("%d\n", test_load_dump("{\"zero\":0,\"one\":1}"));
     printf("%d\n", test_load_dump("{\"zero\":0,\"one\":[]}"));
+    printf("%d\n", test_load_dump_ex("{\"zero\":0,\"one\":[1,\"abc\",null]}", \
+                JSON_LOAD_HEAP));
+    printf("%d\n", test_load_dump_ex("[{\"zero\":0},[true,false],\"abc\"]", \
+                JSON_LOAD_HEAP));
+    printf("%d\n", test_load_append());
+    printf("%d\n", test_load_insitu("{\"key\":\"value\",\"a\":[\"b\\\\c\"]}", \
+                JSON_LOAD_DEFAULT));
+    printf("%d\n", test_load_insitu("{\"key\":\"value\",\"a\":[\"b\\\\c\"]}", \
+                JSON_LOAD_HEAP));
+    printf("%d\n", test_dump_modes("{\"zero\":0,\"one\":[1,\"a\\\\b\",null]}"));
 
-    /* BUGGY */
-    /*printf("%d\n", test_load_dump("\"\\\"\""));*/
+    printf("%d\n", test_load_dump("\"\\\"\""));
     return 0;
 }
 